@@ -0,0 +1,381 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cache_cmd.h"
+
+#define CACHE_ENTRIES 64   // number of lines kept
+#define CACHE_BUCKETS 128  // must be a power of 2
+#define CACHE_MAX_LEN 4096 // longer lines are not cached
+
+/**
+ * @brief One cached line.
+ */
+struct cache_entry {
+    uint64_t hash;
+    char *text;        // the text of the line, NULL if the entry is free
+    struct line_template tpl;
+    int bucket_next;   // next entry of the same bucket, -1 at the end
+    int lru_prev;      // more recently used entry, -1 for the most recent
+    int lru_next;      // less recently used entry, -1 for the least recent
+};
+
+/**
+ * @brief Hash table (separate chaining) of the cached lines, ordered by use.
+ */
+static struct {
+    struct cache_entry entries[CACHE_ENTRIES];
+    int buckets[CACHE_BUCKETS]; // first entry of each bucket, -1 if empty
+    int lru_head;               // most recently used entry
+    int lru_tail;               // least recently used entry, evicted first
+    size_t count;
+    unsigned long hits;
+    unsigned long misses;
+    bool ready;
+} cache;
+
+
+/**
+ * @brief FNV-1a hash of a string.
+ *
+ * @param str The string.
+ * @param len The length of the string.
+ * @return uint64_t The hash.
+ */
+static uint64_t cache_hash(const char *str, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)str[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/**
+ * @brief Empty the cache.
+ */
+static void cache_clear() {
+    for (size_t i = 0; i < cache.count; ++i) {
+        free(cache.entries[i].text);
+        cache_template_free(&cache.entries[i].tpl);
+    }
+    memset(cache.entries, 0, sizeof(cache.entries));
+    for (int i = 0; i < CACHE_BUCKETS; ++i) {
+        cache.buckets[i] = -1;
+    }
+    cache.lru_head = -1;
+    cache.lru_tail = -1;
+    cache.count = 0;
+    cache.ready = true;
+}
+
+/**
+ * @brief Remove an entry from the LRU list.
+ *
+ * @param i The index of the entry.
+ */
+static void cache_unlink(int i) {
+    struct cache_entry *e = &cache.entries[i];
+    if (e->lru_prev != -1) {
+        cache.entries[e->lru_prev].lru_next = e->lru_next;
+    } else {
+        cache.lru_head = e->lru_next;
+    }
+    if (e->lru_next != -1) {
+        cache.entries[e->lru_next].lru_prev = e->lru_prev;
+    } else {
+        cache.lru_tail = e->lru_prev;
+    }
+}
+
+/**
+ * @brief Put an entry at the head of the LRU list.
+ *
+ * @param i The index of the entry (not in the list).
+ */
+static void cache_push_front(int i) {
+    struct cache_entry *e = &cache.entries[i];
+    e->lru_prev = -1;
+    e->lru_next = cache.lru_head;
+    if (cache.lru_head != -1) {
+        cache.entries[cache.lru_head].lru_prev = i;
+    } else {
+        cache.lru_tail = i;
+    }
+    cache.lru_head = i;
+}
+
+/**
+ * @brief Find the entry of a line.
+ *
+ * @param hash The hash of the text.
+ * @param str The text.
+ * @return int The index of the entry, or -1 if the line is not cached.
+ */
+static int cache_find(uint64_t hash, const char *str) {
+    for (int i = cache.buckets[hash & (CACHE_BUCKETS - 1)]; i != -1; i = cache.entries[i].bucket_next) {
+        if (cache.entries[i].hash == hash && strcmp(cache.entries[i].text, str) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Take a free entry, evicting the least recently used line if the cache is full.
+ *
+ * @return int The index of the entry (linked in no list).
+ */
+static int cache_take() {
+    if (cache.count < CACHE_ENTRIES) {
+        return cache.count++;
+    }
+
+    int i = cache.lru_tail;
+    struct cache_entry *e = &cache.entries[i];
+    cache_unlink(i);
+    int *link = &cache.buckets[e->hash & (CACHE_BUCKETS - 1)];
+    while (*link != i) {
+        link = &cache.entries[*link].bucket_next;
+    }
+    *link = e->bucket_next;
+    free(e->text);
+    cache_template_free(&e->tpl);
+    e->text = NULL;
+    return i;
+}
+
+/**
+ * @brief Copy a parsed line in a template.
+ *
+ * All the pipelines of the list starting at "li" are copied. The args of the
+ * commands may have been moved forward in the argv pool (to drop a keyword):
+ * only the args from cmd->args are copied.
+ *
+ * @param e The template.
+ * @param li The parsed line (not expanded).
+ * @return int Returns 0 on success, or -1 on failure.
+ */
+int cache_template_store(struct line_template *e, const struct line *li) {
+    size_t n_segs = 0;
+    size_t n_cmds = 0;
+    size_t n_redirs = 0;
+    size_t argv_len = 0;
+    size_t str_len = 0;
+    for (const struct line *seg = li; seg != NULL; seg = seg->next) {
+        n_segs++;
+        n_cmds += seg->n_cmds;
+        for (size_t i = 0; i < seg->n_cmds; ++i) {
+            const struct cmd *cmd = &seg->cmds[i];
+            argv_len += cmd->n_args + 1;
+            for (size_t k = 0; k < cmd->n_args; ++k) {
+                str_len += strlen(cmd->args[k]) + 1;
+            }
+            n_redirs += cmd->n_redirs;
+            for (size_t k = 0; k < cmd->n_redirs; ++k) {
+                str_len += cmd->redirs[k].target ? strlen(cmd->redirs[k].target) + 1 : 0;
+            }
+        }
+    }
+
+    size_t off_cmds = n_segs * sizeof(struct line);
+    size_t off_redirs = off_cmds + n_cmds * sizeof(struct cmd);
+    size_t off_argv = off_redirs + n_redirs * sizeof(struct redir);
+    size_t off_glob = off_argv + argv_len * sizeof(char *);
+    size_t off_str = off_glob + argv_len * sizeof(bool);
+    e->block = calloc(1, off_str + str_len);
+    if (e->block == NULL) {
+        perror("calloc");
+        return -1;
+    }
+    e->size = off_str + str_len;
+    e->n_segs = n_segs;
+    e->n_cmds = n_cmds;
+    e->n_redirs = n_redirs;
+    e->argv_len = argv_len;
+
+    struct line *segs = (struct line *)e->block;
+    struct cmd *cmds = (struct cmd *)(e->block + off_cmds);
+    struct redir *redirs = (struct redir *)(e->block + off_redirs);
+    char **pool = (char **)(e->block + off_argv);
+    char **argv = pool;
+    bool *globs = (bool *)(e->block + off_glob);
+    char *str = e->block + off_str;
+    for (const struct line *seg = li; seg != NULL; seg = seg->next, ++segs) {
+        segs->cmds = cmds;
+        segs->n_cmds = seg->n_cmds;
+        segs->argv = pool;
+        segs->argv_glob = (bool *)(e->block + off_glob);
+        segs->redirs = (struct redir *)(e->block + off_redirs);
+        segs->background = seg->background;
+        segs->next = seg->next != NULL ? segs + 1 : NULL;
+        segs->next_op = seg->next_op;
+        for (size_t i = 0; i < seg->n_cmds; ++i) {
+            const struct cmd *cmd = &seg->cmds[i];
+            const bool *cmd_globs = seg->argv_glob + (cmd->args - seg->argv);
+            *cmds++ = (struct cmd){ argv, cmd->n_args, NULL, 0, cmd->n_redirs ? redirs : NULL, cmd->n_redirs };
+            for (size_t k = 0; k < cmd->n_args; ++k) {
+                *globs++ = cmd_globs[k];
+                *argv++ = str;
+                str = stpcpy(str, cmd->args[k]) + 1;
+            }
+            *globs++ = false;
+            *argv++ = NULL;
+            for (size_t k = 0; k < cmd->n_redirs; ++k) {
+                *redirs = cmd->redirs[k];
+                if (redirs->target != NULL) {
+                    redirs->target = str;
+                    str = stpcpy(str, cmd->redirs[k].target) + 1;
+                }
+                redirs++;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Relocate a pointer of a template in its copy.
+ *
+ * @param from The block of the template.
+ * @param to The copy of the block.
+ * @param ptr The pointer in the block of the template, or NULL.
+ * @return void* The same pointer in the copy, or NULL.
+ */
+static void *cache_reloc(const char *from, char *to, const void *ptr) {
+    return ptr != NULL ? to + ((const char *)ptr - from) : NULL;
+}
+
+/**
+ * @brief Copy a template in the arena of a line, relocating its pointers.
+ *
+ * @param e The template.
+ * @param li The line to fill (after line_init() or line_reset()).
+ * @return int Returns 0 on success, or -1 on failure.
+ */
+int cache_template_load(const struct line_template *e, struct line *li) {
+    char *block = line_alloc(li, e->size);
+    if (block == NULL) {
+        return -1;
+    }
+    memcpy(block, e->block, e->size);
+
+    struct cmd *cmds = (struct cmd *)(block + e->n_segs * sizeof(struct line));
+    struct redir *redirs = (struct redir *)(cmds + e->n_cmds);
+    char **argv = (char **)(redirs + e->n_redirs);
+    for (size_t i = 0; i < e->argv_len; ++i) {
+        argv[i] = cache_reloc(e->block, block, argv[i]);
+    }
+    for (size_t i = 0; i < e->n_redirs; ++i) {
+        redirs[i].target = cache_reloc(e->block, block, redirs[i].target);
+    }
+    for (size_t i = 0; i < e->n_cmds; ++i) {
+        cmds[i].args = cache_reloc(e->block, block, cmds[i].args);
+        cmds[i].redirs = cache_reloc(e->block, block, cmds[i].redirs);
+    }
+
+    // The first pipeline is the line itself, the next ones stay in the copy
+    struct line *segs = (struct line *)block;
+    for (size_t i = 0; i < e->n_segs; ++i) {
+        struct line *seg = &segs[i];
+        seg->cmds = cache_reloc(e->block, block, seg->cmds);
+        seg->argv = cache_reloc(e->block, block, seg->argv);
+        seg->argv_glob = cache_reloc(e->block, block, seg->argv_glob);
+        seg->redirs = cache_reloc(e->block, block, seg->redirs);
+        seg->next = cache_reloc(e->block, block, seg->next);
+        seg->owner = li;
+    }
+    struct line_arena arena = li->arena;
+    *li = segs[0];
+    li->arena = arena;
+    li->owner = NULL;
+    return 0;
+}
+
+/**
+ * @brief Release the memory of a template.
+ *
+ * @param tpl The template.
+ */
+void cache_template_free(struct line_template *tpl) {
+    free(tpl->block);
+    tpl->block = NULL;
+}
+
+/**
+ * @brief Parse a command line, reusing the result of a previous parse of the same text.
+ *
+ * The successfully parsed lines are kept as immutable templates in a LRU cache
+ * indexed by the hash of their text. On a hit, the template is copied in the
+ * arena of the line and its pointers are relocated: the line is not tokenized
+ * again. The variables and patterns are expanded later, on the copy.
+ * The invalid lines are never cached: their errors are printed each time.
+ *
+ * @param li The line to fill (after line_init() or line_reset()).
+ * @param str The text of the line.
+ * @return int Returns 0 on success, or -1 if the line is not valid.
+ */
+int cache_parse(struct line *li, const char *str) {
+    size_t len = strlen(str);
+    if (len > CACHE_MAX_LEN) {
+        return line_parse(li, str);
+    }
+    if (!cache.ready) {
+        cache_clear();
+    }
+
+    uint64_t hash = cache_hash(str, len);
+    int i = cache_find(hash, str);
+    if (i != -1) {
+        cache.hits++;
+        cache_unlink(i);
+        cache_push_front(i);
+        return cache_template_load(&cache.entries[i].tpl, li);
+    }
+
+    cache.misses++;
+    int err = line_parse(li, str);
+    if (err) {
+        return err;
+    }
+
+    // The line is parsed: failing to cache it is not an error
+    struct cache_entry entry = { .hash = hash, .text = strdup(str) };
+    if (entry.text == NULL || cache_template_store(&entry.tpl, li) != 0) {
+        free(entry.text);
+        return 0;
+    }
+    i = cache_take();
+    struct cache_entry *e = &cache.entries[i];
+    *e = entry;
+    int *bucket = &cache.buckets[hash & (CACHE_BUCKETS - 1)];
+    e->bucket_next = *bucket;
+    *bucket = i;
+    cache_push_front(i);
+    return 0;
+}
+
+/**
+ * @brief Show or clear the cache of parsed lines.
+ *
+ * This function implements the 'cache' command for the shell: 'cache' prints
+ * the number of hits, of misses and of cached lines, 'cache -r' empties the cache.
+ *
+ * @param args Array of arguments where args[0] is "cache".
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int execute_command_intern_cache(char **args) {
+    if (args[1] == NULL) {
+        printf("hits\t%lu\nmisses\t%lu\nlines\t%zu/%d\n", cache.hits, cache.misses, cache.count, CACHE_ENTRIES);
+        return 0;
+    }
+    if (strcmp(args[1], "-r") != 0 || args[2] != NULL) {
+        fprintf(stderr, "Usage: cache [-r]\n");
+        return 1;
+    }
+    cache_clear();
+    cache.hits = 0;
+    cache.misses = 0;
+    return 0;
+}
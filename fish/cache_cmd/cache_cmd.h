@@ -0,0 +1,77 @@
+#ifndef CACHE_CMD_H
+#define CACHE_CMD_H
+
+#include "cmdline.h"
+
+/**
+ * @brief A parsed line, kept as an immutable template.
+ *
+ * The block holds, one after the other: the pipelines of the list (struct line
+ * without arena), their commands, their redirections, the argv pool, the glob
+ * flags of the pool and the words. All its pointers point inside the block.
+ */
+struct line_template {
+    char *block;
+    size_t size;     // size of the block
+    size_t n_segs;   // number of pipelines
+    size_t n_cmds;   // number of commands of all the pipelines
+    size_t n_redirs; // number of redirections of all the commands
+    size_t argv_len;
+};
+
+/**
+ * @brief Copy a parsed line in a template.
+ *
+ * All the pipelines of the list starting at "li" are copied. The args of the
+ * commands may have been moved forward in the argv pool (to drop a keyword):
+ * only the args from cmd->args are copied.
+ *
+ * @param e The template.
+ * @param li The parsed line (not expanded).
+ * @return int Returns 0 on success, or -1 on failure.
+ */
+int cache_template_store(struct line_template *e, const struct line *li);
+
+/**
+ * @brief Copy a template in the arena of a line, relocating its pointers.
+ *
+ * @param e The template.
+ * @param li The line to fill (after line_init() or line_reset()).
+ * @return int Returns 0 on success, or -1 on failure.
+ */
+int cache_template_load(const struct line_template *e, struct line *li);
+
+/**
+ * @brief Release the memory of a template.
+ *
+ * @param tpl The template.
+ */
+void cache_template_free(struct line_template *tpl);
+
+/**
+ * @brief Parse a command line, reusing the result of a previous parse of the same text.
+ *
+ * The successfully parsed lines are kept as immutable templates in a LRU cache
+ * indexed by the hash of their text. On a hit, the template is copied in the
+ * arena of the line and its pointers are relocated: the line is not tokenized
+ * again. The variables and patterns are expanded later, on the copy.
+ * The invalid lines are never cached: their errors are printed each time.
+ *
+ * @param li The line to fill (after line_init() or line_reset()).
+ * @param str The text of the line.
+ * @return int Returns 0 on success, or -1 if the line is not valid.
+ */
+int cache_parse(struct line *li, const char *str);
+
+/**
+ * @brief Show or clear the cache of parsed lines.
+ *
+ * This function implements the 'cache' command for the shell: 'cache' prints
+ * the number of hits, of misses and of cached lines, 'cache -r' empties the cache.
+ *
+ * @param args Array of arguments where args[0] is "cache".
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int execute_command_intern_cache(char **args);
+
+#endif /* CACHE_CMD_H */
@@ -2,10 +2,44 @@
 
 #include <assert.h>
 #include <string.h>
-#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stdint.h>
+
+#define ARENA_CHUNK_SIZE 4096
+#define ARENA_ALIGN 16
+#define FD_DIGITS 4 // at most 4 digits in the file descriptor of a redirection ("2>", "1000<")
+
+enum token_kind {
+  TOKEN_NONE, // end of the line
+  TOKEN_WORD,
+  TOKEN_PIPE,
+  TOKEN_REDIR, // "<", ">", ">>", "<>", "<<", "<<<", ">&", "<&", "&>", "&>>", with an optional fd before
+  TOKEN_BACKGROUND,
+  TOKEN_SEQ, // ";"
+  TOKEN_AND, // "&&"
+  TOKEN_OR,  // "||"
+};
+
+/* a token is a view on the line: no copy is made by the tokenizer */
+struct token {
+  enum token_kind kind;
+  bool quoted; // the word contains double quotes to remove
+  int redir;   // TOKEN_REDIR: REDIR_INPUT ... REDIR_HEREDOC (REDIR_DUP for ">&" and "<&")
+  int fd;      // TOKEN_REDIR: the redirected file descriptor
+  bool both;   // TOKEN_REDIR: "&>" or "&>>", stdout and stderr
+  size_t start;
+  size_t len;
+};
+
+struct line_chunk {
+  struct line_chunk *next;
+  size_t size; // bytes available in data
+  char data[];
+};
+
+static size_t alloc_count = 0;
 
 void line_init(struct line *li) {
   assert(li);
@@ -14,25 +48,369 @@ void line_init(struct line *li) {
 
 
 /**
- * Test the validity of command arguments or file names used in redirections
+ * Allocate "size" bytes aligned on "align" bytes in the arena "arena"
  * 
- * This function is static : it means that it is a local function, accessible only in this source file
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * The chunks released by the last reset are reused before a new chunk is allocated.
  * 
- * @param word pointer on the first char of string to test
+ * @param arena pointer on the arena
+ * @param size number of bytes to allocate
+ * @param align alignment of the memory (a power of 2)
  *
- * @return true if the word is valid, false otherwise
+ * @return a pointer on the memory, NULL on failure
  */
-static bool valid_cmdarg_filename(const char *word){ 
-   const char *forbidden = "<>&|";// forbidden characters in commands arguments and filenames
-
-   size_t lenf = strlen(forbidden);
-   for (size_t i = 0; i < lenf ; ++i){
-      char *ptr = strchr(word, forbidden[i]);
-      if (ptr) {
-         return false;
+static void *arena_alloc(struct line_arena *arena, size_t size, size_t align) {
+  assert(arena);
+
+  for (;;) {
+    if (arena->curr) {
+      /* the address itself is aligned: "data" is only aligned like malloc() */
+      uintptr_t data = (uintptr_t)arena->curr->data;
+      size_t start = ((data + arena->used + align - 1) & ~(uintptr_t)(align - 1)) - data;
+      if (start + size <= arena->curr->size) {
+        arena->used = start + size;
+        return arena->curr->data + start;
       }
-   }
-   return true;
+      if (arena->curr->next && size + align <= arena->curr->next->size) {
+        arena->curr = arena->curr->next;
+        arena->used = 0;
+        continue;
+      }
+    }
+
+    /* a new chunk, inserted after the current one */
+    size_t chunk_size = size + align > ARENA_CHUNK_SIZE ? size + align : ARENA_CHUNK_SIZE;
+    struct line_chunk *chunk = malloc(sizeof(struct line_chunk) + chunk_size);
+    if (chunk == NULL) {
+      fprintf(stderr, "Memory allocation failure\n");
+      return NULL;
+    }
+    ++alloc_count;
+    chunk->size = chunk_size;
+    if (arena->curr) {
+      chunk->next = arena->curr->next;
+      arena->curr->next = chunk;
+    } else {
+      chunk->next = arena->first;
+      arena->first = chunk;
+    }
+    arena->curr = chunk;
+    arena->used = 0;
+  }
+}
+
+/**
+ * Grow the last allocation "ptr" of the arena "arena" from "old_size" to "new_size" bytes
+ * 
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * The memory is extended in place when "ptr" is at the end of the current chunk and the chunk is
+ * large enough, otherwise it is copied (the old copy stays in the arena until the next reset).
+ * 
+ * @param arena pointer on the arena
+ * @param ptr pointer on the memory to grow (may be NULL if "old_size" is 0)
+ * @param old_size current size of the memory
+ * @param new_size new size of the memory
+ *
+ * @return a pointer on the memory, NULL on failure
+ */
+static void *arena_grow(struct line_arena *arena, void *ptr, size_t old_size, size_t new_size) {
+  assert(arena);
+  assert(new_size >= old_size);
+
+  if (ptr && arena->curr && (char *)ptr + old_size == arena->curr->data + arena->used
+      && (char *)ptr - arena->curr->data + new_size <= arena->curr->size) {
+    arena->used += new_size - old_size;
+    return ptr;
+  }
+
+  void *grown = arena_alloc(arena, new_size, ARENA_ALIGN);
+  if (grown && old_size > 0) {
+    memcpy(grown, ptr, old_size);
+  }
+  return grown;
+}
+
+void *line_alloc(struct line *li, size_t size) {
+  assert(li);
+  struct line *owner = li->owner ? li->owner : li;
+  return arena_alloc(&owner->arena, size, ARENA_ALIGN);
+}
+
+char *line_strndup(struct line *li, const char *str, size_t n) {
+  assert(li);
+  assert(str);
+  struct line *owner = li->owner ? li->owner : li;
+  char *copy = arena_alloc(&owner->arena, n + 1, 1);
+  if (copy) {
+    memcpy(copy, str, n);
+    copy[n] = '\0';
+  }
+  return copy;
+}
+
+size_t line_alloc_count(void) {
+  return alloc_count;
+}
+
+
+/* classes of the bytes which end a word (or a quoted part of a word) */
+#define BYTE_SPACE 1
+#define BYTE_QUOTE 2
+#define BYTE_OP    4
+#define BYTE_END   8
+
+#define SCAN_WORD  (BYTE_SPACE | BYTE_QUOTE | BYTE_OP | BYTE_END)
+#define SCAN_QUOTE (BYTE_QUOTE | BYTE_END)
+
+static const unsigned char byte_class[256] = {
+  ['\0'] = BYTE_END,
+  [' '] = BYTE_SPACE, ['\t'] = BYTE_SPACE, ['\n'] = BYTE_SPACE,
+  ['\v'] = BYTE_SPACE, ['\f'] = BYTE_SPACE, ['\r'] = BYTE_SPACE,
+  ['"'] = BYTE_QUOTE,
+  ['|'] = BYTE_OP, ['<'] = BYTE_OP, ['>'] = BYTE_OP, ['&'] = BYTE_OP, [';'] = BYTE_OP,
+};
+
+static bool simd_enabled = true;
+
+/* 
+ * line_parse() works on a copy of the line, aligned on LINE_PAD bytes and padded with
+ * '\0' up to a multiple of LINE_PAD bytes: the aligned SIMD loads never read outside
+ * of it. The words are '\0' terminated in place in this copy.
+ */
+#define LINE_PAD 32
+
+/* state of the tokenizer on a line */
+struct scanner {
+  char *str;         // the copy of the line
+  const char *block; // last block classified by scan_simd()
+  uint32_t mask;     // SCAN_WORD mask of this block
+  size_t held_at;    // position of the '\0' ending the last word
+  char held;         // byte replaced by this '\0'
+};
+
+/**
+ * Get the byte at the position "i" of the line, as it was before the words were terminated
+ * 
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * 
+ * @param sc pointer on the scanner of the line
+ * @param i position of the byte
+ *
+ * @return the byte
+ */
+static char peek(const struct scanner *sc, size_t i) {
+  return i == sc->held_at ? sc->held : sc->str[i];
+}
+
+void line_set_simd(bool enabled) {
+  simd_enabled = enabled;
+}
+
+/**
+ * Find the first byte of one of the classes "classes" in "str", from the "from" position
+ * 
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * Scalar version, one byte at a time.
+ * 
+ * @param str pointer on the first char of the line
+ * @param from position of the first byte to test
+ * @param classes SCAN_WORD or SCAN_QUOTE (both contain BYTE_END, so the search always ends)
+ *
+ * @return the position of the byte found
+ */
+static size_t scan_scalar(const char *str, size_t from, unsigned classes) {
+  while (!(byte_class[(unsigned char)str[from]] & classes)) {
+    ++from;
+  }
+  return from;
+}
+
+#if defined(__AVX2__) || defined(__SSE2__)
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCAN_BLOCK 32
+typedef __m256i scan_vec;
+#define VEC_LOAD(p) _mm256_load_si256((const __m256i *)(p))
+#define VEC_SET(c) _mm256_set1_epi8(c)
+#define VEC_EQ(a, b) _mm256_cmpeq_epi8(a, b)
+#define VEC_OR(a, b) _mm256_or_si256(a, b)
+#define VEC_SUB(a, b) _mm256_sub_epi8(a, b)
+#define VEC_MINU(a, b) _mm256_min_epu8(a, b)
+#define VEC_MASK(a) ((uint32_t)_mm256_movemask_epi8(a))
+#else
+#include <emmintrin.h>
+#define SCAN_BLOCK 16
+typedef __m128i scan_vec;
+#define VEC_LOAD(p) _mm_load_si128((const __m128i *)(p))
+#define VEC_SET(c) _mm_set1_epi8(c)
+#define VEC_EQ(a, b) _mm_cmpeq_epi8(a, b)
+#define VEC_OR(a, b) _mm_or_si128(a, b)
+#define VEC_SUB(a, b) _mm_sub_epi8(a, b)
+#define VEC_MINU(a, b) _mm_min_epu8(a, b)
+#define VEC_MASK(a) ((uint32_t)_mm_movemask_epi8(a))
+#endif
+
+/**
+ * Classify the SCAN_BLOCK bytes of the aligned block "block"
+ * 
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * 
+ * @param block pointer on the first char of the block, aligned on SCAN_BLOCK bytes
+ * @param classes SCAN_WORD or SCAN_QUOTE
+ *
+ * @return a mask with the bit i set if the byte i belongs to one of the classes
+ */
+static inline uint32_t block_mask(const char *block, unsigned classes) {
+  scan_vec b = VEC_LOAD(block);
+  scan_vec m = VEC_OR(VEC_EQ(b, VEC_SET(0)), VEC_EQ(b, VEC_SET('"')));
+  if (classes & BYTE_SPACE) {
+    /* '\t', '\n', '\v', '\f', '\r' are 9..13: b - 9 <= 4 (unsigned) */
+    scan_vec t = VEC_SUB(b, VEC_SET(9));
+    m = VEC_OR(m, VEC_EQ(VEC_MINU(t, VEC_SET(4)), t));
+    m = VEC_OR(m, VEC_EQ(b, VEC_SET(' ')));
+  }
+  if (classes & BYTE_OP) {
+    m = VEC_OR(m, VEC_OR(VEC_EQ(b, VEC_SET('|')), VEC_EQ(b, VEC_SET('&'))));
+    m = VEC_OR(m, VEC_OR(VEC_EQ(b, VEC_SET('<')), VEC_EQ(b, VEC_SET('>'))));
+    m = VEC_OR(m, VEC_EQ(b, VEC_SET(';')));
+  }
+  return VEC_MASK(m);
+}
+
+/**
+ * Find the first byte of one of the classes "classes" in the line, from the "from" position
+ * 
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * SIMD version, SCAN_BLOCK bytes at a time. The SCAN_WORD mask of the last block is kept in
+ * the scanner: each block is classified once, whatever the number of words it contains.
+ * 
+ * @param sc pointer on the scanner of the line
+ * @param from position of the first byte to test
+ * @param classes SCAN_WORD or SCAN_QUOTE
+ *
+ * @return the position of the byte found
+ */
+static size_t scan_simd(struct scanner *sc, size_t from, unsigned classes) {
+  const char *p = sc->str + from;
+  const char *block = (const char *)((uintptr_t)p & ~(uintptr_t)(SCAN_BLOCK - 1));
+  uint32_t mask;
+
+  if (classes == SCAN_WORD) {
+    if (block != sc->block) {
+      sc->block = block;
+      sc->mask = block_mask(block, SCAN_WORD);
+    }
+    mask = sc->mask & (~(uint32_t)0 << (p - block));
+    while (mask == 0) {
+      block += SCAN_BLOCK;
+      sc->block = block;
+      sc->mask = mask = block_mask(block, SCAN_WORD);
+    }
+  }
+  else {
+    mask = block_mask(block, classes) & (~(uint32_t)0 << (p - block));
+    while (mask == 0) {
+      block += SCAN_BLOCK;
+      mask = block_mask(block, classes);
+    }
+  }
+  return block + __builtin_ctz(mask) - sc->str;
+}
+
+#endif
+
+/**
+ * Find the first byte of one of the classes "classes" in "str", from the "from" position
+ * 
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * The SSE2/AVX2 version is used when available, the scalar one otherwise.
+ * 
+ * @param sc pointer on the scanner of the line
+ * @param from position of the first byte to test
+ * @param classes SCAN_WORD or SCAN_QUOTE
+ *
+ * @return the position of the byte found
+ */
+static size_t scan(struct scanner *sc, size_t from, unsigned classes) {
+#if defined(__AVX2__) || defined(__SSE2__)
+  if (simd_enabled) {
+    return scan_simd(sc, from, classes);
+  }
+#endif
+  return scan_scalar(sc->str, from, classes);
+}
+
+/**
+ * Append the pointer "arg" to the argv pool of the line "li"
+ * 
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * The pool doubles its capacity in the arena when it is full, and so does its array of glob flags.
+ * 
+ * @param li pointer on the struct line
+ * @param len pointer on the number of pointers in the pool
+ * @param cap pointer on the capacity of the pool
+ * @param arg pointer to append (NULL to end the args of a command)
+ * @param glob true if the word has no double quotes: it is a pattern if it contains '*', '?' or '['
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int line_push_arg(struct line *li, size_t *len, size_t *cap, char *arg, bool glob) {
+  if (*len == *cap) {
+    size_t new_cap = *cap ? 2 * *cap : 16;
+    char **argv = arena_grow(&li->arena, li->argv, *cap * sizeof(char *), new_cap * sizeof(char *));
+    if (!argv) {
+      return -1;
+    }
+    li->argv = argv;
+    bool *argv_glob = arena_grow(&li->arena, li->argv_glob, *cap * sizeof(bool), new_cap * sizeof(bool));
+    if (!argv_glob) {
+      return -1;
+    }
+    li->argv_glob = argv_glob;
+    *cap = new_cap;
+  }
+  li->argv_glob[*len] = glob;
+  li->argv[(*len)++] = arg;
+  return 0;
+}
+
+/**
+ * Append a new command to the pipeline "seg" of the line "li"
+ * 
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * The array of commands (shared by all the pipelines of the line) doubles its capacity in the arena
+ * when it is full. The args and the redirections of the command, and the commands of each pipeline,
+ * are set at the end of line_parse(), when the pools and the array of commands do not move anymore.
+ * 
+ * @param li pointer on the struct line
+ * @param seg pointer on the current pipeline of the line
+ * @param len pointer on the number of commands of the whole line
+ * @param cap pointer on the capacity of the array of commands
+ * @param n_args number of arguments of the command
+ * @param n_redirs number of redirections of the command (the last ones of the pool)
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int line_push_cmd(struct line *li, struct line *seg, size_t *len, size_t *cap, size_t n_args, size_t n_redirs) {
+  if (*len == *cap) {
+    size_t new_cap = *cap ? 2 * *cap : 4;
+    struct cmd *cmds = arena_grow(&li->arena, li->cmds, *cap * sizeof(struct cmd), new_cap * sizeof(struct cmd));
+    if (!cmds) {
+      return -1;
+    }
+    li->cmds = cmds;
+    *cap = new_cap;
+  }
+  li->cmds[*len].args = NULL;
+  li->cmds[*len].n_args = n_args;
+  li->cmds[*len].assigns = NULL;
+  li->cmds[*len].n_assigns = 0;
+  li->cmds[*len].redirs = NULL;
+  li->cmds[*len].n_redirs = n_redirs;
+  ++*len;
+  ++seg->n_cmds;
+  return 0;
 }
 
 /**
@@ -55,130 +433,382 @@ static void parse_error(const char *format, ...) {
 }
 
 /**
- * Search a new word in the string "str" from the "index" position
+ * Read a redirection operator starting with '<' or '>'
+ * 
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * The redirected file descriptor is set to its default (0 for '<', 1 for '>') if it is not given.
+ * 
+ * @param sc pointer on the scanner of the line
+ * @param i position of the '<' or '>'
+ * @param tok pointer on the TOKEN_REDIR token to complete
+ *
+ * @return the length of the operator
+ */
+static size_t line_redir_op(const struct scanner *sc, size_t i, struct token *tok) {
+  size_t len = 2;
+  if (peek(sc, i) == '<') {
+    switch (peek(sc, i + 1)) {
+    case '<':
+      tok->redir = peek(sc, i + 2) == '<' ? REDIR_STRING : REDIR_HEREDOC;
+      len = tok->redir == REDIR_STRING ? 3 : 2;
+      break;
+    case '>': tok->redir = REDIR_RDWR; break;
+    case '&': tok->redir = REDIR_DUP; break;
+    default: tok->redir = REDIR_INPUT; len = 1; break;
+    }
+    if (tok->fd == -1) {
+      tok->fd = 0;
+    }
+  } else {
+    switch (peek(sc, i + 1)) {
+    case '>': tok->redir = REDIR_APPEND; break;
+    case '&': tok->redir = REDIR_DUP; break;
+    default: tok->redir = REDIR_OUTPUT; len = 1; break;
+    }
+    if (tok->fd == -1) {
+      tok->fd = 1;
+    }
+  }
+  return len;
+}
+
+/**
+ * Search the next token in the string "str" from the "index" position
  * 
  * This function is static : it means that it is a local function, accessible only in this source file.
  * After the call, "index" contains the position of the last character used plus one.
- * If a word is found, it is copied to a dynamically allocated memory space. "pword" is a pointer
- * on a pointer which retrieves the address of this dynamically allocated memory space.
+ * A token is an operator ("|", "&", ";", "&&", "||", a redirection like "<", ">>", "2>&" or "&>") or
+ * a word. A word ends at a space or at an operator, except in the parts enclosed in double quotes. The bytes are classified
+ * in a single sweep by scan().
  * 
- * @param str pointer on the first char of the line entered by the user
+ * @param sc pointer on the scanner of the line entered by the user
  * @param index pointer on the index
- * @param pword pointer on a pointer which retrieves the address of this dynamically allocated memory space
+ * @param tok pointer on the token found (TOKEN_NONE at the end of the line)
  *
- * @return   0 if a word is found or if the end of the line is reached
+ * @return   0 if a token is found or if the end of the line is reached
  *           -1 if a malformed line is detected
- *           -2 if a memory allocation failure occurs
  */
-static int line_next_word(const char *str, size_t *index, char **pword) {
-  assert(str);
+static int line_next_token(struct scanner *sc, size_t *index, struct token *tok) {
+  assert(sc);
   assert(index);
-  assert(pword);
-  
+  assert(tok);
+
+  const char *str = sc->str;
   size_t i = *index;
-  *pword = NULL;
+  tok->kind = TOKEN_NONE;
+  tok->quoted = false;
+  tok->fd = -1;
+  tok->both = false;
 
   /* eat space */
-  while (str[i] != '\0' && isspace(str[i])) {
+  while (byte_class[(unsigned char)peek(sc, i)] == BYTE_SPACE) {
     ++i;
   }
+  tok->start = i;
+
+  /* a number just before '<' or '>' is the redirected file descriptor */
+  size_t digits = i;
+  while (peek(sc, digits) >= '0' && peek(sc, digits) <= '9' && digits - i < FD_DIGITS) {
+    ++digits;
+  }
+  if (digits > i && (peek(sc, digits) == '<' || peek(sc, digits) == '>')) {
+    tok->fd = 0;
+    for (; i < digits; ++i) {
+      tok->fd = 10 * tok->fd + (peek(sc, i) - '0');
+    }
+  }
 
-  /* check if it is the end of the line */
-  if (str[i] == '\0') {
+  switch (peek(sc, i)) {
+  case '\0':
     *index = i;
     return 0;
+  case '|':
+    tok->kind = peek(sc, i + 1) == '|' ? TOKEN_OR : TOKEN_PIPE;
+    tok->len = tok->kind == TOKEN_OR ? 2 : 1;
+    break;
+  case '&':
+    if (peek(sc, i + 1) == '>') {
+      /* "&>" and "&>>" redirect both stdout and stderr */
+      tok->kind = TOKEN_REDIR;
+      tok->both = true;
+      tok->fd = 1;
+      tok->len = 1 + line_redir_op(sc, i + 1, tok);
+      if (tok->redir == REDIR_DUP) {
+        parse_error("Redirection \"&>&\" is not valid\n");
+        return -1;
+      }
+    } else {
+      tok->kind = peek(sc, i + 1) == '&' ? TOKEN_AND : TOKEN_BACKGROUND;
+      tok->len = tok->kind == TOKEN_AND ? 2 : 1;
+    }
+    break;
+  case ';':
+    tok->kind = TOKEN_SEQ;
+    tok->len = 1;
+    break;
+  case '<':
+  case '>':
+    tok->kind = TOKEN_REDIR;
+    tok->len = line_redir_op(sc, i, tok);
+    break;
+  default:
+    tok->kind = TOKEN_WORD;
+    break;
   }
 
-  size_t start = i;
-  size_t end = i;
-  if (str[i] == '"') {
-    ++start;
-    do {
-      ++i;
-    } while (str[i] != '\0' && str[i] != '"');
+  if (tok->kind != TOKEN_WORD) {
+    *index = i + tok->len;
+    tok->len = *index - tok->start;
+    return 0;
+  }
 
+  for (;;) {
+    i = scan(sc, i, SCAN_WORD);
+    if (str[i] != '"') {
+      break;
+    }
+    tok->quoted = true;
+    i = scan(sc, i + 1, SCAN_QUOTE);
     if (str[i] == '\0') {
       parse_error("Malformed line\n");
       return -1;
     }
-    assert(str[i] == '"');
-    end = i;
     ++i;
-  } 
-  else {
-    while (str[i] != '\0' && !isspace(str[i])) {
-      ++i;
-    }
-    end = i;
   }
 
+  tok->len = i - tok->start;
   *index = i;
+  return 0;
+}
+
+/**
+ * Terminate the word of the token "tok" in place, and remove its double quotes
+ * 
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * The word is not copied: it is a view on the copy of the line made by line_parse(). The byte
+ * replaced by the '\0' is kept in the scanner, for the next call of line_next_token().
+ * 
+ * @param sc pointer on the scanner of the line
+ * @param tok pointer on a TOKEN_WORD token
+ *
+ * @return a pointer on the word
+ */
+static char *line_token_word(struct scanner *sc, const struct token *tok) {
+  char *word = sc->str + tok->start;
+  size_t end = tok->start + tok->len;
+
+  if (!tok->quoted) {
+    sc->held = sc->str[end];
+    sc->held_at = end;
+    sc->str[end] = '\0';
+    return word;
+  }
+
+  /* the word gets shorter: the '\0' does not hide the next token */
+  size_t n = 0;
+  for (size_t i = tok->start; i < end; ++i) {
+    if (sc->str[i] != '"') {
+      word[n++] = sc->str[i];
+    }
+  }
+  word[n] = '\0';
+  return word;
+}
+
+/**
+ * Get the filename following a redirection operator
+ * 
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * 
+ * @param sc pointer on the scanner of the line entered by the user
+ * @param index pointer on the index, just after the redirection operator
+ * @param what "an input" or "an output", for the error messages
+ * @param quoted pointer set to true if the filename has double quotes (can be NULL)
+ *
+ * @return a pointer on the filename, NULL on failure
+ */
+static char *line_next_filename(struct scanner *sc, size_t *index, const char *what, bool *quoted) {
+  struct token tok;
+  if (line_next_token(sc, index, &tok)) {
+    return NULL;
+  }
+  if (tok.kind == TOKEN_NONE) {
+    parse_error("Waiting for a filename after %s redirection\n", what);
+    return NULL;
+  }
+  if (tok.kind != TOKEN_WORD) {
+    parse_error("Filename \"%.*s\" is not valid\n", (int)tok.len, sc->str + tok.start);
+    return NULL;
+  }
+  if (quoted) {
+    *quoted = tok.quoted;
+  }
+  return line_token_word(sc, &tok);
+}
 
-  /* copy this word */
-  assert(end >= start); 
-  *pword = calloc(end - start + 1, sizeof(char));
-  if (*pword == NULL){
-    fprintf(stderr, "Memory allocation failure\n");
-    return -2;
+/**
+ * Check the end of the pipeline "seg"
+ * 
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * 
+ * @param seg pointer on the pipeline
+ * @param curr_n_arg number of arguments of its last command
+ * @param curr_n_redir number of redirections of its last command
+ *
+ * @return 0 if the pipeline is valid (or empty), -1 otherwise
+ */
+static int line_check_pipeline(const struct line *seg, size_t curr_n_arg, size_t curr_n_redir) {
+  if (curr_n_arg != 0) {
+    return 0;
+  }
+  if (seg->n_cmds > 0){
+    parse_error("An empty command detected\n");
+    return -1;
+  }
+  // in a real shell, "< fic" is equivalent to "test -r fic"
+  // in a real shell, "> fic" :
+  // - creates the regular file "fic" if it does not exist, 
+  // - and truncates it if it already exists
+  // in a real shell, ">> fic" :
+  // - creates the regular file "fic" if it does not exist,
+  // - and doesn't truncate it if it already exists
+  if (curr_n_redir != 0){
+    parse_error("Missing command before a redirection\n");
+    return -1;
   }
-  memcpy(*pword, str + start, end - start);
   return 0;
 }
 
+/**
+ * Read the target of the redirection token "tok" and append the redirection to the pool
+ * 
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * "&> file" appends two redirections: "> file" and "2>&1". A file descriptor can only be
+ * redirected to one file, here-document or here-string by command.
+ * 
+ * @param li pointer on the struct line
+ * @param sc pointer on the scanner of the line
+ * @param index pointer on the index, just after the redirection operator
+ * @param tok pointer on the TOKEN_REDIR token
+ * @param len pointer on the number of redirections in the pool
+ * @param cap pointer on the capacity of the pool
+ * @param first index in the pool of the first redirection of the current command
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int line_parse_redir(struct line *li, struct scanner *sc, size_t *index, const struct token *tok,
+                            size_t *len, size_t *cap, size_t first) {
+  static const char *const what[] = {
+    [REDIR_INPUT] = "an input", [REDIR_OUTPUT] = "an output", [REDIR_APPEND] = "an output",
+    [REDIR_RDWR] = "an input/output", [REDIR_DUP] = "a duplication",
+    [REDIR_STRING] = "a here-string", [REDIR_HEREDOC] = "a here-document",
+  };
+  bool quoted = false;
+  char *word = line_next_filename(sc, index, what[tok->redir], &quoted);
+  if (!word) {
+    return -1;
+  }
 
+  struct redir redir = { tok->fd, tok->redir, -1, false, false, word };
+  if (tok->redir == REDIR_DUP) {
+    /* "N>&M" or "N>&-" */
+    redir.target = NULL;
+    if (strcmp(word, "-") == 0) {
+      redir.op = REDIR_CLOSE;
+    } else {
+      size_t n = strspn(word, "0123456789");
+      if (n == 0 || n > FD_DIGITS || word[n] != '\0') {
+        parse_error("Bad file descriptor \"%s\"\n", word);
+        return -1;
+      }
+      redir.src_fd = atoi(word);
+    }
+  } else {
+    for (size_t i = first; i < *len; ++i) {
+      if (li->redirs[i].fd == tok->fd && li->redirs[i].op != REDIR_DUP && li->redirs[i].op != REDIR_CLOSE) {
+        parse_error(tok->fd == 0 ? "Input redirection already defined\n"
+                    : tok->fd == 1 ? "Output redirection already defined\n"
+                    : "Redirection of fd %d already defined\n", tok->fd);
+        return -1;
+      }
+    }
+    if (tok->redir == REDIR_HEREDOC) {
+      /* the body is read after the line, up to the end word */
+      redir.literal = quoted;
+      redir.pending = true;
+    }
+  }
 
+  struct redir err = { 2, REDIR_DUP, 1, false, false, NULL };
+  for (int k = 0; k < (tok->both ? 2 : 1); ++k) {
+    if (*len == *cap) {
+      size_t new_cap = *cap ? 2 * *cap : 4;
+      struct redir *redirs = arena_grow(&li->arena, li->redirs, *cap * sizeof(struct redir), new_cap * sizeof(struct redir));
+      if (!redirs) {
+        return -1;
+      }
+      li->redirs = redirs;
+      *cap = new_cap;
+    }
+    li->redirs[(*len)++] = k == 0 ? redir : err;
+  }
+  return 0;
+}
 
 int line_parse(struct line *li, const char *str) {
   assert(li);
   assert(str);
 
+  /* the only copy of the line: all the words point in it */
   size_t len = strlen(str);
-  assert(len >= 1); 
-  if (str[len -1] != '\n'){
-    fprintf(stderr, "The command line is too long\n");
-    char c = 0;
-    while (c != '\n'){
-      c = fgetc(stdin);
-    }
+  size_t size = (len + LINE_PAD) & ~(size_t)(LINE_PAD - 1);
+  char *copy = arena_alloc(&li->arena, size, LINE_PAD);
+  if (!copy) {
     return -1;
   }
-  
+  memcpy(copy, str, len);
+  memset(copy + len, 0, size - len);
+
+  struct scanner sc = { copy, NULL, 0, (size_t)-1, '\0' };
   size_t index = 0;
-  size_t curr_n_cmd = 0;
   size_t curr_n_arg = 0;
+  size_t argv_len = 0;
+  size_t argv_cap = 0;
+  size_t redirs_len = 0;
+  size_t redirs_cap = 0;
+  size_t curr_redir = 0;       // first redirection of the current command in the pool
+  size_t cmds_len = 0;
+  size_t cmds_cap = 0;
+  struct line *seg = li;       // current pipeline
+  struct line *prev_seg = NULL; // previous pipeline of the list
   int valret = 0; 
 
   for (;;) {
-    /* get the next word */
-    char *word;
-    int err = line_next_word(str, &index, &word);
+    /* get the next token */
+    struct token tok;
+    int err = line_next_token(&sc, &index, &tok);
     if (err) {
       valret = -1; 
       break;
     }
 
-    if (!word) {
+    if (tok.kind == TOKEN_NONE) {
       break;
     }
 
 #ifdef DEBUG
-    fprintf(stderr, "\tnew word: \"%s\"\n", word);
+    fprintf(stderr, "\tnew token: \"%.*s\"\n", (int)tok.len, sc.str + tok.start);
 #endif
 
-    if (strcmp(word, "|") == 0) {
-      free(word);
+    size_t curr_n_redir = redirs_len - curr_redir;
 
-      if (li->background) {
+    if (tok.kind == TOKEN_PIPE) {
+
+      if (seg->background) {
         parse_error("No pipe allowed after a '&'\n");
         valret = -1;
         break;
       }
-      
-      if (li->file_output) {
-        parse_error("No pipe allowed after an output redirection\n");
-        valret = -1;
-        break;
-      }
 
       if (curr_n_arg == 0){
         parse_error("An empty command before a pipe detected\n");
@@ -186,96 +816,73 @@ int line_parse(struct line *li, const char *str) {
         break;
       }
 
-      li->cmds[curr_n_cmd].n_args = curr_n_arg;
+      if (line_push_arg(li, &argv_len, &argv_cap, NULL, false) || line_push_cmd(li, seg, &cmds_len, &cmds_cap, curr_n_arg, curr_n_redir)) {
+        valret = -1;
+        break;
+      }
       curr_n_arg = 0;
-      ++curr_n_cmd;
+      curr_redir = redirs_len;
 
     } 
-    else if (strcmp(word, ">") == 0 || strcmp(word, ">>") == 0) {
-      bool append = strcmp(word, ">>") == 0;
-      free(word);
+    else if (tok.kind == TOKEN_SEQ || tok.kind == TOKEN_AND || tok.kind == TOKEN_OR) {
+      const char *op = tok.kind == TOKEN_SEQ ? ";" : tok.kind == TOKEN_AND ? "&&" : "||";
 
-      if (li->file_output) {
-        parse_error("Output redirection already defined\n");
+      if (curr_n_arg == 0 && seg->n_cmds == 0 && curr_n_redir == 0) {
+        parse_error("An empty command before '%s' detected\n", op);
         valret = -1;
         break;
       }
-      
-      if (li->background) {
-        parse_error("No output redirection allowed after a '&'\n");
+
+      // "a & ; b" runs "a" in the background, but "a & && b" has no meaning
+      if (seg->background && tok.kind != TOKEN_SEQ) {
+        parse_error("No '%s' allowed after a '&'\n", op);
         valret = -1;
         break;
       }
 
-      err = line_next_word(str, &index, &word);
-      if (err) {
-        valret = -1; 
+      if (line_check_pipeline(seg, curr_n_arg, curr_n_redir)) {
+        valret = -1;
         break;
       }
 
-      if (!word) {
-        parse_error("Waiting for a filename after an output redirection\n");
+      if (line_push_arg(li, &argv_len, &argv_cap, NULL, false) || line_push_cmd(li, seg, &cmds_len, &cmds_cap, curr_n_arg, curr_n_redir)) {
         valret = -1;
         break;
       }
+      curr_n_arg = 0;
+      curr_redir = redirs_len;
 
-      if (!valid_cmdarg_filename(word)){
-        parse_error("Filename \"%s\" is not valid\n", word);
-        free(word);
+      /* the next pipeline of the list */
+      struct line *next = arena_alloc(&li->arena, sizeof(struct line), ARENA_ALIGN);
+      if (!next) {
         valret = -1;
-        break;        
+        break;
       }
-      li->file_output = word;
-      li->file_output_append = append;
+      memset(next, 0, sizeof(struct line));
+      next->owner = li;
+      seg->next = next;
+      seg->next_op = tok.kind == TOKEN_SEQ ? LINE_SEQ : tok.kind == TOKEN_AND ? LINE_AND : LINE_OR;
+      prev_seg = seg;
+      seg = next;
 
     } 
-    else if (strcmp(word, "<") == 0) {
-      free(word);
+    else if (tok.kind == TOKEN_REDIR) {
 
-      if (li->file_input) {
-        parse_error("Input redirection already defined\n");
-        valret = -1;
-        break;
-      }
-      
-      if (li->background) {
-        parse_error("No input redirection allowed after a '&'\n");
+      if (seg->background) {
+        parse_error("No redirection allowed after a '&'\n");
         valret = -1;
         break;
       }
-      
-      if (curr_n_cmd > 0){
-        parse_error("Input redirection is only allowed for the first command\n");
-        valret = -1;
-        break;
-      }
-
-      err = line_next_word(str, &index, &word);
-      if (err) {
-        valret = -1; 
-        break;
-      }
 
-      if (!word) {
-        parse_error("Waiting for a filename after an input redirection\n");
+      if (line_parse_redir(li, &sc, &index, &tok, &redirs_len, &redirs_cap, curr_redir)) {
         valret = -1;
         break;
       }
 
-      if (!valid_cmdarg_filename(word)){
-        parse_error("Filename \"%s\" is not valid\n", word);
-        free(word);
-        valret = -1;
-        break;      
-      }
-      
-      li->file_input = word;
-
     } 
-    else if (strcmp(word, "&") == 0) {
-      free(word);
+    else if (tok.kind == TOKEN_BACKGROUND) {
 
-      if (li->background) {
+      if (seg->background) {
         parse_error("More than one '&' detected\n");
         valret = -1;
         break;
@@ -287,89 +894,98 @@ int line_parse(struct line *li, const char *str) {
         break;
       }
 
-      li->background = true;
+      seg->background = true;
     } 
     else {
-      if (li->background) {
-        free(word);
+      if (seg->background) {
         parse_error("No more commands allowed after a '&'\n");
         valret = -1;
         break;
       }
-      if (curr_n_cmd == MAX_CMDS) {
-        free(word);
-        parse_error("Too much commands. Max: %i\n", MAX_CMDS);
-        valret = -1;
-        break;
-      }
-      if (curr_n_arg == MAX_ARGS) {
-        free(word);
-        parse_error("Too much arguments. Max: %i\n", MAX_ARGS);
-        valret = -1;
-        break;
-      }
 
-      if (!valid_cmdarg_filename(word)){ 
-        parse_error("Argument \"%s\" is not valid\n", word);
-        free(word);
+      char *word = line_token_word(&sc, &tok);
+      if (line_push_arg(li, &argv_len, &argv_cap, word, !tok.quoted)) {
         valret = -1;
-        break;        
+        break;
       }
-
-      li->cmds[curr_n_cmd].args[curr_n_arg] = word;
       ++curr_n_arg;
     }
   } //end of the loop for
 
-  if (!valret && curr_n_arg == 0) {
-    if (curr_n_cmd > 0){
-      parse_error("An empty command detected\n");
-      valret = -1;
-    }
-    // in a real shell, "< fic" is equivalent to "test -r fic"
-    else if (li->file_input){
-      parse_error("Missing first command\n");
+  size_t curr_n_redir = redirs_len - curr_redir;
+  if (!valret && prev_seg && curr_n_arg == 0 && seg->n_cmds == 0 && curr_n_redir == 0) {
+    // nothing after the last operator: only allowed for ";"
+    if (prev_seg->next_op != LINE_SEQ) {
+      parse_error("Missing command after '%s'\n", prev_seg->next_op == LINE_AND ? "&&" : "||");
       valret = -1;
     }
-    // in a real shell, "> fic" :
-    // - creates the regular file "fic" if it does not exist, 
-    // - and truncates it if it already exists
-    // in a real shell, ">> fic" :
-    // - creates the regular file "fic" if it does not exist,
-    // - and doesn't truncate it if it already exists
-    else if (li->file_output){
-      parse_error("Missing last command\n");
+    prev_seg->next = NULL;
+    prev_seg->next_op = LINE_SEQ;
+  }
+  else if (!valret) {
+    valret = line_check_pipeline(seg, curr_n_arg, curr_n_redir);
+  }
+
+  if (curr_n_arg != 0) {
+    if (line_push_arg(li, &argv_len, &argv_cap, NULL, false) || line_push_cmd(li, seg, &cmds_len, &cmds_cap, curr_n_arg, curr_n_redir)) {
       valret = -1;
     }
   }
 
-  if (curr_n_arg != 0) {
-    li->cmds[curr_n_cmd].n_args = curr_n_arg;
-    ++curr_n_cmd;
+  /* the pools and the array of commands do not move anymore: each command
+     points on its args and its redirections, and each pipeline on its commands */
+  size_t offset = 0;
+  size_t redir_offset = 0;
+  for (size_t i = 0; i < cmds_len; ++i) {
+    li->cmds[i].args = li->argv + offset;
+    offset += li->cmds[i].n_args + 1;
+    li->cmds[i].redirs = li->cmds[i].n_redirs ? li->redirs + redir_offset : NULL;
+    redir_offset += li->cmds[i].n_redirs;
+  }
+  struct cmd *cmds = li->next ? li->cmds + li->n_cmds : NULL;
+  for (struct line *s = li->next; s; s = s->next) {
+    s->cmds = cmds;
+    s->argv = li->argv;
+    s->argv_glob = li->argv_glob;
+    s->redirs = li->redirs;
+    cmds += s->n_cmds;
   }
-  li->n_cmds = curr_n_cmd;
   return valret;
 }
 
-void line_reset(struct line *li) {
+int line_set_heredoc(struct line *li, struct redir *redir, const char *body, size_t len) {
   assert(li);
+  assert(redir && redir->pending);
 
-  for (size_t i = 0; i < li->n_cmds; ++i) {
-    for (size_t j = 0; j < li->cmds[i].n_args; ++j) {
-      free(li->cmds[i].args[j]);
-      li->cmds[i].args[j] = NULL; // useless here because of the call of memset()
-    }
+  char *copy = line_strndup(li, body, len);
+  if (!copy) {
+    return -1;
   }
+  redir->target = copy;
+  redir->pending = false;
+  return 0;
+}
 
-  if (li->file_input) {
-    free(li->file_input);
-    li->file_input = NULL; // useless here because of the call of memset()
-  }
+void line_reset(struct line *li) {
+  assert(li);
 
-  if (li->file_output) {
-    free(li->file_output);
-    li->file_output = NULL; // useless here because of the call of memset()
-  }
+  /* all the words and filenames are in the arena: rewind it */
+  struct line_arena arena = li->arena;
+  arena.curr = arena.first;
+  arena.used = 0;
+
+  memset(li, 0, sizeof(struct line));
+  li->arena = arena;
+}
+
+void line_destroy(struct line *li) {
+  assert(li);
 
+  struct line_chunk *chunk = li->arena.first;
+  while (chunk) {
+    struct line_chunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
   memset(li, 0, sizeof(struct line));
 }
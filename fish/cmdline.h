@@ -4,21 +4,80 @@
 #include <stddef.h>
 #include <stdbool.h>
 
-#define MAX_ARGS 16
-#define MAX_CMDS 16
+/* kinds of redirection */
+#define REDIR_INPUT   0 // "N< file" (N is 0 by default)
+#define REDIR_OUTPUT  1 // "N> file" (N is 1 by default)
+#define REDIR_APPEND  2 // "N>> file"
+#define REDIR_RDWR    3 // "N<> file"
+#define REDIR_DUP     4 // "N>&M" or "N<&M": N becomes a copy of M
+#define REDIR_CLOSE   5 // "N>&-" or "N<&-"
+#define REDIR_STRING  6 // "N<<< word": the word followed by a '\n'
+#define REDIR_HEREDOC 7 // "N<< end": the body of the here-document
+
+/**
+ * A redirection of a command
+ *
+ * "&> file" (and "&>> file") is kept as two redirections: "> file 2>&1".
+ */
+struct redir {
+  int fd;       // redirected file descriptor
+  int op;       // REDIR_INPUT ... REDIR_HEREDOC
+  int src_fd;   // REDIR_DUP: the copied file descriptor
+  bool literal; // REDIR_HEREDOC: the end word is quoted, no $ expansion in the body
+  bool pending; // REDIR_HEREDOC: target is still the end word, the body is not read yet
+  char *target; // file name, word or body (NULL for REDIR_DUP and REDIR_CLOSE)
+};
 
 struct cmd {
-  char *args[MAX_ARGS + 1]; //+1 to have a NULL at the end if nargs = MAX_ARGS
+  char **args; // NULL terminated, points in the argv pool of the line
   size_t n_args;
+  char **assigns; // leading NAME=value words, set by var_expand_line()
+  size_t n_assigns;
+  struct redir *redirs; // applied in order, after the pipes; points in the redirection pool of the line
+  size_t n_redirs;
 };
 
+struct line_chunk; // block of memory of an arena, private to cmdline.c
+
+/**
+ * Bump allocator owning all the strings of a struct line
+ *
+ * The memory is never freed word by word: line_reset() rewinds the arena
+ * in O(1) and keeps its chunks for the next line.
+ */
+struct line_arena {
+  struct line_chunk *first; // list of chunks
+  struct line_chunk *curr;  // chunk used by the next allocation
+  size_t used;              // bytes used in the current chunk
+};
+
+/* how the next pipeline of a list runs */
+#define LINE_SEQ 0 // ";": always
+#define LINE_AND 1 // "&&": if the status of the previous one is 0
+#define LINE_OR  2 // "||": if the status of the previous one is not 0
+
+/* resources printed by the 'time' keyword, set by the shell before a pipeline runs */
+#define LINE_TIME        1 // "time": for the whole pipeline
+#define LINE_TIME_STAGES 2 // "time -v": and for each of its stages
+
+/**
+ * A parsed pipeline, and the first one of a list of pipelines separated by ";", "&&" or "||"
+ *
+ * The next pipelines of the list are struct line too, allocated in the arena of the
+ * first one: they share its argv pool and its array of commands.
+ */
 struct line {
-  struct cmd cmds[MAX_CMDS];
+  struct cmd *cmds; // in the arena, n_cmds elements
   size_t n_cmds;
-  char *file_input;
-  char *file_output;
-  bool file_output_append; // only used if file_output isn't NULL
   bool background;
+  char **argv; // argv pool: the args of all the commands, one after the other, each list NULL terminated
+  bool *argv_glob; // for each pointer of the argv pool: the word has no double quotes (it can be a pattern)
+  struct redir *redirs; // redirection pool: the redirections of all the commands, one after the other
+  struct line *next;  // next pipeline of the list, NULL for the last one
+  int next_op;        // LINE_SEQ, LINE_AND or LINE_OR: how the next pipeline runs
+  struct line *owner; // first pipeline of the list (NULL for the first one itself)
+  int time;           // 0, LINE_TIME or LINE_TIME_STAGES: set by the shell, never by the parser
+  struct line_arena arena; // owns cmds, argv, argv_glob, args, redirs, their targets and the next pipelines
 };
 
 /**
@@ -34,6 +93,14 @@ void line_init(struct line *li);
 /**
  * Parse the string "str" and construct the struct line pointed by "li"
  * 
+ * A line is a list of pipelines separated by ";", "&&" or "||": "li" is the first
+ * one, and the next ones are linked by li->next. A last ";" is allowed.
+ * The body of a here-document ("<< end") is not on the line: its redirection keeps
+ * the end word as target (pending), and the body is given later by line_set_heredoc().
+ * There is no limit on the number of commands or arguments: the commands and
+ * the argv pool grow with the line, in the arena of the line.
+ * "str" is copied once in the arena, and the words are '\0' terminated in place
+ * in this copy: they are not copied again ("str" can be released after the call)
  * You must call line_init() or line_reset() before calling this function
  * 
  * @param li pointer on the struct line to fill
@@ -43,14 +110,89 @@ void line_init(struct line *li);
  */
 int line_parse(struct line *li, const char *str);
 
+/**
+ * Give its body to a here-document
+ * 
+ * The body is copied in the arena of the line, and the redirection is not pending anymore.
+ * 
+ * @param li pointer on the struct line owning the redirection
+ * @param redir pointer on the pending REDIR_HEREDOC redirection
+ * @param body pointer on the first char of the body (the lines before the end word)
+ * @param len number of chars of the body
+ *
+ * @return 0 on success, -1 on failure
+ */
+int line_set_heredoc(struct line *li, struct redir *redir, const char *body, size_t len);
+
 /**
  * Reset a struct line
  * 
- * Free dynamically allocated memory
- * All bytes occupied by the structure are set to 0
+ * Release all the strings of the line at once (the memory is kept for the next line)
+ * All the other bytes occupied by the structure are set to 0
  * 
  * @param li pointer on the struct line to be reset
  */
 void line_reset(struct line *li);
 
+/**
+ * Destroy a struct line
+ * 
+ * Free all dynamically allocated memory, including the memory kept by line_reset()
+ * The structure can be used again after a call to line_init()
+ * 
+ * @param li pointer on the struct line to be destroyed
+ */
+void line_destroy(struct line *li);
+
+/**
+ * Allocate memory owned by a struct line
+ * 
+ * The memory is released by the next call to line_reset() or line_destroy().
+ * For a pipeline which is not the first one of its list, the memory is taken
+ * from the arena of the first one.
+ * It is suitably aligned for any type.
+ * 
+ * @param li pointer on the struct line owning the memory
+ * @param size number of bytes to allocate
+ *
+ * @return a pointer on the memory, NULL on failure
+ */
+void *line_alloc(struct line *li, size_t size);
+
+/**
+ * Copy "n" chars of the string "str" in memory owned by a struct line
+ * 
+ * The copy is terminated by a '\0' and is released by the next call to
+ * line_reset() or line_destroy().
+ * 
+ * @param li pointer on the struct line owning the copy
+ * @param str pointer on the first char to copy
+ * @param n number of chars to copy
+ *
+ * @return a pointer on the copy, NULL on failure
+ */
+char *line_strndup(struct line *li, const char *str, size_t n);
+
+/**
+ * Enable or disable the SSE2/AVX2 tokenizer
+ * 
+ * line_parse() classifies the bytes of the line by blocks of 16 (SSE2) or 32 (AVX2)
+ * bytes when the compiler targets these instruction sets, and one by one otherwise
+ * (the default build is SSE2, "make cmdline_test_avx2" tests the AVX2 version).
+ * Disabling the SIMD version is only useful to compare both versions.
+ *
+ * @param enabled true to use the SIMD version when available, false to force the scalar one
+ */
+void line_set_simd(bool enabled);
+
+/**
+ * Get the number of memory allocations made by the parser since the start of the program
+ * 
+ * Only the chunks of the arenas are allocated with malloc(): parsing a line
+ * usually costs no allocation at all once the arena has been used once.
+ *
+ * @return the number of calls to malloc() made by this library
+ */
+size_t line_alloc_count(void);
+
 #endif
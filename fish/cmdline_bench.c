@@ -0,0 +1,153 @@
+#include "cmdline.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define N_LINES 1024
+#define N_ROUNDS 200
+
+
+/**
+ * Get the current time in seconds
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ *
+ * @return the value of the monotonic clock in seconds
+ */
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Split a line the way line_parse() did before the single-pass tokenizer
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * It reproduces the passes of the old parser: strlen(), isspace() on each char, a calloc()
+ * per word, a strcmp() of each word against the operators and a strchr() per forbidden char.
+ * It is only used as a reference for the timings.
+ *
+ * @param str command line to split
+ *
+ * @return the number of words found
+ */
+static size_t legacy_split(const char *str) {
+  char *words[256];
+  size_t n = 0;
+  size_t len = strlen(str);
+  size_t i = 0;
+
+  while (i < len) {
+    while (str[i] != '\0' && isspace((unsigned char)str[i])) {
+      ++i;
+    }
+    if (str[i] == '\0') {
+      break;
+    }
+    size_t start = i;
+    while (str[i] != '\0' && !isspace((unsigned char)str[i])) {
+      ++i;
+    }
+    char *word = calloc(i - start + 1, sizeof(char));
+    memcpy(word, str + start, i - start);
+
+    if (strcmp(word, "|") && strcmp(word, ">") && strcmp(word, ">>") && strcmp(word, "<") && strcmp(word, "&")) {
+      const char *forbidden = "<>&|";
+      for (size_t f = 0; f < strlen(forbidden); ++f) {
+        if (strchr(word, forbidden[f])) {
+          break;
+        }
+      }
+    }
+    if (n < 256) {
+      words[n++] = word;
+    } else {
+      free(word);
+    }
+  }
+
+  for (size_t j = 0; j < n; ++j) {
+    free(words[j]);
+  }
+  return n;
+}
+
+/**
+ * Build a generated command line, like the ones of the batch scripts
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ *
+ * @param buf buffer receiving the line
+ * @param size size of the buffer
+ * @param k number of the line
+ */
+static void make_line(char *buf, size_t size, int k) {
+  snprintf(buf, size,
+           "grep --line-number --ignore-case \"pattern number %d\" /var/log/generated/file-%d.log"
+           " | sort --key=2 --numeric-sort | uniq --count | head -n %d > /tmp/result-%d.txt\n",
+           k, k, k % 100, k);
+}
+
+/**
+ * Print the rate of a benchmark
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ *
+ * @param name name of the benchmark
+ * @param seconds elapsed time
+ * @param bytes number of bytes parsed
+ */
+static void report(const char *name, double seconds, size_t bytes) {
+  double lines = (double)N_LINES * N_ROUNDS;
+  printf("%-28s %10.0f lines/s %8.1f MB/s\n", name, lines / seconds, bytes / seconds / 1e6);
+}
+
+
+int main() {
+  static char lines[N_LINES][256];
+  size_t bytes = 0;
+  for (int k = 0; k < N_LINES; ++k) {
+    make_line(lines[k], sizeof(lines[k]), k);
+    bytes += strlen(lines[k]);
+  }
+  bytes *= N_ROUNDS;
+
+  struct line li;
+  line_init(&li);
+  size_t check = 0;
+
+  double start = now();
+  for (int r = 0; r < N_ROUNDS; ++r) {
+    for (int k = 0; k < N_LINES; ++k) {
+      check += legacy_split(lines[k]);
+    }
+  }
+  report("legacy multi-pass split", now() - start, bytes);
+
+  line_set_simd(false);
+  start = now();
+  for (int r = 0; r < N_ROUNDS; ++r) {
+    for (int k = 0; k < N_LINES; ++k) {
+      check += line_parse(&li, lines[k]);
+      line_reset(&li);
+    }
+  }
+  report("line_parse (scalar)", now() - start, bytes);
+
+  line_set_simd(true);
+  start = now();
+  for (int r = 0; r < N_ROUNDS; ++r) {
+    for (int k = 0; k < N_LINES; ++k) {
+      check += line_parse(&li, lines[k]);
+      line_reset(&li);
+    }
+  }
+  report("line_parse (SIMD)", now() - start, bytes);
+
+  line_destroy(&li);
+  return check == 0;
+}
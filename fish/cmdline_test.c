@@ -46,6 +46,81 @@ static void try(const char *str, int expected) {
 }
 
 
+/**
+ * Test that the SIMD and the scalar tokenizers give the same struct line for a command line "str"
+ * 
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * 
+ * @param str command line to test
+ */
+static void try_simd(const char *str) {
+  static int n = 0;
+  struct line simd, scalar;
+
+  line_init(&simd);
+  line_init(&scalar);
+  printf("TEST SIMD #%i\n", ++n);
+
+  line_set_simd(true);
+  int err = line_parse(&simd, str);
+  line_set_simd(false);
+  err |= line_parse(&scalar, str);
+  line_set_simd(true);
+
+  bool same = !err && simd.n_cmds == scalar.n_cmds;
+  for (size_t i = 0; same && i < simd.n_cmds; ++i) {
+    same = simd.cmds[i].n_args == scalar.cmds[i].n_args;
+    for (size_t j = 0; same && j < simd.cmds[i].n_args; ++j) {
+      same = strcmp(simd.cmds[i].args[j], scalar.cmds[i].args[j]) == 0;
+    }
+  }
+
+  if (!same) {
+    printf("%sDIFFERENT TOKENS WITH: %s%s\n", RED, str, NC);
+  } 
+  else {
+    printf("%sTEST OK!%s\n", GREEN, NC);
+  }
+  line_destroy(&simd);
+  line_destroy(&scalar);
+}
+
+/**
+ * Test the number of memory allocations made by line_parse() for a command line "str"
+ * 
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * The line is parsed twice with the same struct line: the first parse must not allocate
+ * more than "max_allocs" times, and the second one must reuse the memory kept by line_reset().
+ * 
+ * @param str command line to test
+ * @param max_allocs maximum number of allocations expected for the first parse
+ */
+static void try_alloc(const char *str, size_t max_allocs) {
+  static int n = 0;
+  struct line li;
+
+  line_init(&li);
+  printf("TEST ALLOC #%i\n", ++n);
+
+  size_t before = line_alloc_count();
+  int err = line_parse(&li, str);
+  size_t first = line_alloc_count() - before;
+  line_reset(&li);
+
+  before = line_alloc_count();
+  err |= line_parse(&li, str);
+  size_t second = line_alloc_count() - before;
+  line_destroy(&li);
+
+  if (err || first > max_allocs || second != 0) {
+    printf("%sUNEXPECTED ALLOCATIONS (%zu then %zu) WITH: %s%s\n", RED, first, second, str, NC);
+  } 
+  else {
+    printf("%sTEST OK!%s\n", GREEN, NC);
+  }
+}
+
+
 int main() {
 
   // things working
@@ -82,14 +157,40 @@ int main() {
   try("bar | baz | qux\n", OK);
   try("bar \"baz\"\n", OK);
   try("bar \"baz qux\"\n", OK);
+  try("find . -name a -o -name b -o -name c -o -name d -o -name e -o -name f -o -name g\n", OK);
+  try("a | b | c | d | e | f | g | h | i | j | k | l | m | n | o | p | q | r | s | t\n", OK);
+  try("bar|baz>qux\n", OK);
+  try("bar<qux&\n", OK);
+  try("bar \"baz|qux\" \"a>b\"\n", OK);
+  try("bar ba\"z q\"ux\n", OK);
+  try("\tbar\vbaz\fqux\r\n", OK);
+  try("bar ; baz\n", OK);
+  try("bar;baz;\n", OK);
+  try("bar && baz || qux\n", OK);
+  try("bar | baz > qux && qux < bar\n", OK);
+  try("bar & ; baz\n", OK);
+  try("bar << baz\n", OK);
+  try("bar <<\"baz\" | qux > baz\n", OK);
+  try("bar <<< baz\n", OK);
+  try("bar <<< \"baz qux\" && qux << baz\n", OK);
+  try("bar > qux | baz\n", OK);
+  try("bar >> qux | baz\n", OK);
+  try("bar bar | baz < qux\n", OK);
+  try("bar | qux <<< baz\n", OK);
+  try("bar 2> qux\n", OK);
+  try("bar > qux 2>&1\n", OK);
+  try("bar 2>&1 | baz 2>> qux | qux\n", OK);
+  try("bar &> qux\n", OK);
+  try("bar &>> qux &\n", OK);
+  try("bar 3<> qux 0<&3 3>&-\n", OK);
+  try("bar 12>qux\n", OK);
+  try("bar a2>qux\n", OK);
 
 
   // things not working
   try("bar \"bar\n", KO);	
   
   try("bar & | baz\n", KO);
-  try("bar > qux | baz\n", KO);
-  try("bar >> qux | baz\n", KO);
   try("bar > qux |\n", KO);
   try("bar >> qux |\n", KO);
   try("bar | | barz\n", KO);
@@ -109,7 +210,6 @@ int main() {
   try("bar < qux < baz\n", KO);
   try("bar < qux <\n", KO);
   try("bar & < qux\n", KO);
-  try("bar bar | baz < qux\n", KO);
   try("bar | < qux\n", KO);
   try("bar <   \n", KO);
   try("bar <\n", KO);
@@ -122,8 +222,26 @@ int main() {
   
   try("bar & baz\n", KO);
   try("bar & ba&z\n", KO);
-  try("bar << baz\n", KO);
   try("bar &ml baz\n", KO);
+
+  try("; bar\n", KO);
+  try("bar ; ; baz\n", KO);
+  try("bar &&\n", KO);
+  try("bar || && baz\n", KO);
+  try("bar & && baz\n", KO);
+  try("bar | ; baz\n", KO);
+  try("bar <<\n", KO);
+  try("bar <<< < baz\n", KO);
+  try("bar << baz < qux\n", KO);
+  try("bar <<<< baz\n", KO);
+  try("bar 2>\n", KO);
+  try("bar 2>&\n", KO);
+  try("bar >&qux\n", KO);
+  try("bar 2>&1x\n", KO);
+  try("bar 2> qux 2> baz\n", KO);
+  try("bar &> qux > baz\n", KO);
+  try("2>&1\n", KO);
+  try("bar &>&1\n", KO);
   
   try("bar |\n", KO);
   try("bar | > qux\n", KO);
@@ -135,5 +253,33 @@ int main() {
   try(">> qux \n", KO);
   
 
+  // SIMD and scalar tokenizers
+  try_simd("bar baz qux\n");
+  try_simd("bar<quux|baz>>qux&\n");
+  try_simd("a-word-longer-than-one-block-of-32-bytes \"and a quoted part | longer than 32 bytes too\"x y\n");
+  try_simd("\t  bar\v\f\"\"baz  \"\" \r\n");
+  try_simd("bar");
+
+  // memory allocations
+  try_alloc("bar\n", 1);
+  try_alloc("bar baz > qux < quux\n", 1);
+  try_alloc("a0 a1 a2 a3 a4 a5 a6 a7 a8 a9 a10 a11 a12 a13 a14 a15 | "
+            "b0 b1 b2 b3 b4 b5 b6 b7 b8 b9 b10 b11 b12 b13 b14 b15 | "
+            "c0 c1 c2 c3 c4 c5 c6 c7 c8 c9 c10 c11 c12 c13 c14 c15 | "
+            "d0 d1 d2 d3 d4 d5 d6 d7 d8 d9 d10 d11 d12 d13 d14 d15 | "
+            "e0 e1 e2 e3 e4 e5 e6 e7 e8 e9 e10 e11 e12 e13 e14 e15 | "
+            "f0 f1 f2 f3 f4 f5 f6 f7 f8 f9 f10 f11 f12 f13 f14 f15 | "
+            "g0 g1 g2 g3 g4 g5 g6 g7 g8 g9 g10 g11 g12 g13 g14 g15 | "
+            "h0 h1 h2 h3 h4 h5 h6 h7 h8 h9 h10 h11 h12 h13 h14 h15 | "
+            "i0 i1 i2 i3 i4 i5 i6 i7 i8 i9 i10 i11 i12 i13 i14 i15 | "
+            "j0 j1 j2 j3 j4 j5 j6 j7 j8 j9 j10 j11 j12 j13 j14 j15 | "
+            "k0 k1 k2 k3 k4 k5 k6 k7 k8 k9 k10 k11 k12 k13 k14 k15 | "
+            "l0 l1 l2 l3 l4 l5 l6 l7 l8 l9 l10 l11 l12 l13 l14 l15 | "
+            "m0 m1 m2 m3 m4 m5 m6 m7 m8 m9 m10 m11 m12 m13 m14 m15 | "
+            "n0 n1 n2 n3 n4 n5 n6 n7 n8 n9 n10 n11 n12 n13 n14 n15 | "
+            "o0 o1 o2 o3 o4 o5 o6 o7 o8 o9 o10 o11 o12 o13 o14 o15 | "
+            "p0 p1 p2 p3 p4 p5 p6 p7 p8 p9 p10 p11 p12 p13 p14 p15\n", 4);
+
+
   return 0;
 }
@@ -0,0 +1,748 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "intern_cmd/intern_cmd.h"
+#include "var_cmd/var_cmd.h"
+#include "complete_cmd.h"
+
+#define COMPLETE_WAIT_MS 10     // longest wait of a completion for the check of $PATH
+#define COMPLETE_CACHE_DIRS 16  // directories kept for the completion of the files
+#define COMPLETE_DENTS_SIZE 32768
+#define COMPLETE_LIST_MIN 256
+#define COMPLETE_TRIE_MIN 1024
+
+/**
+ * @brief A node of the trie of the commands.
+ *
+ * The nodes are in one array, linked by their indexes: the children of a
+ * node are a list sorted by byte. The root is the node 0, so 0 also means "none".
+ */
+struct complete_node {
+    uint32_t child; // first child
+    uint32_t next;  // next sibling
+    unsigned char c;
+    bool end;       // a name ends here
+};
+
+/**
+ * @brief The trie of the commands.
+ */
+struct complete_trie {
+    struct complete_node *nodes;
+    size_t n;
+    size_t cap;
+};
+
+/**
+ * @brief A directory read, with what tells if it changed since.
+ */
+struct complete_dir {
+    char *path;                 // NULL for a free entry
+    dev_t dev;                  // 0 when the directory could not be read
+    ino_t ino;
+    struct timespec mtime;
+    bool recent;                // modified while it was read: read again next time
+    unsigned long used;         // last use (cache of the files)
+    struct complete_list names; // sorted, the directories end with '/'
+};
+
+/**
+ * @brief The requests of the shell and the trie built by the thread.
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;        // signaled when a request is made
+    pthread_cond_t ready;       // signaled when a request is answered
+    bool started;
+    char *request;              // $PATH of the last request
+    unsigned long requested;    // number of the last request
+    unsigned long answered;     // number of the last request answered
+    struct complete_trie *trie; // last trie built, NULL before the first one
+} comp = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+// The directories of $PATH, only used by the thread
+static struct complete_dir *path_dirs = NULL;
+static size_t n_path_dirs = 0;
+
+// The directories of the completion of the files, only used by the shell
+static struct complete_dir cache[COMPLETE_CACHE_DIRS];
+static unsigned long cache_clock = 0;
+
+
+/**
+ * @brief Add a name to a list, given in two parts.
+ *
+ * @param list The list.
+ * @param a The first part of the name.
+ * @param alen The length of the first part.
+ * @param b The second part of the name.
+ * @param blen The length of the second part.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+static int complete_add(struct complete_list *list, const char *a, size_t alen, const char *b, size_t blen) {
+    size_t need = list->len + alen + blen + 1;
+    if (need > list->cap) {
+        size_t cap = list->cap ? list->cap : COMPLETE_LIST_MIN;
+        while (cap < need) {
+            cap *= 2;
+        }
+        char *names = realloc(list->names, cap);
+        if (names == NULL) {
+            perror("realloc");
+            return 1;
+        }
+        list->names = names;
+        list->cap = cap;
+    }
+    memcpy(list->names + list->len, a, alen);
+    memcpy(list->names + list->len + alen, b, blen);
+    list->names[need - 1] = '\0';
+    list->len = need;
+    list->count++;
+    return 0;
+}
+
+/**
+ * @brief Compare two names for qsort().
+ *
+ * @param a Pointer to the first name.
+ * @param b Pointer to the second name.
+ * @return int The result of strcmp().
+ */
+static int complete_cmp(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * @brief Sort the names of a list.
+ *
+ * @param list The list.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+static int complete_sort(struct complete_list *list) {
+    if (list->count < 2) {
+        return 0;
+    }
+    char **index = malloc(list->count * sizeof(*index));
+    char *names = malloc(list->cap);
+    if (index == NULL || names == NULL) {
+        perror("malloc");
+        free(index);
+        free(names);
+        return 1;
+    }
+    char *s = list->names;
+    for (size_t i = 0; i < list->count; ++i) {
+        index[i] = s;
+        s += strlen(s) + 1;
+    }
+    qsort(index, list->count, sizeof(*index), complete_cmp);
+
+    size_t len = 0;
+    for (size_t i = 0; i < list->count; ++i) {
+        size_t n = strlen(index[i]) + 1;
+        memcpy(names + len, index[i], n);
+        len += n;
+    }
+    free(index);
+    free(list->names);
+    list->names = names;
+    return 0;
+}
+
+/**
+ * @brief Compute the prefix shared by all the names of a list.
+ *
+ * @param list The list, whose "common" field is set.
+ */
+static void complete_common(struct complete_list *list) {
+    list->common = 0;
+    if (list->count == 0) {
+        return;
+    }
+    const char *first = list->names;
+    size_t common = strlen(first);
+    for (const char *s = first + common + 1; s < list->names + list->len; s += strlen(s) + 1) {
+        size_t i = 0;
+        while (i < common && s[i] == first[i]) {
+            i++;
+        }
+        common = i;
+    }
+    // The prefix never ends in the middle of a UTF-8 character
+    while (common > 0 && ((unsigned char)first[common] & 0xc0) == 0x80) {
+        common--;
+    }
+    list->common = common;
+}
+
+/**
+ * @brief Read the names of a directory with getdents64().
+ *
+ * The entries are read in big blocks, and the type given by the kernel is
+ * used, so that only the symbolic links (and the entries of the filesystems
+ * giving no type) cost a stat().
+ *
+ * @param fd The directory.
+ * @param commands A flag indicating if only the executable files are kept
+ *                 (otherwise every name is kept, with a '/' after the directories).
+ * @param names Receives the names, sorted.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+static int complete_read_dir(int fd, bool commands, struct complete_list *names) {
+    union {
+        struct dirent64 d;
+        char b[COMPLETE_DENTS_SIZE];
+    } buf;
+    names->len = 0;
+    names->count = 0;
+
+    for (;;) {
+        ssize_t n = getdents64(fd, &buf, sizeof(buf));
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("getdents64");
+            return 1;
+        }
+        if (n == 0) {
+            break;
+        }
+        for (ssize_t off = 0; off < n;) {
+            struct dirent64 *d = (struct dirent64 *)(buf.b + off);
+            off += d->d_reclen;
+            const char *name = d->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            bool dir = d->d_type == DT_DIR;
+            if (d->d_type == DT_LNK || d->d_type == DT_UNKNOWN) {
+                struct stat st;
+                dir = fstatat(fd, name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+            }
+            int err;
+            if (commands) {
+                if (dir || faccessat(fd, name, X_OK, 0) != 0) {
+                    continue;
+                }
+                err = complete_add(names, name, strlen(name), "", 0);
+            } else {
+                err = complete_add(names, name, strlen(name), "/", dir);
+            }
+            if (err != 0) {
+                return 1;
+            }
+        }
+    }
+    return complete_sort(names);
+}
+
+/**
+ * @brief Read a directory again.
+ *
+ * @param dir The directory (its path is set).
+ * @param commands A flag indicating if only the executable files are kept.
+ * @return int Returns 0 on success, or 1 on failure (the directory is then empty).
+ */
+static int complete_dir_read(struct complete_dir *dir, bool commands) {
+    dir->names.len = 0;
+    dir->names.count = 0;
+    dir->dev = 0;
+    dir->ino = 0;
+    // A directory of $PATH may not exist: this is not an error to report
+    int fd = open(dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        return 1;
+    }
+    struct stat st;
+    int ret = fstat(fd, &st) == -1 ? 1 : complete_read_dir(fd, commands, &dir->names);
+    close(fd);
+    if (ret == 0) {
+        dir->dev = st.st_dev;
+        dir->ino = st.st_ino;
+        dir->mtime = st.st_mtim;
+        // The mtime has the granularity of the clock of the kernel (a few ms):
+        // a change in the same tick would not be seen, so a recent directory is not trusted
+        dir->recent = st.st_mtim.tv_sec >= time(NULL) - 1;
+    }
+    return ret;
+}
+
+/**
+ * @brief Check if a directory is the same as when it was read.
+ *
+ * @param dir The directory read.
+ * @param st The status of the directory now.
+ * @return bool Returns true if the names read are still the names of the directory.
+ */
+static bool complete_dir_same(const struct complete_dir *dir, const struct stat *st) {
+    return !dir->recent && dir->dev == st->st_dev && dir->ino == st->st_ino
+        && dir->mtime.tv_sec == st->st_mtim.tv_sec && dir->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+/**
+ * @brief Check the directories of $PATH, and read the ones that changed.
+ *
+ * The relative directories are skipped: their content depends on the
+ * directory of the shell, which the thread does not follow.
+ *
+ * @param path The value of $PATH.
+ * @return bool Returns true if the executables may have changed.
+ */
+static bool complete_scan_path(const char *path) {
+    size_t max = 1;
+    for (const char *p = path; *p != '\0'; ++p) {
+        max += *p == ':';
+    }
+    struct complete_dir *dirs = calloc(max, sizeof(*dirs));
+    if (dirs == NULL) {
+        perror("calloc");
+        return false;
+    }
+
+    bool changed = false;
+    size_t n = 0;
+    for (const char *p = path; *p != '\0';) {
+        size_t len = strcspn(p, ":");
+        const char *start = p;
+        p += len + (p[len] == ':');
+        if (len == 0 || start[0] != '/') {
+            continue;
+        }
+        char *name = strndup(start, len);
+        if (name == NULL) {
+            perror("strndup");
+            break;
+        }
+        bool twice = false;
+        for (size_t i = 0; i < n && !twice; ++i) {
+            twice = strcmp(dirs[i].path, name) == 0;
+        }
+        if (twice) {
+            free(name);
+            continue;
+        }
+
+        // A directory already read is kept, with its names
+        struct complete_dir *dir = &dirs[n++];
+        for (size_t i = 0; i < n_path_dirs; ++i) {
+            if (path_dirs[i].path != NULL && strcmp(path_dirs[i].path, name) == 0) {
+                *dir = path_dirs[i];
+                path_dirs[i].path = NULL;
+                break;
+            }
+        }
+        if (dir->path == NULL) {
+            dir->path = name;
+            changed = true;
+        } else {
+            free(name);
+        }
+
+        struct stat st;
+        if (stat(dir->path, &st) == -1) {
+            if (dir->names.count > 0) {
+                changed = true;
+            }
+            dir->names.len = 0;
+            dir->names.count = 0;
+            dir->dev = 0;
+            dir->ino = 0;
+        } else if (!complete_dir_same(dir, &st)) {
+            complete_dir_read(dir, true);
+            changed = true;
+        }
+    }
+
+    // The directories no longer in $PATH
+    for (size_t i = 0; i < n_path_dirs; ++i) {
+        if (path_dirs[i].path != NULL) {
+            free(path_dirs[i].path);
+            free(path_dirs[i].names.names);
+            changed = true;
+        }
+    }
+    free(path_dirs);
+    path_dirs = dirs;
+    n_path_dirs = n;
+    return changed;
+}
+
+/**
+ * @brief Free a trie.
+ *
+ * @param t The trie, or NULL.
+ */
+static void complete_trie_free(struct complete_trie *t) {
+    if (t != NULL) {
+        free(t->nodes);
+        free(t);
+    }
+}
+
+/**
+ * @brief Add a name to a trie.
+ *
+ * @param t The trie.
+ * @param name The name.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+static int complete_trie_insert(struct complete_trie *t, const char *name) {
+    uint32_t node = 0;
+    for (const unsigned char *s = (const unsigned char *)name; *s != '\0'; ++s) {
+        uint32_t prev = 0;
+        uint32_t cur = t->nodes[node].child;
+        while (cur != 0 && t->nodes[cur].c < *s) {
+            prev = cur;
+            cur = t->nodes[cur].next;
+        }
+        if (cur == 0 || t->nodes[cur].c != *s) {
+            if (t->n == t->cap) {
+                struct complete_node *nodes = realloc(t->nodes, 2 * t->cap * sizeof(*nodes));
+                if (nodes == NULL) {
+                    perror("realloc");
+                    return 1;
+                }
+                t->nodes = nodes;
+                t->cap *= 2;
+            }
+            uint32_t added = t->n++;
+            t->nodes[added] = (struct complete_node){ .child = 0, .next = cur, .c = *s, .end = false };
+            if (prev == 0) {
+                t->nodes[node].child = added;
+            } else {
+                t->nodes[prev].next = added;
+            }
+            cur = added;
+        }
+        node = cur;
+    }
+    t->nodes[node].end = true;
+    return 0;
+}
+
+/**
+ * @brief Build the trie of the internal commands and of the executables of $PATH.
+ *
+ * @return struct complete_trie* The trie, or NULL on failure.
+ */
+static struct complete_trie *complete_trie_build() {
+    struct complete_trie *t = malloc(sizeof(*t));
+    if (t == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+    t->cap = COMPLETE_TRIE_MIN;
+    t->n = 1;
+    t->nodes = malloc(t->cap * sizeof(*t->nodes));
+    if (t->nodes == NULL) {
+        perror("malloc");
+        free(t);
+        return NULL;
+    }
+    t->nodes[0] = (struct complete_node){ 0 };
+
+    const char *name;
+    for (size_t i = 0; (name = builtin_name(i)) != NULL; ++i) {
+        if (complete_trie_insert(t, name) != 0) {
+            complete_trie_free(t);
+            return NULL;
+        }
+    }
+    for (size_t i = 0; i < n_path_dirs; ++i) {
+        const struct complete_list *names = &path_dirs[i].names;
+        for (const char *s = names->names; s != NULL && s < names->names + names->len; s += strlen(s) + 1) {
+            if (complete_trie_insert(t, s) != 0) {
+                complete_trie_free(t);
+                return NULL;
+            }
+        }
+    }
+    return t;
+}
+
+/**
+ * @brief Add the names below a node of the trie to a list, in order.
+ *
+ * @param t The trie.
+ * @param node The node.
+ * @param name The name of the node, in a buffer of NAME_MAX + 1 bytes.
+ * @param len The length of the name.
+ * @param list The list.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+static int complete_trie_collect(const struct complete_trie *t, uint32_t node, char *name, size_t len, struct complete_list *list) {
+    if (t->nodes[node].end && complete_add(list, name, len, "", 0) != 0) {
+        return 1;
+    }
+    if (len == NAME_MAX) {
+        return 0;
+    }
+    for (uint32_t c = t->nodes[node].child; c != 0; c = t->nodes[c].next) {
+        name[len] = t->nodes[c].c;
+        if (complete_trie_collect(t, c, name, len + 1, list) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Body of the completion thread: check $PATH and build the trie when asked.
+ *
+ * @param arg Unused.
+ * @return void* Never returns.
+ */
+static void *complete_thread(void *arg) {
+    (void)arg;
+    bool built = false;
+
+    pthread_mutex_lock(&comp.lock);
+    for (;;) {
+        while (comp.answered == comp.requested) {
+            pthread_cond_wait(&comp.work, &comp.lock);
+        }
+        unsigned long request = comp.requested;
+        char *path = strdup(comp.request);
+        // The disk is read without the lock: the completions use the last trie meanwhile
+        pthread_mutex_unlock(&comp.lock);
+        struct complete_trie *trie = NULL;
+        if (path == NULL) {
+            perror("strdup");
+        } else if (complete_scan_path(path) || !built) {
+            trie = complete_trie_build();
+            built = trie != NULL;
+        }
+        free(path);
+        pthread_mutex_lock(&comp.lock);
+
+        if (trie != NULL) {
+            complete_trie_free(comp.trie);
+            comp.trie = trie;
+        }
+        comp.answered = request;
+        pthread_cond_broadcast(&comp.ready);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Start the thread building the trie of the commands.
+ *
+ * The trie holds the executables of the directories of $PATH and the
+ * internal commands. It is built by a thread, so the first prompt never
+ * waits for it; the directories are checked again at each completion of a
+ * command, and only the ones whose mtime changed are read again.
+ *
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int complete_init() {
+    // The first request is made now: the trie is built while the user types
+    const char *path = var_get("PATH");
+    comp.request = strdup(path != NULL ? path : "");
+    if (comp.request == NULL) {
+        perror("strdup");
+        return 1;
+    }
+    comp.requested = 1;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&comp.ready, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_cond_init(&comp.work, NULL);
+
+    // The signals (SIGCHLD) are left to the main thread
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    pthread_t thread;
+    int err = pthread_create(&thread, NULL, complete_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err != 0) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(err));
+        return 1;
+    }
+    pthread_detach(thread);
+    comp.started = true;
+    return 0;
+}
+
+/**
+ * @brief Complete a command with the trie.
+ *
+ * The thread is asked to check $PATH first; the completion waits for it
+ * COMPLETE_WAIT_MS at most, and uses the last trie if it comes too late
+ * (a directory being read again, or the first trie not built yet).
+ *
+ * @param word The beginning of the command.
+ * @param len The length of the word.
+ * @param list Receives the commands.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+static int complete_commands(const char *word, size_t len, struct complete_list *list) {
+    if (!comp.started || len > NAME_MAX) {
+        return 0;
+    }
+    const char *path = var_get("PATH");
+    if (path == NULL) {
+        path = "";
+    }
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += COMPLETE_WAIT_MS * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&comp.lock);
+    if (strcmp(comp.request, path) != 0) {
+        char *copy = strdup(path);
+        if (copy != NULL) {
+            free(comp.request);
+            comp.request = copy;
+        }
+    }
+    unsigned long request = ++comp.requested;
+    pthread_cond_signal(&comp.work);
+    while (comp.answered != request) {
+        if (pthread_cond_timedwait(&comp.ready, &comp.lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+
+    int ret = 0;
+    const struct complete_trie *t = comp.trie;
+    if (t != NULL) {
+        char name[NAME_MAX + 1];
+        uint32_t node = 0;
+        for (size_t i = 0; i < len && node != UINT32_MAX; ++i) {
+            uint32_t c = t->nodes[node].child;
+            while (c != 0 && t->nodes[c].c != (unsigned char)word[i]) {
+                c = t->nodes[c].next;
+            }
+            node = c != 0 ? c : UINT32_MAX;
+        }
+        if (node != UINT32_MAX) {
+            memcpy(name, word, len);
+            ret = complete_trie_collect(t, node, name, len, list);
+        }
+    }
+    pthread_mutex_unlock(&comp.lock);
+    return ret;
+}
+
+/**
+ * @brief Complete a file with the cache of the directories.
+ *
+ * @param word The beginning of the path.
+ * @param len The length of the word.
+ * @param list Receives the paths.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+static int complete_files(const char *word, size_t len, struct complete_list *list) {
+    // The directory of the word, and the beginning of the name
+    size_t dlen = len;
+    while (dlen > 0 && word[dlen - 1] != '/') {
+        dlen--;
+    }
+    char path[PATH_MAX];
+    if (dlen >= sizeof(path)) {
+        return 0;
+    }
+    if (dlen == 0) {
+        strcpy(path, ".");
+    } else {
+        memcpy(path, word, dlen);
+        path[dlen] = '\0';
+    }
+    const char *prefix = word + dlen;
+    size_t plen = len - dlen;
+
+    struct stat st;
+    if (stat(path, &st) == -1) {
+        return 0;
+    }
+    // The entry of the directory, or the one used the longest time ago
+    struct complete_dir *dir = NULL;
+    struct complete_dir *victim = &cache[0];
+    for (size_t i = 0; i < COMPLETE_CACHE_DIRS && dir == NULL; ++i) {
+        if (cache[i].path != NULL && strcmp(cache[i].path, path) == 0) {
+            dir = &cache[i];
+        } else if (cache[i].used < victim->used) {
+            victim = &cache[i];
+        }
+    }
+    if (dir == NULL) {
+        char *copy = strdup(path);
+        if (copy == NULL) {
+            perror("strdup");
+            return 1;
+        }
+        free(victim->path);
+        victim->path = copy;
+        victim->dev = 0;
+        victim->ino = 0;
+        dir = victim;
+    }
+    dir->used = ++cache_clock;
+    // The same path may be another directory after a cd: the inode tells it
+    if (!complete_dir_same(dir, &st) && complete_dir_read(dir, false) != 0) {
+        return 0;
+    }
+
+    const struct complete_list *names = &dir->names;
+    for (const char *s = names->names; s != NULL && s < names->names + names->len; s += strlen(s) + 1) {
+        if (strncmp(s, prefix, plen) != 0 || (s[0] == '.' && (plen == 0 || prefix[0] != '.'))) {
+            continue;
+        }
+        if (complete_add(list, word, dlen, s, strlen(s)) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Find the completions of a word.
+ *
+ * A word in the position of a command, without '/', is completed from the
+ * trie of the commands; other words are completed with the names of the files
+ * of their directory (kept in a cache, read again when the mtime of the
+ * directory changes). The names are sorted, and each one is the whole word
+ * completed; the names of the directories end with '/'. The hidden files are
+ * only given for a word starting with '.'.
+ *
+ * @param word The beginning of the word (not '\0' terminated).
+ * @param len The length of the word.
+ * @param command A flag indicating if the word is in the position of a command.
+ * @param list Receives the completions (its previous content is dropped).
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int complete_word(const char *word, size_t len, bool command, struct complete_list *list) {
+    list->len = 0;
+    list->count = 0;
+    int ret;
+    if (command && memchr(word, '/', len) == NULL) {
+        ret = complete_commands(word, len, list);
+    } else {
+        ret = complete_files(word, len, list);
+    }
+    complete_common(list);
+    return ret;
+}
@@ -0,0 +1,48 @@
+#ifndef COMPLETE_CMD_H
+#define COMPLETE_CMD_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * @brief A list of names, '\0' terminated one after the other.
+ */
+struct complete_list {
+    char *names;
+    size_t len;    // bytes used in "names"
+    size_t cap;
+    size_t count;  // number of names
+    size_t common; // length of the prefix shared by all the names
+};
+
+/**
+ * @brief Start the thread building the trie of the commands.
+ *
+ * The trie holds the executables of the directories of $PATH and the
+ * internal commands. It is built by a thread, so the first prompt never
+ * waits for it; the directories are checked again at each completion of a
+ * command, and only the ones whose mtime changed are read again.
+ *
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int complete_init();
+
+/**
+ * @brief Find the completions of a word.
+ *
+ * A word in the position of a command, without '/', is completed from the
+ * trie of the commands; other words are completed with the names of the files
+ * of their directory (kept in a cache, read again when the mtime of the
+ * directory changes). The names are sorted, and each one is the whole word
+ * completed; the names of the directories end with '/'. The hidden files are
+ * only given for a word starting with '.'.
+ *
+ * @param word The beginning of the word (not '\0' terminated).
+ * @param len The length of the word.
+ * @param command A flag indicating if the word is in the position of a command.
+ * @param list Receives the completions (its previous content is dropped).
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int complete_word(const char *word, size_t len, bool command, struct complete_list *list);
+
+#endif /* COMPLETE_CMD_H */
@@ -0,0 +1,808 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+
+#include "util.h"
+#include "history_cmd/history_cmd.h"
+#include "complete_cmd/complete_cmd.h"
+#include "edit_cmd.h"
+
+#define KEY_CTRL(c) ((c) & 0x1f)
+#define ESC 27
+#define EDIT_ESC_TIMEOUT 50  // ms to wait for the rest of an escape sequence
+#define EDIT_TEXT_MIN 128
+#define EDIT_LIST_MAX 200    // completions listed at most
+#define EDIT_BREAKS " \t|;&<>()" // bytes ending a word, for the completion
+
+#define EDIT_TIMEOUT -1
+#define EDIT_EOF     -2 // end of the input (Ctrl-D or terminal closed)
+#define EDIT_ERROR   -3
+
+/**
+ * @brief Keys given by escape sequences (after the 256 byte values).
+ */
+enum edit_key {
+    KEY_UP = 256,
+    KEY_DOWN,
+    KEY_RIGHT,
+    KEY_LEFT,
+    KEY_HOME,
+    KEY_END,
+    KEY_DELETE,
+    KEY_NONE, // unknown sequence, ignored
+};
+
+/**
+ * @brief A growing text, not '\0' terminated unless said otherwise.
+ */
+struct edit_text {
+    char *s;
+    size_t len;
+    size_t cap;
+};
+
+/**
+ * @brief The state of the line editor.
+ */
+static struct {
+    int fd;
+    int wake_fd;
+    void (*wake)();
+    size_t cols;             // width of the terminal
+    struct edit_text line;   // line being edited
+    size_t pos;              // cursor, as an offset in "line"
+    size_t hist;             // history entry shown, history_end() for the line being edited
+    struct edit_text saved;  // line being edited, kept while the history is shown
+    bool searching;          // Ctrl-R
+    struct edit_text query;  // text searched ('\0' terminated)
+    bool found;              // "match" is an entry containing the query
+    bool failed;             // the last search found nothing
+    size_t match;
+    struct complete_list completions;
+    struct edit_text out;    // bytes to write to the terminal
+    struct edit_text result; // accepted line, given to the reader
+    size_t given;            // bytes of "result" already given
+} ed = { .fd = -1, .wake_fd = -1 };
+
+
+/**
+ * @brief Make room in a text.
+ *
+ * @param t The text.
+ * @param len The length needed (one more byte is always kept for a '\0').
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+static int edit_reserve(struct edit_text *t, size_t len) {
+    if (len + 1 <= t->cap) {
+        return 0;
+    }
+    size_t cap = t->cap ? t->cap : EDIT_TEXT_MIN;
+    while (cap < len + 1) {
+        cap *= 2;
+    }
+    char *s = realloc(t->s, cap);
+    if (s == NULL) {
+        perror("realloc");
+        return 1;
+    }
+    t->s = s;
+    t->cap = cap;
+    return 0;
+}
+
+/**
+ * @brief Add bytes at the end of a text.
+ *
+ * @param t The text.
+ * @param s The bytes.
+ * @param len The number of bytes.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+static int edit_append(struct edit_text *t, const char *s, size_t len) {
+    if (edit_reserve(t, t->len + len) != 0) {
+        return 1;
+    }
+    memcpy(t->s + t->len, s, len);
+    t->len += len;
+    t->s[t->len] = '\0';
+    return 0;
+}
+
+/**
+ * @brief Replace the content of a text.
+ *
+ * @param t The text.
+ * @param s The new content.
+ * @param len The length of the new content.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+static int edit_set(struct edit_text *t, const char *s, size_t len) {
+    t->len = 0;
+    return edit_append(t, s, len);
+}
+
+/**
+ * @brief Check if a byte continues a UTF-8 character.
+ *
+ * @param c The byte.
+ * @return bool Returns true for the bytes 10xxxxxx.
+ */
+static bool edit_cont(char c) {
+    return ((unsigned char)c & 0xc0) == 0x80;
+}
+
+/**
+ * @brief Get the number of columns taken by a text (one per UTF-8 character).
+ *
+ * @param s The text.
+ * @param len The length of the text.
+ * @return size_t The number of columns.
+ */
+static size_t edit_width(const char *s, size_t len) {
+    size_t width = 0;
+    for (size_t i = 0; i < len; ++i) {
+        width += !edit_cont(s[i]);
+    }
+    return width;
+}
+
+/**
+ * @brief Get the offset of the character after an offset of the line.
+ *
+ * @param i The offset (less than the length of the line).
+ * @return size_t The offset of the next character.
+ */
+static size_t edit_next(size_t i) {
+    do {
+        i++;
+    } while (i < ed.line.len && edit_cont(ed.line.s[i]));
+    return i;
+}
+
+/**
+ * @brief Get the offset of the character before an offset of the line.
+ *
+ * @param i The offset (greater than 0).
+ * @return size_t The offset of the previous character.
+ */
+static size_t edit_prev(size_t i) {
+    do {
+        i--;
+    } while (i > 0 && edit_cont(ed.line.s[i]));
+    return i;
+}
+
+/**
+ * @brief Write the pending output to the terminal, in one system call.
+ */
+static void edit_flush() {
+    size_t done = 0;
+    while (done < ed.out.len) {
+        ssize_t n = write(STDOUT_FILENO, ed.out.s + done, ed.out.len - done);
+        if (n == -1 && errno != EINTR) {
+            break;
+        }
+        if (n > 0) {
+            done += n;
+        }
+    }
+    ed.out.len = 0;
+}
+
+/**
+ * @brief Draw the line being edited after the prompt.
+ *
+ * Lines longer than the terminal scroll horizontally, so that the cursor
+ * is always on the screen.
+ */
+static void edit_refresh_line() {
+    const char *prompt = get_prompt();
+    size_t plen = edit_width(prompt, strlen(prompt));
+    const char *s = ed.line.s;
+
+    size_t start = 0;
+    while (start < ed.pos && plen + edit_width(s + start, ed.pos - start) >= ed.cols) {
+        start = edit_next(start);
+    }
+    size_t end = ed.line.len;
+    while (end > ed.pos && plen + edit_width(s + start, end - start) >= ed.cols) {
+        end = edit_prev(end);
+    }
+
+    char move[32];
+    size_t col = plen + edit_width(s + start, ed.pos - start);
+    int n = col > 0 ? snprintf(move, sizeof(move), "\r\x1b[%zuC", col) : snprintf(move, sizeof(move), "\r");
+    edit_append(&ed.out, "\r", 1);
+    edit_append(&ed.out, prompt, strlen(prompt));
+    edit_append(&ed.out, s + start, end - start);
+    edit_append(&ed.out, "\x1b[0K", 4);
+    edit_append(&ed.out, move, n);
+    edit_flush();
+}
+
+/**
+ * @brief Draw the search line: the text searched and the entry found.
+ */
+static void edit_refresh_search() {
+    const char *label = ed.failed ? "(failed reverse-i-search)`" : "(reverse-i-search)`";
+    edit_append(&ed.out, "\r", 1);
+    edit_append(&ed.out, label, strlen(label));
+    edit_append(&ed.out, ed.query.s, ed.query.len);
+    edit_append(&ed.out, "': ", 3);
+
+    if (ed.found) {
+        size_t used = edit_width(label, strlen(label)) + edit_width(ed.query.s, ed.query.len) + 3;
+        size_t len;
+        const char *text = history_entry(ed.match, &len);
+        // Cut the entry at the width of the terminal
+        size_t end = 0;
+        for (size_t width = used; end < len && width + 1 < ed.cols; ++width) {
+            do {
+                end++;
+            } while (end < len && edit_cont(text[end]));
+        }
+        edit_append(&ed.out, text, end);
+    }
+    edit_append(&ed.out, "\x1b[0K", 4);
+    edit_flush();
+}
+
+/**
+ * @brief Draw the current line, editing or searching.
+ */
+static void edit_refresh() {
+    if (ed.searching) {
+        edit_refresh_search();
+    } else {
+        edit_refresh_line();
+    }
+}
+
+/**
+ * @brief Read a byte from the terminal.
+ *
+ * While waiting without timeout, the watched descriptor is handled too.
+ *
+ * @param timeout The longest wait in ms, or -1 to wait for ever.
+ * @return int The byte, EDIT_TIMEOUT, EDIT_EOF or EDIT_ERROR.
+ */
+static int edit_getc(int timeout) {
+    struct pollfd pfds[2] = { { ed.fd, POLLIN, 0 }, { ed.wake_fd, POLLIN, 0 } };
+    nfds_t n_fds = timeout < 0 && ed.wake_fd != -1 ? 2 : 1;
+    for (;;) {
+        int n = poll(pfds, n_fds, timeout);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            return EDIT_ERROR;
+        }
+        if (n == 0) {
+            return EDIT_TIMEOUT;
+        }
+        if (n_fds == 2 && (pfds[1].revents & POLLIN)) {
+            // Something may have been printed over the line
+            ed.wake();
+            edit_refresh();
+        }
+        if (pfds[0].revents != 0) {
+            unsigned char c;
+            ssize_t r = read(ed.fd, &c, 1);
+            if (r == 1) {
+                return c;
+            }
+            if (r == 0) {
+                return EDIT_EOF;
+            }
+            if (errno != EINTR && errno != EAGAIN) {
+                perror("read");
+                return EDIT_ERROR;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Read a key: a byte, or a key given by an escape sequence.
+ *
+ * @return int The key (a byte or an enum edit_key), EDIT_EOF or EDIT_ERROR.
+ */
+static int edit_key() {
+    int c = edit_getc(-1);
+    if (c != ESC) {
+        return c;
+    }
+    // A lone Escape is not followed by anything
+    int c1 = edit_getc(EDIT_ESC_TIMEOUT);
+    if (c1 < 0) {
+        return c1 == EDIT_TIMEOUT ? ESC : c1;
+    }
+    if (c1 != '[' && c1 != 'O') {
+        return KEY_NONE;
+    }
+    int c2 = edit_getc(EDIT_ESC_TIMEOUT);
+    switch (c2) {
+    case 'A': return KEY_UP;
+    case 'B': return KEY_DOWN;
+    case 'C': return KEY_RIGHT;
+    case 'D': return KEY_LEFT;
+    case 'H': return KEY_HOME;
+    case 'F': return KEY_END;
+    }
+    if (c2 < '0' || c2 > '9') {
+        return KEY_NONE;
+    }
+    // "ESC [ number ~"
+    int num = c2 - '0';
+    int c3;
+    while ((c3 = edit_getc(EDIT_ESC_TIMEOUT)) >= '0' && c3 <= '9') {
+        num = 10 * num + c3 - '0';
+    }
+    if (c3 != '~') {
+        return KEY_NONE;
+    }
+    switch (num) {
+    case 1: case 7: return KEY_HOME;
+    case 4: case 8: return KEY_END;
+    case 3: return KEY_DELETE;
+    }
+    return KEY_NONE;
+}
+
+/**
+ * @brief Remove a part of the line.
+ *
+ * @param from The first byte removed.
+ * @param to The byte after the last one removed.
+ */
+static void edit_delete(size_t from, size_t to) {
+    memmove(ed.line.s + from, ed.line.s + to, ed.line.len - to);
+    ed.line.len -= to - from;
+    if (ed.pos > to) {
+        ed.pos -= to - from;
+    } else if (ed.pos > from) {
+        ed.pos = from;
+    }
+}
+
+/**
+ * @brief Insert bytes in the line, at the cursor.
+ *
+ * @param text The bytes.
+ * @param len The number of bytes.
+ */
+static void edit_insert(const char *text, size_t len) {
+    if (edit_reserve(&ed.line, ed.line.len + len) != 0) {
+        return;
+    }
+    memmove(ed.line.s + ed.pos + len, ed.line.s + ed.pos, ed.line.len - ed.pos);
+    memcpy(ed.line.s + ed.pos, text, len);
+    ed.pos += len;
+    ed.line.len += len;
+}
+
+/**
+ * @brief Print the completions under the line, in columns.
+ *
+ * Only the part after the directory of the word is printed, like ls does.
+ *
+ * @param skip The length of the directory of the word.
+ */
+static void edit_list(size_t skip) {
+    const struct complete_list *list = &ed.completions;
+    size_t shown = list->count < EDIT_LIST_MAX ? list->count : EDIT_LIST_MAX;
+    size_t width = 0;
+    const char *s = list->names;
+    for (size_t i = 0; i < shown; ++i, s += strlen(s) + 1) {
+        size_t w = edit_width(s + skip, strlen(s + skip));
+        width = w > width ? w : width;
+    }
+    size_t per_row = ed.cols / (width + 2) > 0 ? ed.cols / (width + 2) : 1;
+    size_t rows = (shown + per_row - 1) / per_row;
+
+    // Column by column, like ls -C
+    const char **index = malloc(shown * sizeof(*index));
+    if (index == NULL) {
+        perror("malloc");
+        return;
+    }
+    s = list->names;
+    for (size_t i = 0; i < shown; ++i, s += strlen(s) + 1) {
+        index[i] = s + skip;
+    }
+    edit_append(&ed.out, "\n", 1);
+    for (size_t r = 0; r < rows; ++r) {
+        for (size_t i = r; i < shown; i += rows) {
+            size_t len = strlen(index[i]);
+            edit_append(&ed.out, index[i], len);
+            for (size_t w = edit_width(index[i], len); i + rows < shown && w < width + 2; ++w) {
+                edit_append(&ed.out, " ", 1);
+            }
+        }
+        edit_append(&ed.out, "\n", 1);
+    }
+    if (shown < list->count) {
+        char more[64];
+        int n = snprintf(more, sizeof(more), "(%zu more)\n", list->count - shown);
+        edit_append(&ed.out, more, n);
+    }
+    free(index);
+}
+
+/**
+ * @brief Complete the word before the cursor (Tab).
+ *
+ * The word is replaced by the prefix shared by its completions; a single
+ * completion is followed by a space (unless it is a directory), and the
+ * completions are listed when the word cannot be made longer.
+ */
+static void edit_complete() {
+    size_t start = ed.pos;
+    while (start > 0 && strchr(EDIT_BREAKS, ed.line.s[start - 1]) == NULL) {
+        start--;
+    }
+    // A command is the first word of the line, or the first one after | ; & or (
+    size_t before = start;
+    while (before > 0 && (ed.line.s[before - 1] == ' ' || ed.line.s[before - 1] == '\t')) {
+        before--;
+    }
+    bool command = before == 0 || strchr("|;&(", ed.line.s[before - 1]) != NULL;
+
+    size_t len = ed.pos - start;
+    struct complete_list *list = &ed.completions;
+    if (complete_word(ed.line.s + start, len, command, list) != 0 || list->count == 0) {
+        edit_append(&ed.out, "\a", 1);
+        return;
+    }
+    if (list->common > len) {
+        edit_insert(list->names + len, list->common - len);
+    }
+    if (list->count == 1) {
+        if (list->names[list->common - 1] != '/') {
+            edit_insert(" ", 1);
+        }
+    } else if (list->common == len) {
+        size_t skip = len;
+        while (skip > 0 && ed.line.s[start + skip - 1] != '/') {
+            skip--;
+        }
+        edit_list(skip);
+    }
+}
+
+/**
+ * @brief Show the previous or the next entry of the history in the line.
+ *
+ * The line being edited is kept, and comes back after the newest entry.
+ *
+ * @param older A flag indicating if the previous (older) entry is shown.
+ */
+static void edit_history(bool older) {
+    size_t pos = ed.hist;
+    if (older ? !history_prev(&pos) : !history_next(&pos)) {
+        return;
+    }
+    if (ed.hist == history_end() && edit_set(&ed.saved, ed.line.s, ed.line.len) != 0) {
+        return;
+    }
+    ed.hist = pos;
+    if (pos == history_end()) {
+        edit_set(&ed.line, ed.saved.s, ed.saved.len);
+    } else {
+        size_t len;
+        const char *text = history_entry(pos, &len);
+        edit_set(&ed.line, text, len);
+    }
+    ed.pos = ed.line.len;
+}
+
+/**
+ * @brief Apply an editing key to the line.
+ *
+ * @param key The key.
+ */
+static void edit_apply(int key) {
+    switch (key) {
+    case KEY_LEFT:
+    case KEY_CTRL('B'):
+        if (ed.pos > 0) {
+            ed.pos = edit_prev(ed.pos);
+        }
+        break;
+    case KEY_RIGHT:
+    case KEY_CTRL('F'):
+        if (ed.pos < ed.line.len) {
+            ed.pos = edit_next(ed.pos);
+        }
+        break;
+    case KEY_HOME:
+    case KEY_CTRL('A'):
+        ed.pos = 0;
+        break;
+    case KEY_END:
+    case KEY_CTRL('E'):
+        ed.pos = ed.line.len;
+        break;
+    case 127:
+    case KEY_CTRL('H'):
+        if (ed.pos > 0) {
+            edit_delete(edit_prev(ed.pos), ed.pos);
+        }
+        break;
+    case KEY_DELETE:
+    case KEY_CTRL('D'):
+        if (ed.pos < ed.line.len) {
+            edit_delete(ed.pos, edit_next(ed.pos));
+        }
+        break;
+    case KEY_CTRL('K'):
+        ed.line.len = ed.pos;
+        break;
+    case KEY_CTRL('U'):
+        edit_delete(0, ed.pos);
+        break;
+    case KEY_CTRL('W'): {
+        // The word before the cursor, and the spaces after it
+        size_t from = ed.pos;
+        while (from > 0 && ed.line.s[from - 1] == ' ') {
+            from--;
+        }
+        while (from > 0 && ed.line.s[from - 1] != ' ') {
+            from--;
+        }
+        edit_delete(from, ed.pos);
+        break;
+    }
+    case '\t':
+        edit_complete();
+        break;
+    case KEY_CTRL('L'):
+        edit_append(&ed.out, "\x1b[H\x1b[2J", 7);
+        break;
+    case KEY_UP:
+    case KEY_CTRL('P'):
+        edit_history(true);
+        break;
+    case KEY_DOWN:
+    case KEY_CTRL('N'):
+        edit_history(false);
+        break;
+    default:
+        // Printable characters (UTF-8 bytes included), the other keys are ignored
+        if (key >= ' ' && key < 256 && key != 127) {
+            char c = key;
+            edit_insert(&c, 1);
+        }
+        break;
+    }
+}
+
+/**
+ * @brief Search the query in the history, before a position.
+ *
+ * On success, the entry found becomes the match; otherwise the search is
+ * marked as failed and the previous match stays.
+ *
+ * @param pos The position to search before (an entry or history_end()).
+ * @param skip_same A flag indicating if the entries equal to the match are skipped.
+ */
+static void edit_search_from(size_t pos, bool skip_same) {
+    if (ed.query.len == 0) {
+        ed.found = false;
+        ed.failed = false;
+        return;
+    }
+    size_t len = 0;
+    const char *current = ed.found ? history_entry(ed.match, &len) : NULL;
+    while (history_search(ed.query.s, &pos)) {
+        size_t found_len;
+        const char *text = history_entry(pos, &found_len);
+        if (skip_same && current != NULL && found_len == len && memcmp(text, current, len) == 0) {
+            continue;
+        }
+        ed.match = pos;
+        ed.found = true;
+        ed.failed = false;
+        return;
+    }
+    ed.failed = true;
+}
+
+/**
+ * @brief Search the history as the query is typed (Ctrl-R).
+ *
+ * Ctrl-R again finds an older entry, Backspace removes the last character
+ * of the query, Ctrl-G or Escape gives the line back as it was. Any other
+ * key puts the entry found in the line, and is then applied to it.
+ *
+ * @return int The key ending the search, KEY_NONE if it is cancelled, EDIT_EOF or EDIT_ERROR.
+ */
+static int edit_search() {
+    ed.searching = true;
+    ed.found = false;
+    ed.failed = false;
+    ed.query.len = 0;
+    edit_set(&ed.query, "", 0);
+
+    for (;;) {
+        edit_refresh();
+        int key = edit_key();
+        if (key == KEY_CTRL('R')) {
+            if (ed.found) {
+                edit_search_from(ed.match, true);
+            }
+            continue;
+        }
+        if (key == 127 || key == KEY_CTRL('H')) {
+            while (ed.query.len > 0 && edit_cont(ed.query.s[--ed.query.len])) {
+            }
+            ed.query.s[ed.query.len] = '\0';
+            ed.found = false;
+            edit_search_from(history_end(), false);
+            continue;
+        }
+        if (key >= ' ' && key < 256 && key != 127) {
+            char c = key;
+            edit_append(&ed.query, &c, 1);
+            // The match stays if it contains the longer query
+            size_t pos = history_end();
+            if (ed.found) {
+                pos = ed.match;
+                history_next(&pos);
+            }
+            edit_search_from(pos, false);
+            continue;
+        }
+
+        ed.searching = false;
+        if (key == KEY_CTRL('G') || key == ESC) {
+            return KEY_NONE;
+        }
+        if (ed.found) {
+            // The match is shown like an entry reached with Up
+            if (ed.hist == history_end()) {
+                edit_set(&ed.saved, ed.line.s, ed.line.len);
+            }
+            size_t len;
+            const char *text = history_entry(ed.match, &len);
+            edit_set(&ed.line, text, len);
+            ed.pos = ed.line.len;
+            ed.hist = ed.match;
+        }
+        return key;
+    }
+}
+
+/**
+ * @brief Edit a line in raw mode.
+ *
+ * @return int Returns 0 when a line is accepted (in ed.line), EDIT_EOF or EDIT_ERROR.
+ */
+static int edit_line() {
+    struct winsize ws;
+    ed.cols = ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0 ? ws.ws_col : 80;
+    ed.line.len = 0;
+    ed.pos = 0;
+    ed.hist = history_end();
+    if (edit_reserve(&ed.line, 0) != 0) {
+        return EDIT_ERROR;
+    }
+
+    // The mode of the terminal is taken again for each line: a command may have changed it
+    struct termios cooked, raw;
+    if (tcgetattr(ed.fd, &cooked) == -1) {
+        perror("tcgetattr");
+        return EDIT_ERROR;
+    }
+    raw = cooked;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_lflag &= ~(ECHO | ICANON | ISIG | IEXTEN);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(ed.fd, TCSADRAIN, &raw) == -1) {
+        perror("tcsetattr");
+        return EDIT_ERROR;
+    }
+
+    int ret;
+    edit_refresh();
+    for (;;) {
+        int key = edit_key();
+        if (key == KEY_CTRL('R')) {
+            key = edit_search();
+        }
+        if (key < 0) {
+            ret = key;
+            break;
+        }
+        if (key == '\r' || key == '\n') {
+            ret = 0;
+            break;
+        }
+        if (key == KEY_CTRL('D') && ed.line.len == 0) {
+            ret = EDIT_EOF;
+            break;
+        }
+        if (key == KEY_CTRL('C')) {
+            // The line is dropped, like in the other shells
+            ed.pos = ed.line.len;
+            edit_refresh();
+            edit_append(&ed.out, "^C", 2);
+            ed.line.len = 0;
+            ret = 0;
+            break;
+        }
+        edit_apply(key);
+        edit_refresh();
+    }
+
+    if (ret == 0 && ed.line.len > 0) {
+        ed.pos = ed.line.len;
+        edit_refresh();
+    }
+    edit_append(&ed.out, "\n", 1);
+    edit_flush();
+    tcsetattr(ed.fd, TCSADRAIN, &cooked);
+
+    if (ret == 0 && ed.line.len > 0) {
+        history_add(ed.line.s, ed.line.len);
+    }
+    return ret;
+}
+
+/**
+ * @brief Prepare the line editor on a terminal.
+ *
+ * @param fd The terminal (the standard input of the shell).
+ * @param wake_fd A file descriptor watched while waiting for a key, -1 if none.
+ * @param wake The function called when "wake_fd" is readable (the line is
+ *             drawn again afterwards, as it may have printed something).
+ */
+void edit_init(int fd, int wake_fd, void (*wake)()) {
+    ed.fd = fd;
+    ed.wake_fd = wake_fd;
+    ed.wake = wake;
+}
+
+/**
+ * @brief Read the input of the shell through the line editor (reader_set_input() callback).
+ *
+ * A line is edited in raw mode, with the prompt given by get_prompt(), then
+ * given to the reader with its '\n'. The keys are the ones of readline:
+ * Left/Right (Ctrl-B/Ctrl-F), Home/End (Ctrl-A/Ctrl-E), Backspace, Delete,
+ * Ctrl-K, Ctrl-U and Ctrl-W to delete, Ctrl-L to clear the screen, Up/Down
+ * (Ctrl-P/Ctrl-N) to browse the history, Ctrl-R to search it, Tab to
+ * complete a command or a file, Ctrl-C to drop the line and Ctrl-D on an
+ * empty line to end the input.
+ * The lines given are added to the history.
+ *
+ * @param buf The buffer receiving the input.
+ * @param size The size of the buffer.
+ * @return ssize_t The number of bytes given, 0 at the end of the input, or -1 on error.
+ */
+ssize_t edit_read(char *buf, size_t size) {
+    if (ed.given == ed.result.len) {
+        // The prompt may still be in the buffer of stdout
+        fflush(stdout);
+        int ret = edit_line();
+        if (ret == EDIT_EOF) {
+            return 0;
+        }
+        if (ret == EDIT_ERROR || edit_set(&ed.result, ed.line.s, ed.line.len) != 0
+            || edit_append(&ed.result, "\n", 1) != 0) {
+            return -1;
+        }
+        ed.given = 0;
+    }
+    size_t n = ed.result.len - ed.given < size ? ed.result.len - ed.given : size;
+    memcpy(buf, ed.result.s + ed.given, n);
+    ed.given += n;
+    return n;
+}
@@ -0,0 +1,35 @@
+#ifndef EDIT_CMD_H
+#define EDIT_CMD_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * @brief Prepare the line editor on a terminal.
+ *
+ * @param fd The terminal (the standard input of the shell).
+ * @param wake_fd A file descriptor watched while waiting for a key, -1 if none.
+ * @param wake The function called when "wake_fd" is readable (the line is
+ *             drawn again afterwards, as it may have printed something).
+ */
+void edit_init(int fd, int wake_fd, void (*wake)());
+
+/**
+ * @brief Read the input of the shell through the line editor (reader_set_input() callback).
+ *
+ * A line is edited in raw mode, with the prompt given by get_prompt(), then
+ * given to the reader with its '\n'. The keys are the ones of readline:
+ * Left/Right (Ctrl-B/Ctrl-F), Home/End (Ctrl-A/Ctrl-E), Backspace, Delete,
+ * Ctrl-K, Ctrl-U and Ctrl-W to delete, Ctrl-L to clear the screen, Up/Down
+ * (Ctrl-P/Ctrl-N) to browse the history, Ctrl-R to search it, Tab to
+ * complete a command or a file, Ctrl-C to drop the line and Ctrl-D on an
+ * empty line to end the input.
+ * The lines given are added to the history.
+ *
+ * @param buf The buffer receiving the input.
+ * @param size The size of the buffer.
+ * @return ssize_t The number of bytes given, 0 at the end of the input, or -1 on error.
+ */
+ssize_t edit_read(char *buf, size_t size);
+
+#endif /* EDIT_CMD_H */
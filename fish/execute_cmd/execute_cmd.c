@@ -10,76 +10,21 @@
 #include "cmdline.h"
 #include "util.h"
 #include "intern_cmd/intern_cmd.h"
+#include "hash_cmd/hash_cmd.h"
 #include "pipe_cmd/pipe_cmd.h"
+#include "spawn_cmd/spawn_cmd.h"
+#include "redirect_cmd/redirect_cmd.h"
+#include "job_cmd/job_cmd.h"
+#include "var_cmd/var_cmd.h"
 
 
-/**
- * @brief Remove terminated background processes from the array.
- *
- * This function checks the background processes array and removes any processes
- * that have terminated.
- */
-void remove_terminated_bg_process() {
-    size_t i = 0;
-    while (i < MAX_CMDS) {
-        if (bg_processes[i] == -1) {
-            remove_element(bg_processes, MAX_CMDS, i);
-            bg_index--;
-        } else {
-            i++;
-        }
-    }
-}
-
-/**
- * @brief Remove a foreground process from the process list.
- *
- * This function searches for a given process ID in the list of foreground processes
- * and removes it if found. It shifts the remaining process IDs in the list to
- * fill the gap left by the removed process and decrements the foreground process index.
- *
- * @param pid_to_remove The process ID of the foreground process to remove.
- *
- */
-void remove_fg_process(pid_t pid_to_remove) {
-    for (size_t i = 0; i < MAX_CMDS; ++i) {
-        if (fg_processes[i] == pid_to_remove) {
-            remove_element(fg_processes, MAX_CMDS, i);
-            fg_index--;
-        }
-    }
-}
-
-
-/**
- * @brief Signal handler for SIGCHLD.
- *
- * This function handles the SIGCHLD signal, which indicates that a child process
- * has terminated. It cleans up the terminated background processes.
- *
- * @param signal The signal number.
- */
-void signal_handler(int signal) {
-    if (signal == SIGCHLD) {
-        int status;
-        int pid_wait;
-
-        // Clean up zombie processes
-        for (size_t i = 0; i < bg_index; ++i){
-            if (bg_processes[i] >= 1 && (pid_wait = waitpid(bg_processes[i], &status, WNOHANG)) > 0 ) {
-                print_process_status(pid_wait, status, 1);
-                bg_processes[i] = -1;
-            }
-        }
-        remove_terminated_bg_process();
-    }
-}
-
 /**
  * @brief Execute a command either in the foreground or background, with or without pipes.
  *
  * This function handles the execution of internal commands like `cd` and `exit`, as well as 
- * external commands, both with and without pipes. It supports running commands in the 
+ * external commands, both with and without pipes. An internal command alone on its line
+ * runs in the shell itself, without any fork, unless it is in the background: then it
+ * gets a job and a child process like an external command. It supports running commands in the 
  * background or foreground, and handles input redirection for background processes.
  * If the command line contains multiple commands separated by pipes, it delegates to
  * functions designed to handle one or multiple pipes.
@@ -99,20 +44,37 @@ void signal_handler(int signal) {
  * @endcode
  */
 int execute_command(char *cmd, char **args, int bg, struct line *li) {
-    // Check if the command is a cd or exit command
-    if (strcmp(cmd, "cd") == 0) {
-        int ret = execute_command_intern_cd(li->cmds[0].args);
-        if (ret != 0) {
-            return 1;
+    // Internal commands run in the shell itself, without any process
+    // (cmd is NULL for a stage made of assignments only); in the background,
+    // they get a job like any command
+    const struct builtin *builtin = cmd != NULL ? builtin_lookup(cmd) : NULL;
+    if (builtin != NULL && li->n_cmds == 1 && !li->background && !builtin_needs_child(builtin, li)) {
+        // The redirections are applied to the shell and undone after the command
+        struct redirect_saved saved;
+        if (redirect_apply(&li->cmds[0], &saved) != 0) {
+            shell_status = 1;
+            return 0;
         }
-    } else if (strcmp(cmd, "exit") == 0) {
-        int ret = execute_command_intern_exit(li, &li->cmds[0]);
-        if (ret != 0) {
+        // The assignments before the command only apply to the command
+        if (var_push_assigns(&li->cmds[0]) != 0) {
+            redirect_restore(&saved);
             return 1;
         }
+        // A failure is reported by the command itself, the shell keeps running
+        // ('time' measures the shell itself: there is no process)
+        struct job_self self;
+        if (li->time) {
+            job_self_start(&self);
+        }
+        shell_status = execute_command_intern(li, &li->cmds[0]);
+        if (li->time) {
+            job_self_report(&self);
+        }
+        var_pop_scope();
+        redirect_restore(&saved);
+        return 0;
     }
 
-
     // Handle pipes
     if (li->n_cmds > 1) {
         /* function for only one pipe */
@@ -124,62 +86,39 @@ int execute_command(char *cmd, char **args, int bg, struct line *li) {
 
     // Execute external command without pipes
     } else {
-
-        pid_t pid = fork();
-        
-        if (pid == -1) {
-            perror("fork");
+        int job = job_create(li);
+        if (job == -1) {
             return 1;
         }
 
-        if (pid == 0) { // Child processes
-            if (bg) {
-                // Redirect standard input to /dev/null for background processes
-                if (!is_input_redirected()) {
-                    if (redirect_input_to_dev_null() != 0) {
-                        return 1;
-                    }
-                }
-            } else {
-                // Reset SIGINT handler to default for foreground commands
-                struct sigaction default_sigint;
-                sigemptyset(&default_sigint.sa_mask);
-                default_sigint.sa_flags = SA_RESTART;
-                default_sigint.sa_handler = SIG_DFL;
-                if (sigaction(SIGINT, &default_sigint, NULL) == -1) {
-                    perror("sigaction");
-                    return 1;
-                }
-            }
-        
-            // Execute the command
-            execvp(cmd, args);
-            char error_message[256];
-            snprintf(error_message, 256, "Exec error: %s", cmd);
-            perror(error_message);
-            return 1;
+        struct spawn_req req;
+        struct intern_stage stage = { li, &li->cmds[0] };
+        spawn_req_init(&req, args, bg);
+        req.pgroup = job_pgid(job);
+        if (builtin != NULL) {
+            // Background internal command: it runs in a child process
+            req.fn = run_intern_stage;
+            req.ctx = &stage;
+        }
+        // A redirection that fails is reported with status 1, the command is not run
+        bool redirected = redirect_add_actions(&req, li, 0) == 0;
+
+        // The assignments before the command are only given to its process
+        pid_t pid = -1;
+        if (redirected && var_push_assigns(&li->cmds[0]) == 0) {
+            pid = spawn_process(&req);
+            var_pop_scope();
+        }
+        spawn_req_reset(&req);
+        // If the process could not be launched, the error has already been printed
+        if (pid != -1) {
+            job_add_process(job, pid);
         } else {
-            if (bg) {
-                // Add background process to the list
-                bg_processes[bg_index++] = pid;
-            } else {
-                // Add foreground process to the list
-                fg_processes[fg_index++] = pid;
-
-                // Wait for the foreground process to complete
-                while (fg_index > 0) {
-                    int status;
-                    pid_t res = wait(&status);
-                    if (res == -1) {
-                        perror("wait");
-                        return 1;
-                    } else {
-                        print_process_status(res, status, bg);
-                        remove_fg_process(res);
-                    }
-                }
-            }
+            job_add_done(job, redirected ? 127 : 1);
         }
+
+        // Wait for the foreground process to complete
+        shell_status = job_run(job);
     }
     return 0;
 }
@@ -32,21 +32,165 @@
 #include <string.h>
 #include <libgen.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
 
 #include "cmdline.h"
 #include "util.h"
-#include "redirect_cmd/redirect_cmd.h"
 #include "pipe_cmd/pipe_cmd.h"
 #include "execute_cmd/execute_cmd.h"
-
-#define BUFLEN 512
+#include "read_cmd/read_cmd.h"
+#include "job_cmd/job_cmd.h"
+#include "var_cmd/var_cmd.h"
+#include "cache_cmd/cache_cmd.h"
+#include "prog_cmd/prog_cmd.h"
+#include "prompt_cmd/prompt_cmd.h"
+#include "history_cmd/history_cmd.h"
+#include "complete_cmd/complete_cmd.h"
+#include "edit_cmd/edit_cmd.h"
+#include "spawn_cmd/spawn_cmd.h"
 
 #define YES_NO(i) ((i) ? "Y" : "N")
 
+static struct reader *stdin_reader = NULL; // reader of the commands, when they come from stdin
+
+
+/**
+ * @brief Print the number of lines read and the reading rate to stderr.
+ *
+ * @param lines The number of lines read.
+ * @param start The time at which the shell started reading.
+ */
+static void print_line_stats(unsigned long lines, const struct timespec *start) {
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double elapsed = (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+  fprintf(stderr, "fish: %lu lines in %.3f s (%.0f lines/s)\n", lines, elapsed, elapsed > 0 ? lines / elapsed : 0.0);
+}
+
+/**
+ * @brief Move the standard input back to the end of the line being run.
+ *
+ * Called before a command that may read the standard input of the shell is
+ * started: with 'fish < script', it reads the script after the current line, like in sh.
+ */
+static void sync_stdin() {
+  reader_sync(stdin_reader);
+}
 
-int main() {
+/**
+ * @brief Open the history file: $HISTFILE, or ~/.fish_history by default.
+ *
+ * Without $HISTFILE and $HOME, the history only lasts for the session.
+ * A file that cannot be opened is reported, and the shell goes on without it.
+ */
+static void history_open() {
+  const char *path = var_get("HISTFILE");
+  char buf[PATH_MAX];
+  if (path == NULL) {
+    const char *home = var_get("HOME");
+    if (home != NULL && snprintf(buf, sizeof(buf), "%s/.fish_history", home) < (int)sizeof(buf)) {
+      path = buf;
+    }
+  }
+  history_init(path);
+}
+
+/**
+ * @brief Read the bodies of the here-documents of a parsed line.
+ *
+ * The lines following the command line are read up to the end word of each
+ * here-document, in the order of the line. Like sh, the end of the input
+ * also ends a here-document, with a warning.
+ *
+ * @param r The reader of the input.
+ * @param li The parsed line.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+static int read_heredocs(struct reader *r, struct line *li) {
+  char *body = NULL;
+  size_t cap = 0;
+  int err = 0;
+
+  for (struct line *seg = li; seg != NULL && !err; seg = seg->next) {
+    for (size_t k = 0; k < seg->n_cmds && !err; ++k) {
+      for (size_t j = 0; j < seg->cmds[k].n_redirs && !err; ++j) {
+        struct redir *redir = &seg->cmds[k].redirs[j];
+        if (!redir->pending) {
+          continue;
+        }
+        size_t len = 0;
+        size_t end_len = strlen(redir->target);
+        for (;;) {
+          if (shell_interactive) {
+            set_prompt("> ");
+            update_prompt();
+          }
+          char *buf = reader_next_line(r);
+          if (buf == NULL) {
+            fprintf(stderr, "fish: here-document ended by end of file (wanted '%s')\n", redir->target);
+            break;
+          }
+          // The end word is the whole line, with or without its "\n" (the reader
+          // adds one to a last line without it, the comparison does not rely on it)
+          size_t n = strlen(buf);
+          size_t word_len = n > 0 && buf[n - 1] == '\n' ? n - 1 : n;
+          if (word_len == end_len && strncmp(buf, redir->target, end_len) == 0) {
+            break;
+          }
+          if (len + n > cap) {
+            cap = 2 * (len + n);
+            char *grown = realloc(body, cap);
+            if (grown == NULL) {
+              perror("realloc");
+              err = 1;
+              break;
+            }
+            body = grown;
+          }
+          memcpy(body + len, buf, n);
+          len += n;
+        }
+        if (!err && line_set_heredoc(li, redir, len > 0 ? body : "", len) != 0) {
+          err = 1;
+        }
+      }
+    }
+  }
+  free(body);
+  return err;
+}
+
+
+int main(int argc, char *argv[]) {
   struct line li;
-  char buf[BUFLEN];
+  struct reader reader;
+  struct prog prog; // block being read (if, while, for)
+  bool stats = false;
+
+  // Usage: fish [-s] [script]
+  //   -s prints the number of lines read and the lines per second at the end
+  int opt;
+  while ((opt = getopt(argc, argv, "s")) != -1) {
+    if (opt != 's') {
+      fprintf(stderr, "Usage: %s [-s] [script]\n", argv[0]);
+      return 1;
+    }
+    stats = true;
+  }
+
+  // Commands are read from the script if one is given, from stdin otherwise
+  int input_fd = STDIN_FILENO;
+  if (optind < argc) {
+    input_fd = open(argv[optind], O_RDONLY | O_CLOEXEC);
+    if (input_fd == -1) {
+      perror(argv[optind]);
+      return 1;
+    }
+  }
+  // Without a terminal, fish runs in batch mode: no prompt and no job report
+  shell_interactive = input_fd == STDIN_FILENO && isatty(STDIN_FILENO);
 
   // Install signal handler for SIGINT
   struct sigaction sa;
@@ -58,76 +202,111 @@ int main() {
     return 1;
   }
 
-  // Install signal handler for SIGCHLD
-  struct sigaction sigchld_action;
-  sigemptyset(&sigchld_action.sa_mask);
-  sigchld_action.sa_handler = signal_handler;
-  sigchld_action.sa_flags = SA_RESTART;
-  if (sigaction(SIGCHLD, &sigchld_action, NULL) == -1) {
-    perror("sigaction");
+  // Install signal handler for SIGCHLD (the children are reaped in the main loop)
+  if (job_init() != 0) {
+    return 1;
+  }
+
+  // The variables of the shell start with its environment
+  if (var_init() != 0) {
+    return 1;
+  }
+
+  // The slow parts of the prompt (git branch) and the commands to complete are read by threads
+  if (shell_interactive && (prompt_init() != 0 || complete_init() != 0)) {
     return 1;
   }
 
   line_init(&li);
+  prog_init(&prog);
+  if (reader_init(&reader, input_fd) != 0) {
+    return 1;
+  }
+  // Terminated background jobs are reported while the shell waits for a line
+  reader_set_wake(&reader, job_signal_fd(), job_reap);
+  if (input_fd == STDIN_FILENO) {
+    stdin_reader = &reader;
+    spawn_set_input_sync(sync_stdin);
+  }
+  if (shell_interactive) {
+    // The lines typed are edited, and kept in the history file
+    history_open();
+    edit_init(STDIN_FILENO, job_signal_fd(), job_reap);
+    reader_set_input(&reader, edit_read);
+  }
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
 
   for (;;) {
-    update_prompt();
-    fgets(buf, BUFLEN, stdin);
+    job_reap();
+    if (shell_interactive && prog_pending(&prog)) {
+      // Continuation of a block
+      set_prompt("> ");
+      update_prompt();
+    } else if (shell_interactive) {
+      prompt_refresh();
+      update_prompt();
+    }
+    char *buf = reader_next_line(&reader);
+    if (buf == NULL) {
+      // End of the input (or Ctrl-D)
+      if (shell_interactive) {
+        printf("\n");
+      }
+      if (prog_pending(&prog)) {
+        fprintf(stderr, "fish: missing 'end'\n");
+        prog_reset(&prog);
+        shell_status = 2;
+      }
+      break;
+    }
 
-    int err = line_parse(&li, buf);
+    // A line already seen is not parsed again
+    int err = cache_parse(&li, buf);
     if (err) { 
-      // The command line entered by the user isn't valid
+      // The command line entered by the user isn't valid (and so is the block containing it)
+      shell_status = 2;
+      prog_reset(&prog);
       line_reset(&li);
       continue;
     }
 
-
-    // Creating a copy of the file descriptor (useful for redirects from question 5)
-    int saved_stdin = dup(STDIN_FILENO);
-    int saved_stdout = dup(STDOUT_FILENO);
-    int saved_stderr = dup(STDERR_FILENO);
-
-    if (saved_stdin == -1 || saved_stdout == -1 || saved_stderr == -1) {
-        perror("dup");
-        exit(EXIT_FAILURE);
+    // The bodies of the here-documents follow the line
+    if (read_heredocs(&reader, &li) != 0) {
+      shell_status = 2;
+      prog_reset(&prog);
+      line_reset(&li);
+      continue;
     }
 
-
-    // Check if there are commands to execute
-    if (li.n_cmds > 0) {
-
-      // Check if there is an input redirection
-      if (li.file_input && redirect_input(li.file_input) != 0) {
-        return 1;
-      }
-      // Checks if there is output redirection in TRUNC mode
-      if (li.file_output && !li.file_output_append && redirect_output_trunc(li.file_output) != 0) {
-        return 1;
-      }
-      // Checks if there is output redirection in APPEND mode
-      if (li.file_output && li.file_output_append && redirect_output_append(li.file_output) != 0) {
-        return 1;
-      }
-
-      // Execute the command
-      int result = execute_command(li.cmds[0].args[0], li.cmds[0].args, li.background, &li);
-      if (result != 0) {
-        return 1;
+    // The lines of a block are compiled, the block runs once complete
+    int state = prog_feed(&prog, &li);
+    if (state == -1 || state == PROG_MORE) {
+      if (state == -1) {
+        shell_status = 2;
       }
+      line_reset(&li);
+      continue;
     }
-    
 
-    // Restore and close standard file descriptors
-    if (dup2(saved_stdin, STDIN_FILENO) == -1 || dup2(saved_stdout, STDOUT_FILENO) == -1 || dup2(saved_stderr, STDERR_FILENO) == -1) {
-      perror("dup2");
-      return 1;
-    }
-    if (close(saved_stdin) == -1 || close(saved_stdout) == -1 || close(saved_stderr) == -1) {
-      perror("close");
+
+    // Execute the line or the block (the redirections are applied in the child processes only)
+    int result = state == PROG_READY ? prog_run(&prog) : prog_run_line(&li);
+    if (result != 0) {
       return 1;
     }
 
     line_reset(&li);
   }
-  return 0;
+
+  if (stats) {
+    print_line_stats(reader.lines, &start);
+  }
+  line_destroy(&li);
+  reader_reset(&reader);
+  if (input_fd != STDIN_FILENO) {
+    close(input_fd);
+  }
+  // Like sh, the status of the shell is the status of the last command line
+  return shell_status;
 }
@@ -0,0 +1,214 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define N_ROUNDS 3           // each script runs N_ROUNDS times, the best time is kept
+#define N_LAUNCHES 1000      // commands of the launch rate benchmark
+#define N_PIPE_PROCS 512     // processes started for each pipeline length
+#define MAX_STAGES 64
+#define N_THROUGHPUT_CATS 8  // cat processes of the throughput chain
+#define THROUGHPUT_BYTES (256L << 20)
+#define N_PARSE_LINES 50000  // lines of the parse rate benchmark
+#define N_JOBS 500           // jobs of the background benchmark
+
+
+/**
+ * Get the current time in seconds
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ *
+ * @return the value of the monotonic clock in seconds
+ */
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * A script given to fish on its standard input
+ */
+struct script {
+  char *text;
+  size_t len;
+  size_t cap;
+};
+
+/**
+ * Append a formatted line to a script
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ *
+ * @param s pointer on the script
+ * @param format format of the text to append, like printf()
+ */
+static void script_add(struct script *s, const char *format, ...) __attribute__((format(printf, 2, 3)));
+static void script_add(struct script *s, const char *format, ...) {
+  va_list ap;
+  for (;;) {
+    va_start(ap, format);
+    int n = vsnprintf(s->text + s->len, s->cap - s->len, format, ap);
+    va_end(ap);
+    if (n < 0) {
+      perror("vsnprintf");
+      exit(1);
+    }
+    if (s->len + n < s->cap) {
+      s->len += n;
+      return;
+    }
+    s->cap = s->cap ? 2 * (s->len + n) : 4096;
+    s->text = realloc(s->text, s->cap);
+    if (!s->text) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+}
+
+/**
+ * Run fish on a script, without terminal: its standard input is the script, its output is dropped
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ * The script is written in a memory file, so that fish reads it at its own pace. The best time of
+ * N_ROUNDS runs is returned.
+ *
+ * @param fish path of the shell to measure
+ * @param s pointer on the script
+ *
+ * @return the elapsed time in seconds
+ */
+static double run_fish(const char *fish, const struct script *s) {
+  double best = -1;
+  for (int r = 0; r < N_ROUNDS; ++r) {
+    int in = memfd_create("fish-bench", 0);
+    if (in == -1 || write(in, s->text, s->len) != (ssize_t)s->len || lseek(in, 0, SEEK_SET) == -1) {
+      perror("memfd");
+      exit(1);
+    }
+    int out = open("/dev/null", O_WRONLY);
+
+    double start = now();
+    pid_t pid = fork();
+    if (pid == -1) {
+      perror("fork");
+      exit(1);
+    }
+    if (pid == 0) {
+      dup2(in, STDIN_FILENO);
+      dup2(out, STDOUT_FILENO);
+      execl(fish, fish, (char *)NULL);
+      perror(fish);
+      _exit(127);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    double elapsed = now() - start;
+    close(in);
+    close(out);
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) == 127) {
+      fprintf(stderr, "fish_bench: %s failed on its script\n", fish);
+      exit(1);
+    }
+    if (best < 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  return best;
+}
+
+/**
+ * Build a pipeline of "n" times the same command
+ *
+ * This function is static : it means that it is a local function, accessible only in this source file.
+ *
+ * @param s pointer on the script receiving the line
+ * @param cmd the command of each stage
+ * @param n number of stages
+ */
+static void add_pipeline(struct script *s, const char *cmd, int n) {
+  for (int k = 0; k < n; ++k) {
+    script_add(s, k == 0 ? "%s" : " | %s", cmd);
+  }
+}
+
+
+int main(int argc, char *argv[]) {
+  // Usage: fish_bench [fish]
+  const char *fish = argc > 1 ? argv[1] : "./fish";
+  struct script s = { NULL, 0, 0 };
+
+  // Start and exit of the shell, taken out of the other timings
+  script_add(&s, "\n");
+  double startup = run_fish(fish, &s);
+
+  printf("{\n");
+  printf("  \"fish\": \"%s\",\n", fish);
+  printf("  \"rounds\": %d,\n", N_ROUNDS);
+  printf("  \"startup_ms\": %.3f,\n", startup * 1e3);
+
+  // Launch rate: external commands, one per line
+  s.len = 0;
+  for (int k = 0; k < N_LAUNCHES; ++k) {
+    script_add(&s, "/bin/true\n");
+  }
+  double launch = run_fish(fish, &s) - startup;
+  printf("  \"launch\": { \"commands\": %d, \"per_second\": %.0f, \"us_per_command\": %.1f },\n",
+         N_LAUNCHES, N_LAUNCHES / launch, launch / N_LAUNCHES * 1e6);
+
+  // Pipeline setup latency: the same number of processes for each length
+  printf("  \"pipeline_setup\": [");
+  for (int stages = 2; stages <= MAX_STAGES; stages *= 2) {
+    int n = N_PIPE_PROCS / stages;
+    s.len = 0;
+    for (int k = 0; k < n; ++k) {
+      add_pipeline(&s, "/bin/true", stages);
+      script_add(&s, "\n");
+    }
+    double t = run_fish(fish, &s) - startup;
+    printf("%s\n    { \"stages\": %d, \"pipelines\": %d, \"us_per_pipeline\": %.1f, \"us_per_stage\": %.1f }",
+           stages == 2 ? "" : ",", stages, n, t / n * 1e6, t / n / stages * 1e6);
+  }
+  printf("\n  ],\n");
+
+  // Throughput of a chain of cat
+  s.len = 0;
+  script_add(&s, "head -c %ld /dev/zero | ", THROUGHPUT_BYTES);
+  add_pipeline(&s, "cat", N_THROUGHPUT_CATS);
+  script_add(&s, " > /dev/null\n");
+  double t = run_fish(fish, &s) - startup;
+  printf("  \"throughput\": { \"cats\": %d, \"bytes\": %ld, \"mb_per_second\": %.1f },\n",
+         N_THROUGHPUT_CATS, THROUGHPUT_BYTES, THROUGHPUT_BYTES / t / 1e6);
+
+  // Parse rate: distinct lines (no hit in the cache of parsed lines), run by the shell
+  // without any process ('true' has no effect and no input/output, even in a pipeline)
+  s.len = 0;
+  for (int k = 0; k < N_PARSE_LINES; ++k) {
+    script_add(&s, "V=%d true --line-number \"pattern number %d\" /var/log/file-%d.log | true -k2 -n %d\n",
+               k, k, k, k);
+  }
+  t = run_fish(fish, &s) - startup;
+  printf("  \"parse\": { \"lines\": %d, \"lines_per_second\": %.0f },\n", N_PARSE_LINES, N_PARSE_LINES / t);
+
+  // Background jobs: launched, then reaped by the shell (the overhead is compared to
+  // the same commands in the foreground)
+  s.len = 0;
+  for (int k = 0; k < N_JOBS; ++k) {
+    script_add(&s, "/bin/true &\n");
+  }
+  script_add(&s, "wait\n");
+  double bg = run_fish(fish, &s) - startup;
+  printf("  \"background\": { \"jobs\": %d, \"us_per_job\": %.1f, \"reap_overhead_us\": %.1f }\n",
+         N_JOBS, bg / N_JOBS * 1e6, (bg / N_JOBS - launch / N_LAUNCHES) * 1e6);
+  printf("}\n");
+
+  free(s.text);
+  return 0;
+}
@@ -0,0 +1,541 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "glob_cmd.h"
+#include "util.h"
+
+#define GLOB_CACHE_DIRS 32        // directories remembered during one line
+#define GLOB_READ_SIZE (64 * 1024) // minimum free space given to getdents64
+
+/**
+ * @brief Kinds of the instructions of a compiled pattern.
+ */
+enum glob_kind {
+    GLOB_CHAR,  // one given char
+    GLOB_ANY,   // '?': any char
+    GLOB_STAR,  // '*': any sequence of chars
+    GLOB_CLASS, // '[...]': one char of a set
+};
+
+/**
+ * @brief One instruction of a compiled pattern.
+ */
+struct glob_op {
+    enum glob_kind kind;
+    unsigned char c;  // GLOB_CHAR only
+    uint64_t set[4];  // GLOB_CLASS only: bitmap of the 256 bytes
+};
+
+/**
+ * @brief A pattern for one component of a pathname, compiled once per word.
+ */
+struct glob_pattern {
+    struct glob_op *ops;
+    size_t n_ops;
+    bool meta;        // the pattern contains '*', '?' or a valid '[...]'
+    size_t min_len;   // minimum length of a matching name
+    const char *tail; // literal chars ending the pattern (after its last special op)
+    size_t tail_len;
+};
+
+/**
+ * @brief One directory listing, as returned by getdents64.
+ */
+struct glob_dir {
+    const char *path; // "" for the current directory, otherwise ends with '/'
+    char *buf;        // the linux_dirent64 records (NULL if the directory can't be read)
+    size_t size;
+};
+
+/**
+ * @brief Growable array of strings.
+ */
+struct glob_vec {
+    char **v;
+    size_t len;
+    size_t cap;
+};
+
+/**
+ * @brief State of the expansion of one line.
+ */
+struct glob_ctx {
+    struct line *li;
+    struct glob_dir dirs[GLOB_CACHE_DIRS]; // directories already read during the line
+    size_t n_dirs;
+    size_t next_dir; // entry replaced when the cache is full
+};
+
+// Buffer receiving the records of getdents64, kept from one line to the next
+static char *read_buf;
+static size_t read_cap;
+
+
+/**
+ * @brief Append a string to an array.
+ *
+ * @param vec The array.
+ * @param str The string.
+ * @return int Returns 0 on success, or -1 on failure.
+ */
+static int glob_push(struct glob_vec *vec, char *str) {
+    if (vec->len == vec->cap) {
+        size_t cap = vec->cap ? 2 * vec->cap : 64;
+        char **v = realloc(vec->v, cap * sizeof(char *));
+        if (v == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        vec->v = v;
+        vec->cap = cap;
+    }
+    vec->v[vec->len++] = str;
+    return 0;
+}
+
+/**
+ * @brief Compile one component of a pattern.
+ *
+ * A '[' without a matching ']' is an ordinary char. In a class, a leading '!' or
+ * '^' negates the set, a leading ']' is an ordinary char and 'a-z' is a range.
+ *
+ * @param li The line owning the instructions.
+ * @param comp The component ('\0' terminated, without '/').
+ * @param pat The compiled pattern.
+ * @return int Returns 0 on success, or -1 on failure.
+ */
+static int glob_compile(struct line *li, const char *comp, struct glob_pattern *pat) {
+    size_t len = strlen(comp);
+    memset(pat, 0, sizeof(struct glob_pattern));
+    pat->ops = line_alloc(li, (len + 1) * sizeof(struct glob_op));
+    if (pat->ops == NULL) {
+        return -1;
+    }
+
+    size_t tail_start = 0; // position in comp of the first char of the tail
+    for (size_t i = 0; i < len; ++i) {
+        struct glob_op *op = &pat->ops[pat->n_ops];
+        memset(op, 0, sizeof(struct glob_op));
+        op->kind = GLOB_CHAR;
+        op->c = comp[i];
+
+        if (comp[i] == '*') {
+            // "**" is the same as "*"
+            if (pat->n_ops == 0 || pat->ops[pat->n_ops - 1].kind != GLOB_STAR) {
+                op->kind = GLOB_STAR;
+                pat->n_ops++;
+            }
+            pat->meta = true;
+            tail_start = i + 1;
+            continue;
+        }
+        if (comp[i] == '?') {
+            op->kind = GLOB_ANY;
+            pat->meta = true;
+            tail_start = i + 1;
+        } else if (comp[i] == '[') {
+            size_t j = i + 1;
+            bool negate = comp[j] == '!' || comp[j] == '^';
+            if (negate) {
+                ++j;
+            }
+            size_t first = j;
+            while (comp[j] != '\0' && (comp[j] != ']' || j == first)) {
+                unsigned char lo = comp[j];
+                unsigned char hi = lo;
+                if (comp[j + 1] == '-' && comp[j + 2] != ']' && comp[j + 2] != '\0') {
+                    hi = comp[j + 2];
+                    j += 2;
+                }
+                for (unsigned c = lo; c <= hi; ++c) {
+                    op->set[c >> 6] |= 1ULL << (c & 63);
+                }
+                ++j;
+            }
+            if (comp[j] == ']') {
+                if (negate) {
+                    for (int k = 0; k < 4; ++k) {
+                        op->set[k] = ~op->set[k];
+                    }
+                }
+                op->kind = GLOB_CLASS;
+                pat->meta = true;
+                i = j;
+                tail_start = i + 1;
+            }
+            // Otherwise the '[' is an ordinary char
+        }
+        pat->n_ops++;
+        pat->min_len++;
+    }
+
+    // Only valid if the tail has no '[' kept as an ordinary char: it is then a plain string
+    if (memchr(comp + tail_start, '[', len - tail_start) == NULL) {
+        pat->tail = comp + tail_start;
+        pat->tail_len = len - tail_start;
+    }
+    return 0;
+}
+
+/**
+ * @brief Check if a char matches an instruction (other than GLOB_STAR).
+ *
+ * @param op The instruction.
+ * @param c The char.
+ * @return bool Returns true if the char matches.
+ */
+static bool glob_match_op(const struct glob_op *op, unsigned char c) {
+    switch (op->kind) {
+    case GLOB_CHAR:
+        return op->c == c;
+    case GLOB_ANY:
+        return true;
+    case GLOB_CLASS:
+        return (op->set[c >> 6] >> (c & 63)) & 1;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Check if a name matches a compiled pattern.
+ *
+ * The names too short or not ending with the tail of the pattern are rejected
+ * first. The '*' are matched greedily, backtracking to the last '*' only: the
+ * match takes O(length of the name * number of instructions) in the worst case.
+ *
+ * @param pat The pattern.
+ * @param name The name.
+ * @return bool Returns true if the name matches.
+ */
+static bool glob_match(const struct glob_pattern *pat, const char *name) {
+    size_t len = strlen(name);
+    if (len < pat->min_len) {
+        return false;
+    }
+    if (pat->tail != NULL && memcmp(name + len - pat->tail_len, pat->tail, pat->tail_len) != 0) {
+        return false;
+    }
+
+    const struct glob_op *ops = pat->ops;
+    size_t n = pat->n_ops;
+    size_t p = 0;
+    const char *s = name;
+    size_t star_p = 0;          // instruction following the last '*'
+    const char *star_s = NULL;  // first char not yet given to the last '*'
+    while (*s != '\0') {
+        if (p < n && ops[p].kind == GLOB_STAR) {
+            star_p = ++p;
+            star_s = s;
+        } else if (p < n && glob_match_op(&ops[p], *s)) {
+            ++p;
+            ++s;
+        } else if (star_s != NULL) {
+            // Give one more char to the last '*'
+            p = star_p;
+            s = ++star_s;
+        } else {
+            return false;
+        }
+    }
+    while (p < n && ops[p].kind == GLOB_STAR) {
+        ++p;
+    }
+    return p == n;
+}
+
+/**
+ * @brief Read all the records of a directory with getdents64.
+ *
+ * @param ctx The expansion state.
+ * @param path The path of the directory ("" for the current directory).
+ * @param dir The listing, in the arena of the line (buf is NULL if the directory can't be read).
+ * @return int Returns 0 on success (even if the directory can't be read), or -1 on failure.
+ */
+static int glob_read_dir(struct glob_ctx *ctx, const char *path, struct glob_dir *dir) {
+    dir->path = path;
+    dir->buf = NULL;
+    dir->size = 0;
+
+    int fd = open(path[0] != '\0' ? path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        return 0;
+    }
+    size_t used = 0;
+    for (;;) {
+        if (read_cap - used < GLOB_READ_SIZE) {
+            size_t cap = read_cap ? 2 * read_cap : 4 * GLOB_READ_SIZE;
+            char *buf = realloc(read_buf, cap);
+            if (buf == NULL) {
+                perror("realloc");
+                close(fd);
+                return -1;
+            }
+            read_buf = buf;
+            read_cap = cap;
+        }
+        long n = syscall(SYS_getdents64, fd, read_buf + used, read_cap - used);
+        if (n <= 0) {
+            break;
+        }
+        used += n;
+    }
+    close(fd);
+
+    // One copy in the arena: the matching names are used in place
+    dir->buf = line_alloc(ctx->li, used);
+    if (dir->buf == NULL) {
+        return -1;
+    }
+    memcpy(dir->buf, read_buf, used);
+    dir->size = used;
+    return 0;
+}
+
+/**
+ * @brief Get the listing of a directory, reading it only if it was not read during the line.
+ *
+ * @param ctx The expansion state.
+ * @param path The path of the directory ("" for the current directory).
+ * @return struct glob_dir* The listing, or NULL on failure.
+ */
+static struct glob_dir *glob_list(struct glob_ctx *ctx, const char *path) {
+    for (size_t i = 0; i < ctx->n_dirs; ++i) {
+        if (strcmp(ctx->dirs[i].path, path) == 0) {
+            return &ctx->dirs[i];
+        }
+    }
+    struct glob_dir *dir;
+    if (ctx->n_dirs < GLOB_CACHE_DIRS) {
+        dir = &ctx->dirs[ctx->n_dirs++];
+    } else {
+        dir = &ctx->dirs[ctx->next_dir];
+        ctx->next_dir = (ctx->next_dir + 1) % GLOB_CACHE_DIRS;
+    }
+    return glob_read_dir(ctx, path, dir) == 0 ? dir : NULL;
+}
+
+/**
+ * @brief Check if an entry of a directory is a directory (following the symbolic links).
+ *
+ * @param dir The directory.
+ * @param ent The entry.
+ * @return bool Returns true if the entry is a directory.
+ */
+static bool glob_is_dir(const struct glob_dir *dir, const struct dirent64 *ent) {
+    if (ent->d_type == DT_DIR) {
+        return true;
+    }
+    if (ent->d_type != DT_LNK && ent->d_type != DT_UNKNOWN) {
+        return false;
+    }
+    char path[PATH_MAX];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s%s", dir->path, ent->d_name);
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+/**
+ * @brief Concatenate a prefix, a name and an optional '/' in the arena of the line.
+ *
+ * @param li The line.
+ * @param prefix The prefix.
+ * @param name The name.
+ * @param slash A flag indicating if a '/' is appended.
+ * @return char* The new string, or NULL on failure.
+ */
+static char *glob_join(struct line *li, const char *prefix, const char *name, bool slash) {
+    size_t len_prefix = strlen(prefix);
+    size_t len_name = strlen(name);
+    char *path = line_alloc(li, len_prefix + len_name + 2);
+    if (path == NULL) {
+        return NULL;
+    }
+    memcpy(path, prefix, len_prefix);
+    memcpy(path + len_prefix, name, len_name);
+    path[len_prefix + len_name] = '/';
+    path[len_prefix + len_name + slash] = '\0';
+    return path;
+}
+
+/**
+ * @brief Match one component of a pattern in the directories of the prefixes.
+ *
+ * @param ctx The expansion state.
+ * @param pat The component.
+ * @param dot_ok A flag indicating if the names beginning with '.' can match.
+ * @param need_dir A flag indicating if only the directories match (a '/' is then appended).
+ * @param prefixes The directories to search ("" or ending with '/').
+ * @param matches The array receiving the matching paths.
+ * @return int Returns 0 on success, or -1 on failure.
+ */
+static int glob_component(struct glob_ctx *ctx, const struct glob_pattern *pat, bool dot_ok, bool need_dir,
+                          const struct glob_vec *prefixes, struct glob_vec *matches) {
+    for (size_t i = 0; i < prefixes->len; ++i) {
+        struct glob_dir *dir = glob_list(ctx, prefixes->v[i]);
+        if (dir == NULL) {
+            return -1;
+        }
+        for (size_t off = 0; off < dir->size; ) {
+            struct dirent64 *ent = (struct dirent64 *)(dir->buf + off);
+            off += ent->d_reclen;
+            const char *name = ent->d_name;
+            if ((name[0] == '.' && !dot_ok) || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+                continue;
+            }
+            if (!glob_match(pat, name) || (need_dir && !glob_is_dir(dir, ent))) {
+                continue;
+            }
+            // A name of the current directory is used in place, without any copy
+            char *path = dir->path[0] == '\0' && !need_dir ? ent->d_name : glob_join(ctx->li, dir->path, name, need_dir);
+            if (path == NULL || glob_push(matches, path) != 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Compare two strings for qsort().
+ */
+static int glob_cmp(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * @brief Expand one word.
+ *
+ * The word is split in components at each '/'. The components without special
+ * chars are appended to the paths found so far, the others are matched against
+ * the listings of the directories of these paths.
+ *
+ * @param ctx The expansion state.
+ * @param word The word.
+ * @param out The array receiving the sorted pathnames (or the word itself).
+ * @return int Returns 0 on success, or -1 on failure.
+ */
+static int glob_word(struct glob_ctx *ctx, char *word, struct glob_vec *out) {
+    char *copy = line_strndup(ctx->li, word, strlen(word));
+    if (copy == NULL) {
+        return -1;
+    }
+
+    // Split the copy in components, without the empty ones
+    size_t n_comps = 0;
+    char *comps[strlen(word) / 2 + 1];
+    for (char *save = NULL, *comp = strtok_r(copy, "/", &save); comp != NULL; comp = strtok_r(NULL, "/", &save)) {
+        comps[n_comps++] = comp;
+    }
+    bool trailing_slash = word[strlen(word) - 1] == '/';
+
+    struct glob_vec paths = { NULL, 0, 0 };
+    struct glob_vec next = { NULL, 0, 0 };
+    int err = glob_push(&paths, word[0] == '/' ? (char *)"/" : (char *)"");
+    bool globbed = false;
+    for (size_t i = 0; i < n_comps && !err && paths.len > 0; ++i) {
+        bool last = i == n_comps - 1;
+        bool need_dir = !last || trailing_slash;
+        struct glob_pattern pat;
+        if (glob_compile(ctx->li, comps[i], &pat) != 0) {
+            err = -1;
+            break;
+        }
+
+        next.len = 0;
+        if (pat.meta) {
+            err = glob_component(ctx, &pat, comps[i][0] == '.', need_dir, &paths, &next);
+            globbed = true;
+        } else {
+            for (size_t k = 0; k < paths.len && !err; ++k) {
+                char *path = glob_join(ctx->li, paths.v[k], comps[i], need_dir);
+                struct stat st;
+                // After a pattern, the last component must exist (the others are checked by the listings)
+                if (path != NULL && last && globbed && lstat(path, &st) != 0) {
+                    continue;
+                }
+                err = path == NULL || glob_push(&next, path) != 0 ? -1 : 0;
+            }
+        }
+        struct glob_vec tmp = paths;
+        paths = next;
+        next = tmp;
+    }
+
+    if (!err) {
+        if (!globbed) {
+            // No valid pattern (a '[' alone is an ordinary char)
+            err = glob_push(out, word);
+        } else if (paths.len == 0) {
+            // No match: the word is kept, or removed with nullglob
+            err = shell_nullglob ? 0 : glob_push(out, word);
+        } else {
+            size_t start = out->len;
+            for (size_t k = 0; k < paths.len && !err; ++k) {
+                err = glob_push(out, paths.v[k]);
+            }
+            qsort(out->v + start, out->len - start, sizeof(char *), glob_cmp);
+        }
+    }
+    free(paths.v);
+    free(next.v);
+    return err;
+}
+
+/**
+ * @brief Expand the patterns of a parsed line into the matching pathnames.
+ *
+ * The words of the commands containing '*', '?' or '[...]' outside of double
+ * quotes are replaced by the sorted list of the pathnames they match.
+ * A pattern matching nothing is left as is, or removed with 'set -o nullglob'.
+ * The names beginning with '.' are only matched by a pattern beginning with '.'.
+ * Each directory is read once per line, whatever the number of patterns
+ * listing it. There is no limit on the number of pathnames.
+ *
+ * @param li The parsed line (after var_expand_line()).
+ * @return int Returns 0 on success, or -1 on failure.
+ */
+int glob_expand_line(struct line *li) {
+    struct glob_ctx ctx = { .li = li };
+    struct glob_vec args = { NULL, 0, 0 };
+    int err = 0;
+
+    for (size_t i = 0; i < li->n_cmds && !err; ++i) {
+        struct cmd *cmd = &li->cmds[i];
+        // The args of a command are still in the argv pool, next to their flags
+        const bool *globs = li->argv_glob + (cmd->args - li->argv);
+        bool changed = false;
+        args.len = 0;
+        for (size_t k = 0; k < cmd->n_args && !err; ++k) {
+            if (globs[k] && strpbrk(cmd->args[k], "*?[") != NULL) {
+                err = glob_word(&ctx, cmd->args[k], &args);
+                changed = true;
+            } else {
+                err = glob_push(&args, cmd->args[k]);
+            }
+        }
+        if (err || !changed) {
+            continue;
+        }
+
+        char **new_args = line_alloc(li, (args.len + 1) * sizeof(char *));
+        if (new_args == NULL) {
+            err = -1;
+            break;
+        }
+        memcpy(new_args, args.v, args.len * sizeof(char *));
+        new_args[args.len] = NULL;
+        cmd->args = new_args;
+        cmd->n_args = args.len;
+    }
+    free(args.v);
+    return err;
+}
@@ -0,0 +1,21 @@
+#ifndef GLOB_CMD_H
+#define GLOB_CMD_H
+
+#include "cmdline.h"
+
+/**
+ * @brief Expand the patterns of a parsed line into the matching pathnames.
+ *
+ * The words of the commands containing '*', '?' or '[...]' outside of double
+ * quotes are replaced by the sorted list of the pathnames they match.
+ * A pattern matching nothing is left as is, or removed with 'set -o nullglob'.
+ * The names beginning with '.' are only matched by a pattern beginning with '.'.
+ * Each directory is read once per line, whatever the number of patterns
+ * listing it. There is no limit on the number of pathnames.
+ *
+ * @param li The parsed line (after var_expand_line()).
+ * @return int Returns 0 on success, or -1 on failure.
+ */
+int glob_expand_line(struct line *li);
+
+#endif /* GLOB_CMD_H */
@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "hash_cmd.h"
+#include "var_cmd/var_cmd.h"
+
+#define HASH_MIN_SIZE 64 // must be a power of 2
+
+/**
+ * @brief One remembered command.
+ */
+struct hash_entry {
+    char *name; // NULL if the slot is empty
+    char *path;
+    unsigned long hits;
+};
+
+/**
+ * @brief Open addressing hash table (linear probing) of remembered commands.
+ */
+static struct {
+    struct hash_entry *slots;
+    size_t size; // number of slots, a power of 2
+    size_t count;
+    char *path_env; // copy of $PATH when the table was filled
+} table;
+
+
+/**
+ * @brief FNV-1a hash of a string.
+ *
+ * @param str The string.
+ * @return uint64_t The hash.
+ */
+static uint64_t hash_string(const char *str) {
+    uint64_t h = 14695981039346656037ULL;
+    for (; *str; ++str) {
+        h ^= (unsigned char)*str;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/**
+ * @brief Find the slot of a name: the slot holding it, or the empty slot where it would go.
+ *
+ * @param name The name of the command.
+ * @return struct hash_entry* The slot.
+ */
+static struct hash_entry *hash_slot(const char *name) {
+    size_t mask = table.size - 1;
+    size_t i = hash_string(name) & mask;
+    while (table.slots[i].name != NULL && strcmp(table.slots[i].name, name) != 0) {
+        i = (i + 1) & mask;
+    }
+    return &table.slots[i];
+}
+
+/**
+ * @brief Double the size of the table.
+ *
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+static int hash_grow() {
+    struct hash_entry *old = table.slots;
+    size_t old_size = table.size;
+    size_t size = old_size ? 2 * old_size : HASH_MIN_SIZE;
+
+    struct hash_entry *slots = calloc(size, sizeof(struct hash_entry));
+    if (slots == NULL) {
+        perror("calloc");
+        return 1;
+    }
+    table.slots = slots;
+    table.size = size;
+    for (size_t i = 0; i < old_size; ++i) {
+        if (old[i].name != NULL) {
+            *hash_slot(old[i].name) = old[i];
+        }
+    }
+    free(old);
+    return 0;
+}
+
+/**
+ * @brief Check if a path is an executable regular file.
+ *
+ * @param path The path to test.
+ * @return int Returns 1 if the path can be executed, 0 otherwise.
+ */
+static int is_executable(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+}
+
+/**
+ * @brief Scan the $PATH directories for a command.
+ *
+ * @param name The name of the command.
+ * @param path_env The value of $PATH.
+ * @return char* The dynamically allocated path, or NULL if not found.
+ */
+static char *hash_search_path(const char *name, const char *path_env) {
+    size_t name_len = strlen(name);
+    const char *dir = path_env;
+    for (;;) {
+        const char *end = strchr(dir, ':');
+        size_t dir_len = end ? (size_t)(end - dir) : strlen(dir);
+
+        // An empty entry means the current directory
+        char *candidate = malloc(dir_len + name_len + 3);
+        if (candidate == NULL) {
+            perror("malloc");
+            return NULL;
+        }
+        if (dir_len == 0) {
+            memcpy(candidate, ".", 1);
+            dir_len = 1;
+        } else {
+            memcpy(candidate, dir, dir_len);
+        }
+        candidate[dir_len] = '/';
+        memcpy(candidate + dir_len + 1, name, name_len + 1);
+
+        if (is_executable(candidate)) {
+            return candidate;
+        }
+        free(candidate);
+
+        if (end == NULL) {
+            return NULL;
+        }
+        dir = end + 1;
+    }
+}
+
+/**
+ * @brief Empty the table if $PATH changed since it was filled.
+ *
+ * @param path_env The current value of $PATH.
+ */
+static void hash_check_path_env(const char *path_env) {
+    if (table.path_env != NULL && strcmp(table.path_env, path_env) == 0) {
+        return;
+    }
+    hash_clear();
+    table.path_env = strdup(path_env);
+}
+
+/**
+ * @brief Find the absolute path of a command.
+ *
+ * The $PATH directories are only scanned the first time a command is used:
+ * the result is remembered in a hash table (name -> path), like the 'hash'
+ * builtin of bash. The table is emptied when $PATH changes.
+ * A name containing a '/' is returned as is.
+ *
+ * @param name The name of the command.
+ * @return const char* The path of the command (owned by the table), or NULL if not found.
+ */
+const char *hash_lookup(const char *name) {
+    if (strchr(name, '/') != NULL) {
+        return name;
+    }
+    if (name[0] == '\0') {
+        return NULL;
+    }
+
+    const char *path_env = var_get("PATH");
+    if (path_env == NULL) {
+        path_env = "/usr/local/bin:/usr/bin:/bin";
+    }
+    hash_check_path_env(path_env);
+
+    // Keep the load factor under 1/2
+    if (2 * (table.count + 1) > table.size && hash_grow() != 0) {
+        return NULL;
+    }
+
+    struct hash_entry *entry = hash_slot(name);
+    if (entry->name != NULL) {
+        entry->hits++;
+        return entry->path;
+    }
+
+    char *path = hash_search_path(name, path_env);
+    if (path == NULL) {
+        return NULL;
+    }
+    char *key = strdup(name);
+    if (key == NULL) {
+        perror("strdup");
+        free(path);
+        return NULL;
+    }
+    entry->name = key;
+    entry->path = path;
+    entry->hits = 1;
+    table.count++;
+    return path;
+}
+
+/**
+ * @brief Forget the path remembered for a command.
+ *
+ * Called when a remembered path does not exist anymore.
+ *
+ * @param name The name of the command.
+ */
+void hash_forget(const char *name) {
+    if (table.size == 0) {
+        return;
+    }
+    struct hash_entry *entry = hash_slot(name);
+    if (entry->name == NULL) {
+        return;
+    }
+    free(entry->name);
+    free(entry->path);
+    entry->name = NULL;
+    table.count--;
+
+    // Backward shift deletion: move back the entries of the same probe sequence
+    size_t mask = table.size - 1;
+    size_t hole = entry - table.slots;
+    size_t i = (hole + 1) & mask;
+    while (table.slots[i].name != NULL) {
+        size_t home = hash_string(table.slots[i].name) & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            table.slots[hole] = table.slots[i];
+            table.slots[i].name = NULL;
+            hole = i;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+/**
+ * @brief Forget all the remembered paths.
+ */
+void hash_clear() {
+    for (size_t i = 0; i < table.size; ++i) {
+        if (table.slots[i].name != NULL) {
+            free(table.slots[i].name);
+            free(table.slots[i].path);
+            table.slots[i].name = NULL;
+        }
+    }
+    table.count = 0;
+    free(table.path_env);
+    table.path_env = NULL;
+}
+
+/**
+ * @brief Show or modify the table of remembered command paths.
+ *
+ * This function implements the 'hash' command for the shell:
+ * 'hash' lists the remembered commands, 'hash -r' forgets all of them and
+ * 'hash name...' looks the names up and remembers them.
+ *
+ * @param args Array of arguments where args[0] is "hash".
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int execute_command_intern_hash(char **args) {
+    if (args[1] == NULL) {
+        if (table.count == 0) {
+            printf("hash: hash table empty\n");
+            return 0;
+        }
+        printf("hits\tcommand\n");
+        for (size_t i = 0; i < table.size; ++i) {
+            if (table.slots[i].name != NULL) {
+                printf("%4lu\t%s\n", table.slots[i].hits, table.slots[i].path);
+            }
+        }
+        return 0;
+    }
+
+    if (strcmp(args[1], "-r") == 0) {
+        if (args[2] != NULL) {
+            fprintf(stderr, "hash: too many arguments\n");
+            return 1;
+        }
+        hash_clear();
+        return 0;
+    }
+
+    int ret = 0;
+    for (size_t i = 1; args[i] != NULL; ++i) {
+        if (hash_lookup(args[i]) == NULL) {
+            fprintf(stderr, "hash: %s: not found\n", args[i]);
+            ret = 1;
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,43 @@
+#ifndef HASH_CMD_H
+#define HASH_CMD_H
+
+/**
+ * @brief Find the absolute path of a command.
+ *
+ * The $PATH directories are only scanned the first time a command is used:
+ * the result is remembered in a hash table (name -> path), like the 'hash'
+ * builtin of bash. The table is emptied when $PATH changes.
+ * A name containing a '/' is returned as is.
+ *
+ * @param name The name of the command.
+ * @return const char* The path of the command (owned by the table), or NULL if not found.
+ */
+const char *hash_lookup(const char *name);
+
+/**
+ * @brief Forget the path remembered for a command.
+ *
+ * Called when a remembered path does not exist anymore.
+ *
+ * @param name The name of the command.
+ */
+void hash_forget(const char *name);
+
+/**
+ * @brief Forget all the remembered paths.
+ */
+void hash_clear();
+
+/**
+ * @brief Show or modify the table of remembered command paths.
+ *
+ * This function implements the 'hash' command for the shell:
+ * 'hash' lists the remembered commands, 'hash -r' forgets all of them and
+ * 'hash name...' looks the names up and remembers them.
+ *
+ * @param args Array of arguments where args[0] is "hash".
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int execute_command_intern_hash(char **args);
+
+#endif /* HASH_CMD_H */
@@ -0,0 +1,415 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "history_cmd.h"
+
+#define HISTORY_BLOCK 64          // entries of a block of the index
+#define HISTORY_BLOOM_BITS 8192   // size of the trigram signature of a block (power of 2)
+#define HISTORY_SESSION_MIN 4096
+
+/**
+ * @brief A block of consecutive entries of the file, and its trigram signature.
+ *
+ * Each trigram of the entries sets one bit of the signature: an entry of the
+ * block can only contain a text if all the bits of the trigrams of the text
+ * are set. With 64 entries of 40 bytes, a quarter of the bits are set.
+ */
+struct history_block {
+    size_t start; // position of the first entry of the block
+    size_t end;   // position after the last entry of the block
+    uint64_t bloom[HISTORY_BLOOM_BITS / 64];
+};
+
+/**
+ * @brief The history: the mapped file, the entries of the session and the index.
+ */
+static struct {
+    const char *file;   // mapped content of the file at startup, NULL if empty
+    size_t file_size;
+    int fd;             // the file, opened for appending, -1 without file
+    bool need_newline;  // the file does not end with '\n' (interrupted write)
+    char *session;      // entries added since startup, each ending with '\n'
+    size_t session_len;
+    size_t session_cap;
+    pthread_mutex_t lock;           // protects the two fields below
+    struct history_block *blocks;   // from the newest entries of the file to the oldest
+    size_t n_blocks;                // number of blocks already built
+} hist = { .fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER };
+
+
+/**
+ * @brief Get the bit of a trigram in a signature.
+ *
+ * @param s The first of the 3 bytes.
+ * @return uint32_t The index of the bit.
+ */
+static uint32_t history_trigram_bit(const char *s) {
+    uint32_t t = (uint32_t)(unsigned char)s[0] << 16 | (uint32_t)(unsigned char)s[1] << 8 | (unsigned char)s[2];
+    return (t * 2654435761u) >> 19; // 13 bits (Fibonacci hashing)
+}
+
+/**
+ * @brief Find the entry before a position, in a text of entries.
+ *
+ * @param base The text.
+ * @param lo The start of the text searched.
+ * @param end The position of an entry, or the end of the text (greater than lo).
+ * @param stop Receives the end of the entry found (its '\n' or the end of the text).
+ * @return size_t The position of the entry found.
+ */
+static size_t history_before(const char *base, size_t lo, size_t end, size_t *stop) {
+    *stop = base[end - 1] == '\n' ? end - 1 : end;
+    const char *nl = memrchr(base + lo, '\n', *stop - lo);
+    return nl != NULL ? (size_t)(nl - base) + 1 : lo;
+}
+
+/**
+ * @brief Find the newest entry containing a text, in a part of a text of entries.
+ *
+ * @param base The text.
+ * @param lo The start of the part searched.
+ * @param hi The end of the part searched (the position of an entry, or the end of the text).
+ * @param query The text to find.
+ * @param qlen The length of "query".
+ * @param found Receives the position of the entry found (in "base").
+ * @return bool Returns true if an entry was found.
+ */
+static bool history_scan(const char *base, size_t lo, size_t hi, const char *query, size_t qlen, size_t *found) {
+    while (hi > lo) {
+        size_t stop;
+        size_t start = history_before(base, lo, hi, &stop);
+        if (memmem(base + start, stop - start, query, qlen) != NULL) {
+            *found = start;
+            return true;
+        }
+        hi = start;
+    }
+    return false;
+}
+
+/**
+ * @brief Body of the index thread: build the signatures of the file, newest entries first.
+ *
+ * Each block is published as soon as it is built: the searches use the
+ * blocks already built and scan the rest of the file.
+ *
+ * @param arg Unused.
+ * @return void* NULL.
+ */
+static void *history_index_thread(void *arg) {
+    (void)arg;
+    size_t n_entries = 1;
+    for (const char *p = hist.file; (p = memchr(p, '\n', hist.file + hist.file_size - p)) != NULL; ++p) {
+        n_entries++;
+    }
+    struct history_block *blocks = calloc(n_entries / HISTORY_BLOCK + 1, sizeof(struct history_block));
+    if (blocks == NULL) {
+        return NULL;
+    }
+    pthread_mutex_lock(&hist.lock);
+    hist.blocks = blocks;
+    pthread_mutex_unlock(&hist.lock);
+
+    size_t end = hist.file_size;
+    for (size_t b = 0; end > 0; ++b) {
+        struct history_block *block = &blocks[b];
+        block->end = end;
+        for (size_t k = 0; k < HISTORY_BLOCK && end > 0; ++k) {
+            size_t stop;
+            size_t start = history_before(hist.file, 0, end, &stop);
+            for (size_t i = start; i + 3 <= stop; ++i) {
+                uint32_t bit = history_trigram_bit(hist.file + i);
+                block->bloom[bit / 64] |= (uint64_t)1 << (bit % 64);
+            }
+            end = start;
+        }
+        block->start = end;
+
+        pthread_mutex_lock(&hist.lock);
+        hist.n_blocks = b + 1;
+        pthread_mutex_unlock(&hist.lock);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Open the history file and map it in memory.
+ *
+ * The file is never parsed at startup: its entries are found on demand,
+ * by searching the '\n' around a position. The trigram index used by
+ * history_search() is built by a thread, from the newest entries to the
+ * oldest. The new entries are appended to the file, one write per entry.
+ *
+ * The history is seen as one text: the entries of the file followed by the
+ * entries of the session. A position is the offset of an entry in this text,
+ * history_end() being the position of the line being edited.
+ *
+ * @param path The history file (created if needed), or NULL to keep no file.
+ * @return int Returns 0 on success, or 1 on failure (the history is then empty).
+ */
+int history_init(const char *path) {
+    if (path == NULL) {
+        return 0;
+    }
+    hist.fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (hist.fd == -1) {
+        perror(path);
+        return 1;
+    }
+    struct stat st;
+    if (fstat(hist.fd, &st) == -1) {
+        perror(path);
+        return 1;
+    }
+    if (st.st_size == 0) {
+        return 0;
+    }
+
+    void *file = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, hist.fd, 0);
+    if (file == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    hist.file = file;
+    hist.file_size = st.st_size;
+    hist.need_newline = hist.file[hist.file_size - 1] != '\n';
+
+    // The signals (SIGCHLD) are left to the main thread
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    pthread_t thread;
+    int err = pthread_create(&thread, NULL, history_index_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err != 0) {
+        // The searches scan the whole file
+        fprintf(stderr, "pthread_create: %s\n", strerror(err));
+        return 0;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+/**
+ * @brief Add a line to the history, unless it is the same as the last entry.
+ *
+ * @param line The line, without '\n'.
+ * @param len The length of the line.
+ */
+void history_add(const char *line, size_t len) {
+    size_t last = history_end();
+    if (history_prev(&last)) {
+        size_t last_len;
+        const char *text = history_entry(last, &last_len);
+        if (last_len == len && memcmp(text, line, len) == 0) {
+            return;
+        }
+    }
+
+    if (hist.session_len + len + 1 > hist.session_cap) {
+        size_t cap = hist.session_cap ? 2 * (hist.session_len + len + 1) : HISTORY_SESSION_MIN + len;
+        char *session = realloc(hist.session, cap);
+        if (session == NULL) {
+            perror("realloc");
+            return;
+        }
+        hist.session = session;
+        hist.session_cap = cap;
+    }
+    char *entry = hist.session + hist.session_len;
+    memcpy(entry, line, len);
+    entry[len] = '\n';
+    hist.session_len += len + 1;
+
+    if (hist.fd == -1) {
+        return;
+    }
+    // A single write with O_APPEND: the entries of several shells are not mixed
+    struct iovec iov[2] = { { "\n", hist.need_newline }, { entry, len + 1 } };
+    if (writev(hist.fd, iov, 2) == -1) {
+        perror("history");
+    }
+    hist.need_newline = false;
+}
+
+/**
+ * @brief Get the position after the last entry.
+ *
+ * @return size_t The position of the line being edited.
+ */
+size_t history_end() {
+    return hist.file_size + hist.session_len;
+}
+
+/**
+ * @brief Get the text of an entry.
+ *
+ * @param pos The position of the entry.
+ * @param len Receives the length of the entry (without '\n').
+ * @return const char* The text of the entry (not '\0' terminated).
+ */
+const char *history_entry(size_t pos, size_t *len) {
+    const char *base = hist.file;
+    size_t size = hist.file_size;
+    if (pos >= hist.file_size) {
+        base = hist.session;
+        size = hist.session_len;
+        pos -= hist.file_size;
+    }
+    const char *nl = memchr(base + pos, '\n', size - pos);
+    *len = (nl != NULL ? (size_t)(nl - base) : size) - pos;
+    return base + pos;
+}
+
+/**
+ * @brief Move to the previous (older) entry.
+ *
+ * @param pos The position of an entry, or history_end(); updated.
+ * @return bool Returns false if there is no older entry.
+ */
+bool history_prev(size_t *pos) {
+    if (*pos == 0) {
+        return false;
+    }
+    size_t stop;
+    if (*pos <= hist.file_size) {
+        *pos = history_before(hist.file, 0, *pos, &stop);
+    } else {
+        *pos = hist.file_size + history_before(hist.session, 0, *pos - hist.file_size, &stop);
+    }
+    return true;
+}
+
+/**
+ * @brief Move to the next (newer) entry, or to history_end() after the last one.
+ *
+ * @param pos The position of an entry; updated.
+ * @return bool Returns false if "pos" is already history_end().
+ */
+bool history_next(size_t *pos) {
+    if (*pos >= history_end()) {
+        return false;
+    }
+    size_t len;
+    history_entry(*pos, &len);
+    *pos += len;
+    // The last entry of the file may have no '\n'
+    if (*pos != hist.file_size) {
+        (*pos)++;
+    }
+    return true;
+}
+
+/**
+ * @brief Find the newest entry containing a text, in the file.
+ *
+ * The blocks of the index are skipped when their signature lacks one of the
+ * trigrams of the text; the part of the file not indexed yet is scanned.
+ *
+ * @param query The text to find.
+ * @param qlen The length of "query".
+ * @param pos The position to search before; receives the position of the entry found.
+ * @return bool Returns true if an entry was found.
+ */
+static bool history_search_file(const char *query, size_t qlen, size_t *pos) {
+    pthread_mutex_lock(&hist.lock);
+    const struct history_block *blocks = hist.blocks;
+    size_t n_blocks = hist.n_blocks;
+    pthread_mutex_unlock(&hist.lock);
+
+    size_t limit = *pos;
+    for (size_t b = 0; b < n_blocks; ++b) {
+        const struct history_block *block = &blocks[b];
+        if (block->start >= limit) {
+            continue;
+        }
+        bool candidate = true;
+        for (size_t i = 0; i + 3 <= qlen && candidate; ++i) {
+            uint32_t bit = history_trigram_bit(query + i);
+            candidate = (block->bloom[bit / 64] >> (bit % 64)) & 1;
+        }
+        if (candidate && history_scan(hist.file, block->start, limit < block->end ? limit : block->end,
+                                      query, qlen, pos)) {
+            return true;
+        }
+        limit = block->start;
+    }
+    return history_scan(hist.file, 0, limit, query, qlen, pos);
+}
+
+/**
+ * @brief Find the newest entry containing a text, before a position.
+ *
+ * @param query The text to find ('\0' terminated, not empty).
+ * @param pos The position to search before (history_end() for all the
+ *            history); receives the position of the entry found.
+ * @return bool Returns true if an entry was found.
+ */
+bool history_search(const char *query, size_t *pos) {
+    size_t qlen = strlen(query);
+    if (*pos > hist.file_size) {
+        size_t found;
+        if (history_scan(hist.session, 0, *pos - hist.file_size, query, qlen, &found)) {
+            *pos = hist.file_size + found;
+            return true;
+        }
+    }
+    if (hist.file == NULL) {
+        return false;
+    }
+    size_t found = *pos < hist.file_size ? *pos : hist.file_size;
+    if (history_search_file(query, qlen, &found)) {
+        *pos = found;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Print the history.
+ *
+ * This function implements the 'history' command for the shell: 'history'
+ * prints all the entries with their number, 'history n' the last n ones.
+ *
+ * @param args Array of arguments where args[0] is "history".
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int execute_command_intern_history(char **args) {
+    size_t count = SIZE_MAX;
+    if (args[1] != NULL) {
+        char *end;
+        long n = strtol(args[1], &end, 10);
+        if (*end != '\0' || n < 0 || args[2] != NULL) {
+            fprintf(stderr, "Usage: history [n]\n");
+            return 1;
+        }
+        count = n;
+    }
+
+    // Go back "count" entries, then number them from the total count
+    size_t pos = history_end();
+    size_t shown = 0;
+    while (shown < count && history_prev(&pos)) {
+        shown++;
+    }
+    size_t number = 1;
+    for (size_t p = pos; history_prev(&p);) {
+        number++;
+    }
+    for (; shown > 0; --shown, ++number) {
+        size_t len;
+        const char *text = history_entry(pos, &len);
+        printf("%5zu  %.*s\n", number, (int)len, text);
+        history_next(&pos);
+    }
+    return 0;
+}
@@ -0,0 +1,85 @@
+#ifndef HISTORY_CMD_H
+#define HISTORY_CMD_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * @brief Open the history file and map it in memory.
+ *
+ * The file is never parsed at startup: its entries are found on demand,
+ * by searching the '\n' around a position. The trigram index used by
+ * history_search() is built by a thread, from the newest entries to the
+ * oldest. The new entries are appended to the file, one write per entry.
+ *
+ * The history is seen as one text: the entries of the file followed by the
+ * entries of the session. A position is the offset of an entry in this text,
+ * history_end() being the position of the line being edited.
+ *
+ * @param path The history file (created if needed), or NULL to keep no file.
+ * @return int Returns 0 on success, or 1 on failure (the history is then empty).
+ */
+int history_init(const char *path);
+
+/**
+ * @brief Add a line to the history, unless it is the same as the last entry.
+ *
+ * @param line The line, without '\n'.
+ * @param len The length of the line.
+ */
+void history_add(const char *line, size_t len);
+
+/**
+ * @brief Get the position after the last entry.
+ *
+ * @return size_t The position of the line being edited.
+ */
+size_t history_end();
+
+/**
+ * @brief Get the text of an entry.
+ *
+ * @param pos The position of the entry.
+ * @param len Receives the length of the entry (without '\n').
+ * @return const char* The text of the entry (not '\0' terminated).
+ */
+const char *history_entry(size_t pos, size_t *len);
+
+/**
+ * @brief Move to the previous (older) entry.
+ *
+ * @param pos The position of an entry, or history_end(); updated.
+ * @return bool Returns false if there is no older entry.
+ */
+bool history_prev(size_t *pos);
+
+/**
+ * @brief Move to the next (newer) entry, or to history_end() after the last one.
+ *
+ * @param pos The position of an entry; updated.
+ * @return bool Returns false if "pos" is already history_end().
+ */
+bool history_next(size_t *pos);
+
+/**
+ * @brief Find the newest entry containing a text, before a position.
+ *
+ * @param query The text to find ('\0' terminated, not empty).
+ * @param pos The position to search before (history_end() for all the
+ *            history); receives the position of the entry found.
+ * @return bool Returns true if an entry was found.
+ */
+bool history_search(const char *query, size_t *pos);
+
+/**
+ * @brief Print the history.
+ *
+ * This function implements the 'history' command for the shell: 'history'
+ * prints all the entries with their number, 'history n' the last n ones.
+ *
+ * @param args Array of arguments where args[0] is "history".
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int execute_command_intern_history(char **args);
+
+#endif /* HISTORY_CMD_H */
@@ -5,14 +5,75 @@
 #include <libgen.h>
 #include <errno.h>
 #include <pwd.h>
+#include <limits.h>
+#include <sys/stat.h>
 #include "cmdline.h"
+#include "util.h"
+#include "hash_cmd/hash_cmd.h"
+#include "job_cmd/job_cmd.h"
+#include "var_cmd/var_cmd.h"
+#include "cache_cmd/cache_cmd.h"
+#include "parallel_cmd/parallel_cmd.h"
+#include "history_cmd/history_cmd.h"
+#include "intern_cmd.h"
 
 
+/**
+ * @brief Build the logical path of a directory, like 'cd' in sh.
+ *
+ * A relative target is taken from $PWD, then the "." and "name/.."
+ * components are removed from the path without looking at the disk:
+ * "cd .." goes back through the symbolic link that was followed.
+ *
+ * @param pwd The current directory ($PWD, absolute).
+ * @param target The directory given to 'cd'.
+ * @param path Receives the absolute path.
+ * @param size The size of "path".
+ * @return int Returns 0 on success, or 1 if the path is too long.
+ */
+static int cd_logical_path(const char *pwd, const char *target, char *path, size_t size) {
+    char joined[PATH_MAX];
+    int n = target[0] == '/' ? snprintf(joined, sizeof(joined), "%s", target)
+                             : snprintf(joined, sizeof(joined), "%s/%s", pwd, target);
+    if (n < 0 || (size_t)n >= sizeof(joined)) {
+        return 1;
+    }
+
+    // The components are copied one by one, ".." removes the last one copied
+    size_t len = 0;
+    for (char *p = joined; *p != '\0';) {
+        while (*p == '/') {
+            p++;
+        }
+        char *end = strchrnul(p, '/');
+        size_t comp = end - p;
+        if (comp == 2 && p[0] == '.' && p[1] == '.') {
+            while (len > 0 && path[--len] != '/') {
+            }
+        } else if (comp > 0 && !(comp == 1 && p[0] == '.')) {
+            if (len + comp + 2 > size) {
+                return 1;
+            }
+            path[len++] = '/';
+            memcpy(path + len, p, comp);
+            len += comp;
+        }
+        p = end;
+    }
+    if (len == 0) {
+        path[len++] = '/';
+    }
+    path[len] = '\0';
+    return 0;
+}
+
 /**
  * @brief Change the current working directory.
  *
  * This function implements the 'cd' command for the shell. It handles various forms
  * of the 'cd' command, including 'cd', 'cd ~', 'cd ~user', 'cd ~user/path', and 'cd path'.
+ * The shell keeps track of its directory in $PWD (and the previous one in $OLDPWD):
+ * the path is computed from $PWD, so that nothing asks the kernel for it afterwards.
  *
  * @param args Array of arguments where args[0] is "cd" and args[1] is the target directory.
  * @return int Returns 0 on success, or 1 on failure.
@@ -22,7 +83,7 @@ int execute_command_intern_cd(char **args) {
     struct passwd *pw;
 
     // Check if the cd command has too many arguments
-    if (args[2] != NULL) {
+    if (args[1] != NULL && args[2] != NULL) {
         fprintf(stderr, "cd: too many arguments\n");
         return 1;
     }
@@ -30,7 +91,12 @@ int execute_command_intern_cd(char **args) {
     // Check if the cd command has an argument
     if (args[1] == NULL || strcmp(args[1], "~") == 0 || (args[1][0] == '~' && strlen(args[1]) == 1)) {
         // If no argument, ~, or ~ with no username is provided, change to the home directory
-        snprintf(target_dir, sizeof(target_dir), "%s", getenv("HOME"));
+        const char *home = var_get("HOME");
+        if (home == NULL) {
+            fprintf(stderr, "cd: HOME not set\n");
+            return 1;
+        }
+        snprintf(target_dir, sizeof(target_dir), "%s", home);
     } else if (args[1][0] == '~') {
         // Handle ~user and ~user/path cases
         char *username_end = strchr(args[1], '/');
@@ -60,8 +126,18 @@ int execute_command_intern_cd(char **args) {
         snprintf(target_dir, sizeof(target_dir), "%s", args[1]);
     }
 
+    // Without a known $PWD, the new directory is asked to the kernel once
+    const char *pwd = var_get("PWD");
+    char path[PATH_MAX];
+    bool logical = pwd != NULL && pwd[0] == '/'
+                   && cd_logical_path(pwd, target_dir, path, sizeof(path)) == 0;
+
     // Attempt to change the directory
-    if (chdir(target_dir) != 0) {
+    // (the physical path is tried too: "link/.." may not be the directory of "link")
+    if (logical && chdir(path) != 0) {
+        logical = false;
+    }
+    if (!logical && chdir(target_dir) != 0) {
         if (errno == EACCES) {
             fprintf(stderr, "chdir : permission denied\n");
         } else {
@@ -70,7 +146,20 @@ int execute_command_intern_cd(char **args) {
         return 1;
     }
 
-    return 0;
+    if (pwd != NULL && var_export("OLDPWD", pwd) != 0) {
+        return 1;
+    }
+    if (logical) {
+        return var_export("PWD", path);
+    }
+    char *cwd = getcwd(NULL, 0);
+    if (cwd == NULL) {
+        perror("getcwd");
+        return 1;
+    }
+    int ret = var_export("PWD", cwd);
+    free(cwd);
+    return ret;
 }
 
 
@@ -95,6 +184,554 @@ int execute_command_intern_exit(struct line *li, struct cmd *cmd) {
     if (cmd->n_args == 2) {
         exit_status = atoi(cmd->args[1]);
     }
-    line_reset(li);
+    line_destroy(li);
     exit(exit_status);
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Show or change the options of the shell.
+ *
+ * This function implements the 'set' command for the shell: 'set -o' lists
+ * the options, 'set -o name' enables an option and 'set +o name' disables it.
+ * The options are 'pipefail': the status of a pipeline is the status of its
+ * last command that failed, instead of the status of its last command, and
+ * 'nullglob': a pattern matching no file expands to nothing, instead of itself.
+ *
+ * @param args Array of arguments where args[0] is "set".
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int execute_command_intern_set(char **args) {
+    static const struct {
+        const char *name;
+        bool *flag;
+    } options[] = {
+        { "nullglob", &shell_nullglob },
+        { "pipefail", &shell_pipefail },
+    };
+    size_t n_options = sizeof(options) / sizeof(options[0]);
+
+    if (args[1] == NULL || (strcmp(args[1], "-o") == 0 && args[2] == NULL)) {
+        for (size_t i = 0; i < n_options; ++i) {
+            printf("%s\t%s\n", options[i].name, *options[i].flag ? "on" : "off");
+        }
+        return 0;
+    }
+    if ((strcmp(args[1], "-o") != 0 && strcmp(args[1], "+o") != 0) || args[2] == NULL || args[3] != NULL) {
+        fprintf(stderr, "Usage: set [-o|+o] [option]\n");
+        return 1;
+    }
+    for (size_t i = 0; i < n_options; ++i) {
+        if (strcmp(args[2], options[i].name) == 0) {
+            *options[i].flag = args[1][0] == '-';
+            return 0;
+        }
+    }
+    fprintf(stderr, "set: %s: invalid option name\n", args[2]);
+    return 1;
+}
+
+/**
+ * @brief Print the current working directory.
+ *
+ * This function implements the 'pwd' command for the shell: 'pwd' prints $PWD,
+ * the directory tracked by the shell, and 'pwd -P' the physical path, without
+ * symbolic links.
+ *
+ * @param args Array of arguments where args[0] is "pwd".
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int execute_command_intern_pwd(char **args) {
+    bool physical = args[1] != NULL && strcmp(args[1], "-P") == 0;
+    if ((args[1] != NULL && !physical) || (physical && args[2] != NULL)) {
+        fprintf(stderr, "Usage: pwd [-P]\n");
+        return 1;
+    }
+    // The directory tracked by the shell, unless the physical path is asked for
+    const char *pwd = var_get("PWD");
+    if (!physical && pwd != NULL && pwd[0] == '/') {
+        printf("%s\n", pwd);
+        return 0;
+    }
+    char *cwd = getcwd(NULL, 0);
+    if (cwd == NULL) {
+        perror("pwd");
+        return 1;
+    }
+    printf("%s\n", cwd);
+    free(cwd);
+    return 0;
+}
+
+/**
+ * @brief Print the arguments.
+ *
+ * This function implements the 'echo' command for the shell: the arguments
+ * are printed separated by spaces, followed by a newline unless the first
+ * argument is -n.
+ *
+ * @param args Array of arguments where args[0] is "echo".
+ * @return int Returns 0.
+ */
+int execute_command_intern_echo(char **args) {
+    size_t i = 1;
+    bool newline = true;
+    if (args[1] != NULL && strcmp(args[1], "-n") == 0) {
+        newline = false;
+        i = 2;
+    }
+    for (size_t first = i; args[i] != NULL; ++i) {
+        if (i != first) {
+            putchar(' ');
+        }
+        fputs(args[i], stdout);
+    }
+    if (newline) {
+        putchar('\n');
+    }
+    return 0;
+}
+
+/**
+ * @brief Print the backslash escape sequence of a printf format.
+ *
+ * @param p Pointer to the backslash.
+ * @return const char* Pointer to the last char of the sequence.
+ */
+static const char *print_escape(const char *p) {
+    switch (p[1]) {
+    case 'n': putchar('\n'); return p + 1;
+    case 't': putchar('\t'); return p + 1;
+    case 'r': putchar('\r'); return p + 1;
+    case 'a': putchar('\a'); return p + 1;
+    case 'b': putchar('\b'); return p + 1;
+    case 'f': putchar('\f'); return p + 1;
+    case 'v': putchar('\v'); return p + 1;
+    case '\\': putchar('\\'); return p + 1;
+    case '\0': putchar('\\'); return p;
+    default:
+        break;
+    }
+    if (p[1] >= '0' && p[1] <= '7') {
+        // Octal value, up to 3 digits
+        int value = 0;
+        int n = 0;
+        while (n < 3 && p[1] >= '0' && p[1] <= '7') {
+            value = 8 * value + (p[1] - '0');
+            ++p;
+            ++n;
+        }
+        putchar(value);
+        return p;
+    }
+    putchar('\\');
+    putchar(p[1]);
+    return p + 1;
+}
+
+/**
+ * @brief Format and print the arguments.
+ *
+ * This function implements the 'printf' command for the shell:
+ * 'printf format [arguments...]'. The conversions %s, %c, %d, %i, %u, %x,
+ * %X, %o and %% are supported, with their flags, width and precision, and
+ * the backslash escapes of the format are interpreted. Like in sh, the
+ * format is reused as long as arguments remain.
+ *
+ * @param args Array of arguments where args[0] is "printf".
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int execute_command_intern_printf(char **args) {
+    if (args[1] == NULL) {
+        fprintf(stderr, "Usage: printf format [arguments...]\n");
+        return 1;
+    }
+    const char *format = args[1];
+    char **arg = &args[2];
+    int ret = 0;
+
+    for (;;) {
+        char **first = arg;
+        for (const char *p = format; *p != '\0'; ++p) {
+            if (*p == '\\') {
+                p = print_escape(p);
+                continue;
+            }
+            if (*p != '%') {
+                putchar(*p);
+                continue;
+            }
+            if (p[1] == '%') {
+                putchar('%');
+                ++p;
+                continue;
+            }
+
+            // Copy the conversion specification, "ll" is added for the integers
+            char spec[64];
+            size_t len = 0;
+            spec[len++] = *p++;
+            while (*p != '\0' && strchr("-+ #0123456789.", *p) != NULL && len < sizeof(spec) - 4) {
+                spec[len++] = *p++;
+            }
+            const char *value = *arg != NULL ? *arg++ : NULL;
+
+            if (*p == 's' || *p == 'c') {
+                spec[len++] = *p;
+                spec[len] = '\0';
+                if (*p == 's') {
+                    printf(spec, value != NULL ? value : "");
+                } else {
+                    printf(spec, value != NULL ? value[0] : '\0');
+                }
+            } else if (*p != '\0' && strchr("diuxXo", *p) != NULL) {
+                spec[len++] = 'l';
+                spec[len++] = 'l';
+                spec[len++] = *p;
+                spec[len] = '\0';
+                char *end = NULL;
+                long long n = 0;
+                if (value != NULL) {
+                    n = strtoll(value, &end, 0);
+                    if (*end != '\0' || end == value) {
+                        fprintf(stderr, "printf: %s: invalid number\n", value);
+                        ret = 1;
+                    }
+                }
+                printf(spec, n);
+            } else {
+                fprintf(stderr, "printf: %%%c: invalid conversion\n", *p);
+                return 1;
+            }
+        }
+        // The format is used again for the remaining arguments
+        if (*arg == NULL || arg == first) {
+            break;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief Do nothing, successfully.
+ *
+ * This function implements the 'true' command for the shell.
+ *
+ * @param args Array of arguments where args[0] is "true".
+ * @return int Returns 0.
+ */
+int execute_command_intern_true(char **args) {
+    (void)args;
+    return 0;
+}
+
+/**
+ * @brief Do nothing, unsuccessfully.
+ *
+ * This function implements the 'false' command for the shell.
+ *
+ * @param args Array of arguments where args[0] is "false".
+ * @return int Returns 1.
+ */
+int execute_command_intern_false(char **args) {
+    (void)args;
+    return 1;
+}
+
+/**
+ * @brief Parse an integer operand of 'test'.
+ *
+ * @param str The operand.
+ * @param n Pointer to the parsed value.
+ * @return int Returns 0 on success, or 1 if the operand is not an integer.
+ */
+static int test_integer(const char *str, long long *n) {
+    char *end;
+    *n = strtoll(str, &end, 10);
+    if (end == str || *end != '\0') {
+        fprintf(stderr, "test: %s: integer expression expected\n", str);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Evaluate a unary expression of 'test'.
+ *
+ * @param op The operator.
+ * @param operand The operand.
+ * @return int Returns 0 if the expression is true, 1 if it is false, 2 on error.
+ */
+static int test_unary(const char *op, const char *operand) {
+    struct stat st;
+    if (strcmp(op, "-n") == 0) {
+        return operand[0] == '\0';
+    }
+    if (strcmp(op, "-z") == 0) {
+        return operand[0] != '\0';
+    }
+    if (strcmp(op, "-r") == 0) {
+        return access(operand, R_OK) != 0;
+    }
+    if (strcmp(op, "-w") == 0) {
+        return access(operand, W_OK) != 0;
+    }
+    if (strcmp(op, "-x") == 0) {
+        return access(operand, X_OK) != 0;
+    }
+    if (strcmp(op, "-L") == 0 || strcmp(op, "-h") == 0) {
+        return lstat(operand, &st) != 0 || !S_ISLNK(st.st_mode);
+    }
+    if (strlen(op) != 2 || op[0] != '-' || strchr("efds", op[1]) == NULL) {
+        fprintf(stderr, "test: %s: unary operator expected\n", op);
+        return 2;
+    }
+    if (stat(operand, &st) != 0) {
+        return 1;
+    }
+    switch (op[1]) {
+    case 'f': return !S_ISREG(st.st_mode);
+    case 'd': return !S_ISDIR(st.st_mode);
+    case 's': return st.st_size == 0;
+    default: return 0; // -e
+    }
+}
+
+/**
+ * @brief Evaluate a binary expression of 'test'.
+ *
+ * @param left The left operand.
+ * @param op The operator.
+ * @param right The right operand.
+ * @return int Returns 0 if the expression is true, 1 if it is false, 2 on error.
+ */
+static int test_binary(const char *left, const char *op, const char *right) {
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) {
+        return strcmp(left, right) != 0;
+    }
+    if (strcmp(op, "!=") == 0) {
+        return strcmp(left, right) == 0;
+    }
+
+    static const char *ops[] = { "-eq", "-ne", "-lt", "-le", "-gt", "-ge" };
+    size_t k = 0;
+    while (k < sizeof(ops) / sizeof(ops[0]) && strcmp(op, ops[k]) != 0) {
+        ++k;
+    }
+    if (k == sizeof(ops) / sizeof(ops[0])) {
+        fprintf(stderr, "test: %s: binary operator expected\n", op);
+        return 2;
+    }
+    long long a, b;
+    if (test_integer(left, &a) != 0 || test_integer(right, &b) != 0) {
+        return 2;
+    }
+    bool result[] = { a == b, a != b, a < b, a <= b, a > b, a >= b };
+    return !result[k];
+}
+
+/**
+ * @brief Evaluate an expression of 'test'.
+ *
+ * @param args The words of the expression.
+ * @param n The number of words.
+ * @return int Returns 0 if the expression is true, 1 if it is false, 2 on error.
+ */
+static int test_expression(char **args, size_t n) {
+    if (n > 0 && strcmp(args[0], "!") == 0) {
+        int ret = test_expression(args + 1, n - 1);
+        return ret == 2 ? 2 : !ret;
+    }
+    switch (n) {
+    case 0:
+        return 1;
+    case 1:
+        return args[0][0] == '\0';
+    case 2:
+        return test_unary(args[0], args[1]);
+    case 3:
+        return test_binary(args[0], args[1], args[2]);
+    default:
+        fprintf(stderr, "test: too many arguments\n");
+        return 2;
+    }
+}
+
+/**
+ * @brief Evaluate a conditional expression.
+ *
+ * This function implements the 'test' and '[' commands for the shell:
+ * a string (true if not empty), the unary operators -n -z -e -f -d -s -r -w -x -L,
+ * the binary operators = != -eq -ne -lt -le -gt -ge, and '!' for the negation.
+ * '[' needs ']' as its last argument.
+ *
+ * @param args Array of arguments where args[0] is "test" or "[".
+ * @return int Returns 0 if the expression is true, 1 if it is false, 2 on error.
+ */
+int execute_command_intern_test(char **args) {
+    size_t n = 0;
+    while (args[n + 1] != NULL) {
+        ++n;
+    }
+    if (strcmp(args[0], "[") == 0) {
+        if (n == 0 || strcmp(args[n], "]") != 0) {
+            fprintf(stderr, "[: missing ']'\n");
+            return 2;
+        }
+        --n;
+    }
+    return test_expression(args + 1, n);
+}
+
+#define BUILTIN_TABLE_SIZE 64 // must be a power of 2, at least twice the number of builtins
+
+/**
+ * @brief The internal commands of the shell.
+ */
+static const struct builtin builtins[] = {
+    { "cd",       execute_command_intern_cd,       NULL,                        BUILTIN_STATE },
+    { "exit",     NULL,                            execute_command_intern_exit, BUILTIN_STATE },
+    { "set",      execute_command_intern_set,      NULL,                        BUILTIN_STATE | BUILTIN_STDIO },
+    { "hash",     execute_command_intern_hash,     NULL,                        BUILTIN_STATE | BUILTIN_STDIO },
+    { "jobs",     execute_command_intern_jobs,     NULL,                        BUILTIN_STATE | BUILTIN_STDIO },
+    { "fg",       execute_command_intern_fg,       NULL,                        BUILTIN_STATE },
+    { "bg",       execute_command_intern_bg,       NULL,                        BUILTIN_STATE },
+    { "wait",     execute_command_intern_wait,     NULL,                        BUILTIN_STATE },
+    { "export",   execute_command_intern_export,   NULL,                        BUILTIN_STATE | BUILTIN_STDIO },
+    { "unset",    execute_command_intern_unset,    NULL,                        BUILTIN_STATE },
+    { "cache",    execute_command_intern_cache,    NULL,                        BUILTIN_STATE | BUILTIN_STDIO },
+    { "parallel", execute_command_intern_parallel, NULL,                        BUILTIN_STDIO },
+    { "history",  execute_command_intern_history,  NULL,                        BUILTIN_STDIO },
+    { "echo",     execute_command_intern_echo,     NULL,                        BUILTIN_STDIO },
+    { "printf",   execute_command_intern_printf,   NULL,                        BUILTIN_STDIO },
+    { "pwd",      execute_command_intern_pwd,      NULL,                        BUILTIN_STDIO },
+    { "true",     execute_command_intern_true,     NULL,                        0 },
+    { "false",    execute_command_intern_false,    NULL,                        0 },
+    { "test",     execute_command_intern_test,     NULL,                        0 },
+    { "[",        execute_command_intern_test,     NULL,                        0 },
+};
+
+static const struct builtin *builtin_table[BUILTIN_TABLE_SIZE];
+
+/**
+ * @brief Hash of the name of a command, for the table of internal commands.
+ *
+ * Only the length and the first and last chars are used: it is collision
+ * free for the current names, and the linear probing keeps the lookup
+ * correct when a name is added.
+ *
+ * @param name The name of the command.
+ * @return size_t The index of its home slot.
+ */
+static size_t builtin_hash(const char *name) {
+    size_t len = strlen(name);
+    if (len == 0) {
+        return 0;
+    }
+    return (len + 6 * (unsigned char)name[0] + (unsigned char)name[len - 1]) & (BUILTIN_TABLE_SIZE - 1);
+}
+
+/**
+ * @brief Find an internal command.
+ *
+ * The table is filled at the first call. The lookup costs one hash and
+ * usually one strcmp(): an external command name is rejected without
+ * comparing it to all the internal commands.
+ *
+ * @param name The name of the command.
+ * @return const struct builtin* The internal command, or NULL if it is not an internal command.
+ */
+const struct builtin *builtin_lookup(const char *name) {
+    static bool filled = false;
+    size_t mask = BUILTIN_TABLE_SIZE - 1;
+    if (!filled) {
+        for (size_t k = 0; k < sizeof(builtins) / sizeof(builtins[0]); ++k) {
+            size_t i = builtin_hash(builtins[k].name);
+            while (builtin_table[i] != NULL) {
+                i = (i + 1) & mask;
+            }
+            builtin_table[i] = &builtins[k];
+        }
+        filled = true;
+    }
+
+    for (size_t i = builtin_hash(name); builtin_table[i] != NULL; i = (i + 1) & mask) {
+        if (strcmp(builtin_table[i]->name, name) == 0) {
+            return builtin_table[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Get the name of an internal command, in the order of the table.
+ *
+ * @param i The index of the internal command.
+ * @return const char* The name, or NULL after the last internal command.
+ */
+const char *builtin_name(size_t i) {
+    return i < sizeof(builtins) / sizeof(builtins[0]) ? builtins[i].name : NULL;
+}
+
+/**
+ * @brief Check if an internal command must run in a child process.
+ *
+ * An internal command alone on its line runs in the shell, unless it is in the
+ * background: its redirections ('echo x >> log', 'cd dir 2>/dev/null') are
+ * applied by the shell around the command, no process is created. In a
+ * pipeline, it runs in a forked subshell, unless it has no effect on the shell
+ * and no input/output (true, false, test): then its status is simply computed
+ * by the shell, with its redirections applied the same way.
+ *
+ * @param b The internal command.
+ * @param li Pointer to the line structure.
+ * @return bool Returns true if the command needs a child process.
+ */
+bool builtin_needs_child(const struct builtin *b, const struct line *li) {
+    if (li->n_cmds > 1) {
+        return b->flags != 0;
+    }
+    return li->background;
+}
+
+/**
+ * @brief Check if a command is an internal command of the shell.
+ *
+ * @param cmd The name of the command.
+ * @return int Returns 1 if the command is an internal command, 0 otherwise.
+ */
+int is_intern_command(const char *cmd) {
+    return builtin_lookup(cmd) != NULL;
+}
+
+/**
+ * @brief Run an internal command.
+ *
+ * @param li Pointer to the line structure.
+ * @param cmd Pointer to the command structure (cmd->args[0] is the internal command).
+ * @return int The exit status of the command.
+ */
+int execute_command_intern(struct line *li, struct cmd *cmd) {
+    const struct builtin *b = builtin_lookup(cmd->args[0]);
+    if (b == NULL) {
+        return 1;
+    }
+    int ret = b->line_fn != NULL ? b->line_fn(li, cmd) : b->fn(cmd->args);
+    // The next command may write to the same file: nothing must stay in the buffer
+    fflush(stdout);
+    return ret;
+}
+
+/**
+ * @brief Run an internal command in a child process (spawn_req callback).
+ *
+ * @param ctx Pointer to a struct intern_stage.
+ * @return int The exit status of the child.
+ */
+int run_intern_stage(void *ctx) {
+    struct intern_stage *stage = ctx;
+    // The command may launch and reap processes of its own (parallel)
+    if (job_subshell() != 0) {
+        return 1;
+    }
+    return execute_command_intern(stage->li, stage->cmd);
+}
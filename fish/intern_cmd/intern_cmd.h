@@ -1,11 +1,41 @@
 #ifndef EXECUTE_COMMAND_INTERN_H
 #define EXECUTE_COMMAND_INTERN_H
 
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "cmdline.h"
+
+#define BUILTIN_STATE 1 // changes the state of the shell: runs in the shell when alone
+#define BUILTIN_STDIO 2 // uses the standard streams: runs in a child in a pipeline (even with BUILTIN_STATE)
+
+/**
+ * @brief An internal command of the shell.
+ *
+ * Most commands only need their arguments (fn); 'exit' needs the whole line (line_fn).
+ */
+struct builtin {
+    const char *name;
+    int (*fn)(char **args);
+    int (*line_fn)(struct line *li, struct cmd *cmd);
+    int flags;
+};
+
+/**
+ * @brief Context given to an internal command running in a child process.
+ */
+struct intern_stage {
+    struct line *li;
+    struct cmd *cmd;
+};
+
 /**
  * @brief Change the current working directory.
  *
  * This function implements the 'cd' command for the shell. It handles various forms
  * of the 'cd' command, including 'cd', 'cd ~', 'cd ~user', 'cd ~user/path', and 'cd path'.
+ * The shell keeps track of its directory in $PWD (and the previous one in $OLDPWD):
+ * the path is computed from $PWD, so that nothing asks the kernel for it afterwards.
  *
  * @param args Array of arguments where args[0] is "cd" and args[1] is the target directory.
  * @return int Returns 0 on success, or 1 on failure.
@@ -24,4 +54,150 @@ int execute_command_intern_cd(char **args);
  */
 int execute_command_intern_exit(struct line *li, struct cmd *cmd);
 
+/**
+ * @brief Show or change the options of the shell.
+ *
+ * This function implements the 'set' command for the shell: 'set -o' lists
+ * the options, 'set -o name' enables an option and 'set +o name' disables it.
+ * The options are 'pipefail': the status of a pipeline is the status of its
+ * last command that failed, instead of the status of its last command, and
+ * 'nullglob': a pattern matching no file expands to nothing, instead of itself.
+ *
+ * @param args Array of arguments where args[0] is "set".
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int execute_command_intern_set(char **args);
+
+/**
+ * @brief Print the current working directory.
+ *
+ * This function implements the 'pwd' command for the shell: 'pwd' prints $PWD,
+ * the directory tracked by the shell, and 'pwd -P' the physical path, without
+ * symbolic links.
+ *
+ * @param args Array of arguments where args[0] is "pwd".
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int execute_command_intern_pwd(char **args);
+
+/**
+ * @brief Print the arguments.
+ *
+ * This function implements the 'echo' command for the shell: the arguments
+ * are printed separated by spaces, followed by a newline unless the first
+ * argument is -n.
+ *
+ * @param args Array of arguments where args[0] is "echo".
+ * @return int Returns 0.
+ */
+int execute_command_intern_echo(char **args);
+
+/**
+ * @brief Format and print the arguments.
+ *
+ * This function implements the 'printf' command for the shell:
+ * 'printf format [arguments...]'. The conversions %s, %c, %d, %i, %u, %x,
+ * %X, %o and %% are supported, with their flags, width and precision, and
+ * the backslash escapes of the format are interpreted. Like in sh, the
+ * format is reused as long as arguments remain.
+ *
+ * @param args Array of arguments where args[0] is "printf".
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int execute_command_intern_printf(char **args);
+
+/**
+ * @brief Do nothing, successfully.
+ *
+ * This function implements the 'true' command for the shell.
+ *
+ * @param args Array of arguments where args[0] is "true".
+ * @return int Returns 0.
+ */
+int execute_command_intern_true(char **args);
+
+/**
+ * @brief Do nothing, unsuccessfully.
+ *
+ * This function implements the 'false' command for the shell.
+ *
+ * @param args Array of arguments where args[0] is "false".
+ * @return int Returns 1.
+ */
+int execute_command_intern_false(char **args);
+
+/**
+ * @brief Evaluate a conditional expression.
+ *
+ * This function implements the 'test' and '[' commands for the shell:
+ * a string (true if not empty), the unary operators -n -z -e -f -d -s -r -w -x -L,
+ * the binary operators = != -eq -ne -lt -le -gt -ge, and '!' for the negation.
+ * '[' needs ']' as its last argument.
+ *
+ * @param args Array of arguments where args[0] is "test" or "[".
+ * @return int Returns 0 if the expression is true, 1 if it is false, 2 on error.
+ */
+int execute_command_intern_test(char **args);
+
+/**
+ * @brief Find an internal command.
+ *
+ * The table is filled at the first call. The lookup costs one hash and
+ * usually one strcmp(): an external command name is rejected without
+ * comparing it to all the internal commands.
+ *
+ * @param name The name of the command.
+ * @return const struct builtin* The internal command, or NULL if it is not an internal command.
+ */
+const struct builtin *builtin_lookup(const char *name);
+
+/**
+ * @brief Get the name of an internal command, in the order of the table.
+ *
+ * @param i The index of the internal command.
+ * @return const char* The name, or NULL after the last internal command.
+ */
+const char *builtin_name(size_t i);
+
+/**
+ * @brief Check if an internal command must run in a child process.
+ *
+ * An internal command alone on its line runs in the shell, unless it is in the
+ * background: its redirections ('echo x >> log', 'cd dir 2>/dev/null') are
+ * applied by the shell around the command, no process is created. In a
+ * pipeline, it runs in a forked subshell, unless it has no effect on the shell
+ * and no input/output (true, false, test): then its status is simply computed
+ * by the shell, with its redirections applied the same way.
+ *
+ * @param b The internal command.
+ * @param li Pointer to the line structure.
+ * @return bool Returns true if the command needs a child process.
+ */
+bool builtin_needs_child(const struct builtin *b, const struct line *li);
+
+/**
+ * @brief Check if a command is an internal command of the shell.
+ *
+ * @param cmd The name of the command.
+ * @return int Returns 1 if the command is an internal command, 0 otherwise.
+ */
+int is_intern_command(const char *cmd);
+
+/**
+ * @brief Run an internal command.
+ *
+ * @param li Pointer to the line structure.
+ * @param cmd Pointer to the command structure (cmd->args[0] is the internal command).
+ * @return int The exit status of the command.
+ */
+int execute_command_intern(struct line *li, struct cmd *cmd);
+
+/**
+ * @brief Run an internal command in a child process (spawn_req callback).
+ *
+ * @param ctx Pointer to a struct intern_stage.
+ * @return int The exit status of the child.
+ */
+int run_intern_stage(void *ctx);
+
 #endif /* EXECUTE_COMMAND_INTERN_H */
\ No newline at end of file
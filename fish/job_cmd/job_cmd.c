@@ -0,0 +1,1163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "job_cmd.h"
+#include "util.h"
+
+#define PROC_MIN_SIZE 64 // must be a power of 2
+#define JOB_MIN_COUNT 16
+#define JOB_MIN_STAGES 4
+
+/**
+ * @brief The resources used by one stage of a job.
+ */
+struct job_stage {
+    pid_t pid;            // -1 for a stage without process
+    char *name;           // command of the stage, only kept for 'time -v'
+    struct timespec end;  // when the process was reaped
+    struct rusage usage;  // zero for a stage without process
+};
+
+/**
+ * @brief One job: the processes launched by one command line (a pipeline).
+ *
+ * The id shown to the user is the index of the job in the table plus 1.
+ */
+struct job {
+    bool used;
+    bool background;
+    pid_t pgid;      // process group of the job, 0 before its first process
+    size_t running;  // number of processes not reaped yet
+    size_t stopped;  // number of processes stopped
+    size_t n_stages; // number of processes added, including the ones that could not be launched
+    pid_t last_pid;  // last process added: its status is the status of the job
+    int status;
+    bool failed;     // a process exited with a non-zero status
+    size_t fail_stage;
+    int fail_status; // status of the last stage with a non-zero status (pipefail)
+    char *cmd;       // text of the command line, shown by 'jobs'
+    int next_free;   // next free job if the job is not used, -1 at the end
+    int time;                 // LINE_TIME or LINE_TIME_STAGES: the resources are printed when the job is over
+    struct timespec start;    // creation of the job
+    struct rusage usage;      // resources of the processes reaped: the sums, and the largest maxrss
+    struct job_stage *stages; // n_stages entries, kept when the job is reused
+    size_t cap_stages;
+    unsigned long current;    // when the job last became the current job ('%+' of sh), 0 never
+};
+
+/**
+ * @brief One running process, in the open addressing table pid -> job.
+ */
+struct proc_entry {
+    pid_t pid; // 0 if the slot is empty
+    int job;
+    size_t stage; // position of the process in the pipeline
+    bool stopped;
+};
+
+static struct {
+    struct job *jobs;
+    size_t n_jobs;
+    int free_job; // first free job, -1 if none
+
+    struct proc_entry *procs;
+    size_t size;  // number of slots, a power of 2
+    size_t count;
+
+    unsigned long current; // last value given to job.current
+} table = { NULL, 0, -1, NULL, 0, 0, 0 };
+
+static int signal_pipe[2] = { -1, -1 };
+static volatile sig_atomic_t sigchld_pending = 0;
+static pid_t shell_pgid = 0; // process group of the shell, 0 without job control
+
+
+/**
+ * @brief Signal handler for SIGCHLD.
+ *
+ * Only async-signal-safe work is done here: a flag is set and a byte is
+ * written in the self-pipe to wake up the event loop.
+ *
+ * @param signal The signal number.
+ */
+static void job_signal_handler(int signal) {
+    (void)signal;
+    int saved_errno = errno;
+    sigchld_pending = 1;
+    // The pipe is non-blocking: if it is full, a wake up is already pending
+    ssize_t ret = write(signal_pipe[1], "", 1);
+    (void)ret;
+    errno = saved_errno;
+}
+
+/**
+ * @brief Install the SIGCHLD handler and create the self-pipe it writes to.
+ *
+ * The handler only sets a flag and writes one byte in the pipe: the children
+ * are reaped later by job_reap(), outside of the signal handler.
+ * When the shell is interactive, job control is enabled: the shell leads its
+ * own process group, owns the terminal and ignores SIGTSTP, SIGTTIN and SIGTTOU.
+ *
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int job_init() {
+    if (pipe2(signal_pipe, O_CLOEXEC | O_NONBLOCK) == -1) {
+        perror("pipe");
+        return 1;
+    }
+
+    struct sigaction sigchld_action;
+    sigemptyset(&sigchld_action.sa_mask);
+    sigchld_action.sa_handler = job_signal_handler;
+    sigchld_action.sa_flags = SA_RESTART;
+    if (sigaction(SIGCHLD, &sigchld_action, NULL) == -1) {
+        perror("sigaction");
+        return 1;
+    }
+
+    if (!shell_interactive) {
+        return 0;
+    }
+    // Job control: the shell leads its own process group and owns the terminal.
+    // It ignores the stop signals, which are given back to its children.
+    struct sigaction ignore;
+    sigemptyset(&ignore.sa_mask);
+    ignore.sa_handler = SIG_IGN;
+    ignore.sa_flags = 0;
+    sigaction(SIGTSTP, &ignore, NULL);
+    sigaction(SIGTTIN, &ignore, NULL);
+    sigaction(SIGTTOU, &ignore, NULL);
+
+    setpgid(0, 0);
+    shell_pgid = getpgrp();
+    if (tcsetpgrp(STDIN_FILENO, shell_pgid) == -1) {
+        perror("tcsetpgrp");
+        shell_pgid = 0;
+    }
+    return 0;
+}
+
+/**
+ * @brief Prepare the job control of a child process running an internal command.
+ *
+ * The child gets its own self-pipe: the one inherited from the shell is
+ * shared with it, and each process could drain the wake ups of the other.
+ * Job control stays with the shell: the child does not touch the terminal.
+ *
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int job_subshell() {
+    close(signal_pipe[0]);
+    close(signal_pipe[1]);
+    shell_pgid = 0;
+    if (pipe2(signal_pipe, O_CLOEXEC | O_NONBLOCK) == -1) {
+        perror("pipe");
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Get the read end of the self-pipe.
+ *
+ * It becomes readable when a child has terminated: an event loop can poll()
+ * it together with its input, and call job_reap() when it is readable.
+ *
+ * @return int The file descriptor (close-on-exec and non-blocking).
+ */
+int job_signal_fd() {
+    return signal_pipe[0];
+}
+
+/**
+ * @brief Hash of a pid (Fibonacci hashing).
+ *
+ * @param pid The pid.
+ * @return size_t The index of its home slot.
+ */
+static size_t proc_home(pid_t pid) {
+    return (size_t)(((uint64_t)pid * 11400714819323198485ULL) >> 32) & (table.size - 1);
+}
+
+/**
+ * @brief Find the slot of a pid: the slot holding it, or the empty slot where it would go.
+ *
+ * @param pid The pid.
+ * @return struct proc_entry* The slot.
+ */
+static struct proc_entry *proc_slot(pid_t pid) {
+    size_t mask = table.size - 1;
+    size_t i = proc_home(pid);
+    while (table.procs[i].pid != 0 && table.procs[i].pid != pid) {
+        i = (i + 1) & mask;
+    }
+    return &table.procs[i];
+}
+
+/**
+ * @brief Double the size of the table of processes.
+ *
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+static int proc_grow() {
+    struct proc_entry *old = table.procs;
+    size_t old_size = table.size;
+    size_t size = old_size ? 2 * old_size : PROC_MIN_SIZE;
+
+    struct proc_entry *procs = calloc(size, sizeof(struct proc_entry));
+    if (procs == NULL) {
+        perror("calloc");
+        return 1;
+    }
+    table.procs = procs;
+    table.size = size;
+    for (size_t i = 0; i < old_size; ++i) {
+        if (old[i].pid != 0) {
+            *proc_slot(old[i].pid) = old[i];
+        }
+    }
+    free(old);
+    return 0;
+}
+
+/**
+ * @brief Remove a process from the table of processes.
+ *
+ * @param entry The slot of the process.
+ */
+static void proc_remove(struct proc_entry *entry) {
+    entry->pid = 0;
+    table.count--;
+
+    // Backward shift deletion: move back the entries of the same probe sequence
+    size_t mask = table.size - 1;
+    size_t hole = entry - table.procs;
+    size_t i = (hole + 1) & mask;
+    while (table.procs[i].pid != 0) {
+        size_t home = proc_home(table.procs[i].pid);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            table.procs[hole] = table.procs[i];
+            table.procs[i].pid = 0;
+            hole = i;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+/**
+ * @brief Build the text of a command line, as shown by 'jobs'.
+ *
+ * @param li The parsed command line.
+ * @return char* The dynamically allocated text, or NULL on failure.
+ */
+static char *job_text(const struct line *li) {
+    size_t len = 3;
+    for (size_t i = 0; i < li->n_cmds; ++i) {
+        for (size_t k = 0; k < li->cmds[i].n_args; ++k) {
+            len += strlen(li->cmds[i].args[k]) + 3;
+        }
+    }
+    char *text = malloc(len);
+    if (text == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    char *p = text;
+    for (size_t i = 0; i < li->n_cmds; ++i) {
+        for (size_t k = 0; k < li->cmds[i].n_args; ++k) {
+            if (p != text) {
+                *p++ = ' ';
+            }
+            p = stpcpy(p, li->cmds[i].args[k]);
+        }
+        if (i + 1 < li->n_cmds) {
+            p = stpcpy(p, " |");
+        }
+    }
+    if (li->background) {
+        p = stpcpy(p, " &");
+    }
+    *p = '\0';
+    return text;
+}
+
+/**
+ * @brief Take a free job of the table, growing the table if it is full.
+ *
+ * @param cmd The dynamically allocated text of the job, owned by the job on success.
+ * @param background A flag indicating if the job runs in the background.
+ * @return int The index of the job, or -1 on failure.
+ */
+static int job_alloc(char *cmd, bool background) {
+    if (table.free_job == -1) {
+        size_t n_jobs = table.n_jobs ? 2 * table.n_jobs : JOB_MIN_COUNT;
+        struct job *jobs = realloc(table.jobs, n_jobs * sizeof(struct job));
+        if (jobs == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        // Chained in increasing order: the first jobs get the small ids
+        for (size_t i = table.n_jobs; i < n_jobs; ++i) {
+            jobs[i].used = false;
+            jobs[i].next_free = i + 1 < n_jobs ? (int)(i + 1) : -1;
+            jobs[i].stages = NULL;
+            jobs[i].cap_stages = 0;
+        }
+        table.jobs = jobs;
+        table.free_job = table.n_jobs;
+        table.n_jobs = n_jobs;
+    }
+
+    int job = table.free_job;
+    struct job *j = &table.jobs[job];
+    table.free_job = j->next_free;
+    struct job_stage *stages = j->stages;
+    size_t cap_stages = j->cap_stages;
+    memset(j, 0, sizeof(struct job));
+    j->used = true;
+    j->background = background;
+    j->cmd = cmd;
+    j->next_free = -1;
+    // A job started in the background becomes the current job
+    if (background) {
+        j->current = ++table.current;
+    }
+    j->stages = stages;
+    j->cap_stages = cap_stages;
+    clock_gettime(CLOCK_MONOTONIC, &j->start);
+    return job;
+}
+
+/**
+ * @brief Make room for the stages of a job.
+ *
+ * @param j The job.
+ * @param n The number of stages needed.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+static int job_reserve_stages(struct job *j, size_t n) {
+    if (n <= j->cap_stages) {
+        return 0;
+    }
+    size_t cap = j->cap_stages ? j->cap_stages : JOB_MIN_STAGES;
+    while (cap < n) {
+        cap *= 2;
+    }
+    struct job_stage *stages = realloc(j->stages, cap * sizeof(struct job_stage));
+    if (stages == NULL) {
+        perror("realloc");
+        return 1;
+    }
+    for (size_t i = j->cap_stages; i < cap; ++i) {
+        stages[i].name = NULL;
+    }
+    j->stages = stages;
+    j->cap_stages = cap;
+    return 0;
+}
+
+/**
+ * @brief Create a job for a command line, taking a free job of the table.
+ *
+ * The resources used by each process of the job are kept on it: with
+ * li->time set ('time'), they are printed on the standard error when the
+ * job is over, for the whole pipeline and, with 'time -v', for each stage.
+ *
+ * @param li The parsed command line.
+ * @return int The index of the job, or -1 on failure.
+ */
+int job_create(const struct line *li) {
+    char *cmd = job_text(li);
+    if (cmd == NULL) {
+        return -1;
+    }
+    int job = job_alloc(cmd, li->background);
+    if (job == -1) {
+        free(cmd);
+        return -1;
+    }
+    struct job *j = &table.jobs[job];
+    j->time = li->time;
+    if (li->time == LINE_TIME_STAGES && job_reserve_stages(j, li->n_cmds) == 0) {
+        for (size_t i = 0; i < li->n_cmds; ++i) {
+            j->stages[i].name = strdup(li->cmds[i].n_args > 0 ? li->cmds[i].args[0] : "");
+        }
+    }
+    return job;
+}
+
+/**
+ * @brief Create a job for a single command launched by an internal command.
+ *
+ * The job is neither waited for by job_run() nor released when its process
+ * terminates: its owner polls it with job_done().
+ *
+ * @param args The arguments of the command, args[0] being the command itself.
+ * @return int The index of the job, or -1 on failure.
+ */
+int job_create_task(char **args) {
+    size_t len = 1;
+    for (size_t k = 0; args[k] != NULL; ++k) {
+        len += strlen(args[k]) + 1;
+    }
+    char *cmd = malloc(len);
+    if (cmd == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    char *p = cmd;
+    for (size_t k = 0; args[k] != NULL; ++k) {
+        if (k > 0) {
+            *p++ = ' ';
+        }
+        p = stpcpy(p, args[k]);
+    }
+    *p = '\0';
+
+    int job = job_alloc(cmd, false);
+    if (job == -1) {
+        free(cmd);
+    }
+    return job;
+}
+
+/**
+ * @brief Give a job back to the free list.
+ *
+ * @param job The index of the job.
+ */
+static void job_free(int job) {
+    struct job *j = &table.jobs[job];
+    if (j->time == LINE_TIME_STAGES) {
+        for (size_t i = 0; i < j->cap_stages; ++i) {
+            free(j->stages[i].name);
+            j->stages[i].name = NULL;
+        }
+    }
+    free(table.jobs[job].cmd);
+    table.jobs[job].cmd = NULL;
+    table.jobs[job].used = false;
+    // The free list stays sorted: the smallest free id is given first, as in sh
+    int *link = &table.free_job;
+    while (*link != -1 && *link < job) {
+        link = &table.jobs[*link].next_free;
+    }
+    table.jobs[job].next_free = *link;
+    *link = job;
+}
+
+/**
+ * @brief Get the process group that the next process of a job must join.
+ *
+ * @param job The index of the job.
+ * @return pid_t The process group of the job, 0 for a new process group
+ *               (first process), or -1 without job control.
+ */
+pid_t job_pgid(int job) {
+    if (shell_pgid == 0) {
+        return -1;
+    }
+    return table.jobs[job].pgid;
+}
+
+/**
+ * @brief Record a new stage of a job.
+ *
+ * The resources of a stage are kept as long as the job: a stage that
+ * cannot be recorded (no memory) is only missing from 'time -v'.
+ *
+ * @param j The job.
+ * @param stage The position of the stage in the pipeline.
+ * @param pid The pid of its process, or -1 for a stage without process.
+ */
+static void job_add_stage(struct job *j, size_t stage, pid_t pid) {
+    if (job_reserve_stages(j, stage + 1) != 0) {
+        return;
+    }
+    struct job_stage *st = &j->stages[stage];
+    st->pid = pid;
+    memset(&st->usage, 0, sizeof(struct rusage));
+    // A stage without process is over as soon as it is added
+    clock_gettime(CLOCK_MONOTONIC, &st->end);
+}
+
+/**
+ * @brief Add a launched process to a job.
+ *
+ * The first process of the job is the leader of its process group.
+ *
+ * @param job The index of the job.
+ * @param pid The pid of the process.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int job_add_process(int job, pid_t pid) {
+    // Keep the load factor under 1/2
+    if (2 * (table.count + 1) > table.size && proc_grow() != 0) {
+        return 1;
+    }
+
+    struct proc_entry *entry = proc_slot(pid);
+    struct job *j = &table.jobs[job];
+    entry->pid = pid;
+    entry->job = job;
+    entry->stage = j->n_stages++;
+    entry->stopped = false;
+    job_add_stage(j, entry->stage, pid);
+    table.count++;
+
+    if (j->pgid == 0) {
+        j->pgid = pid;
+    }
+    j->running++;
+    j->last_pid = pid;
+    return 0;
+}
+
+/**
+ * @brief Record the status of a stage of a job.
+ *
+ * @param j The job.
+ * @param stage The position of the process in the pipeline.
+ * @param is_last A flag indicating if the process is the last one of the job.
+ * @param status The wait status of the process.
+ */
+static void job_set_status(struct job *j, size_t stage, bool is_last, int status) {
+    if (is_last) {
+        j->status = status;
+    }
+    if (status != 0 && (!j->failed || stage > j->fail_stage)) {
+        j->failed = true;
+        j->fail_stage = stage;
+        j->fail_status = status;
+    }
+}
+
+/**
+ * @brief Add a stage without process to a job.
+ *
+ * Used for a command that could not be launched (exit code 127) and for an
+ * internal command run by the shell itself.
+ *
+ * @param job The index of the job.
+ * @param code The exit code of the stage.
+ */
+void job_add_done(int job, int code) {
+    struct job *j = &table.jobs[job];
+    j->last_pid = -1;
+    job_add_stage(j, j->n_stages, -1);
+    job_set_status(j, j->n_stages++, true, (code & 0xff) << 8);
+}
+
+/**
+ * @brief Print the state of a job, like the 'jobs' command.
+ *
+ * @param job The index of the job.
+ */
+static void job_print(int job) {
+    const struct job *j = &table.jobs[job];
+    printf("[%d]  %-8s %s\n", job + 1, j->stopped == j->running ? "Stopped" : "Running", j->cmd);
+    fflush(stdout);
+}
+
+/**
+ * @brief Get the time elapsed between two instants.
+ *
+ * @param from The first instant.
+ * @param to The second instant.
+ * @return double The number of seconds.
+ */
+static double job_elapsed(const struct timespec *from, const struct timespec *to) {
+    return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+/**
+ * @brief Convert a CPU time to seconds.
+ *
+ * @param tv The CPU time.
+ * @return double The number of seconds.
+ */
+static double job_seconds(const struct timeval *tv) {
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+/**
+ * @brief Add the resources used by a process to the ones of a job.
+ *
+ * @param sum The resources of the job: the times and the counters are
+ *            summed, the maximum resident set size is the largest one.
+ * @param ru The resources of the process.
+ */
+static void job_add_usage(struct rusage *sum, const struct rusage *ru) {
+    timeradd(&sum->ru_utime, &ru->ru_utime, &sum->ru_utime);
+    timeradd(&sum->ru_stime, &ru->ru_stime, &sum->ru_stime);
+    if (ru->ru_maxrss > sum->ru_maxrss) {
+        sum->ru_maxrss = ru->ru_maxrss;
+    }
+    sum->ru_minflt += ru->ru_minflt;
+    sum->ru_majflt += ru->ru_majflt;
+    sum->ru_inblock += ru->ru_inblock;
+    sum->ru_oublock += ru->ru_oublock;
+    sum->ru_nvcsw += ru->ru_nvcsw;
+    sum->ru_nivcsw += ru->ru_nivcsw;
+}
+
+/**
+ * @brief Print the resources used by a command, on the standard error.
+ *
+ * @param label The text printed before the resources.
+ * @param real The wall clock time, in seconds.
+ * @param ru The resources used (ctxsw: voluntary+involuntary, faults: major+minor).
+ */
+static void job_print_usage(const char *label, double real, const struct rusage *ru) {
+    double user = job_seconds(&ru->ru_utime);
+    double sys = job_seconds(&ru->ru_stime);
+    // The CPU times are counted in ticks: under 1 ms, their ratio to the wall time means nothing
+    char cpu[16] = "-";
+    if (real >= 0.001) {
+        snprintf(cpu, sizeof(cpu), "%.0f%%", 100 * (user + sys) / real);
+    }
+    fprintf(stderr, "%sreal %.3fs  user %.3fs  sys %.3fs  cpu %s  maxrss %ldk  ctxsw %ld+%ld  faults %ld+%ld\n",
+            label, real, user, sys, cpu, ru->ru_maxrss, ru->ru_nvcsw, ru->ru_nivcsw, ru->ru_majflt, ru->ru_minflt);
+}
+
+/**
+ * @brief Print the resources used by a job that is over ('time').
+ *
+ * With 'time -v', each stage comes first, with the time from the start of
+ * the job to its end: the slowest stage of a pipeline is the one ending last
+ * with the most CPU time, the others wait for it.
+ *
+ * @param j The job.
+ */
+static void job_report(const struct job *j) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (j->time == LINE_TIME_STAGES) {
+        for (size_t i = 0; i < j->n_stages && i < j->cap_stages; ++i) {
+            const struct job_stage *st = &j->stages[i];
+            char label[64];
+            snprintf(label, sizeof(label), "%3zu %-12.12s ", i + 1, st->name != NULL ? st->name : "?");
+            job_print_usage(label, job_elapsed(&j->start, &st->end), &st->usage);
+        }
+    }
+    job_print_usage(j->time == LINE_TIME_STAGES ? "    total        " : "", job_elapsed(&j->start, &now), &j->usage);
+    fflush(stderr);
+}
+
+/**
+ * @brief Start measuring the resources used by the shell itself.
+ *
+ * Used by 'time' on an internal command run without process.
+ *
+ * @param self Receives the current time and resources of the shell.
+ */
+void job_self_start(struct job_self *self) {
+    clock_gettime(CLOCK_MONOTONIC, &self->start);
+    getrusage(RUSAGE_SELF, &self->usage);
+}
+
+/**
+ * @brief Print the resources used by the shell since job_self_start().
+ *
+ * @param self The time and resources at the start.
+ */
+void job_self_report(const struct job_self *self) {
+    struct timespec now;
+    struct rusage ru;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    getrusage(RUSAGE_SELF, &ru);
+    // The counters are the differences; maxrss is the one of the shell
+    timersub(&ru.ru_utime, &self->usage.ru_utime, &ru.ru_utime);
+    timersub(&ru.ru_stime, &self->usage.ru_stime, &ru.ru_stime);
+    ru.ru_minflt -= self->usage.ru_minflt;
+    ru.ru_majflt -= self->usage.ru_majflt;
+    ru.ru_inblock -= self->usage.ru_inblock;
+    ru.ru_oublock -= self->usage.ru_oublock;
+    ru.ru_nvcsw -= self->usage.ru_nvcsw;
+    ru.ru_nivcsw -= self->usage.ru_nivcsw;
+    job_print_usage("", job_elapsed(&self->start, &now), &ru);
+    fflush(stderr);
+}
+
+/**
+ * @brief Record a change of state of a child, as reported by wait4().
+ *
+ * The process is found in the job table in O(1). A terminated process is
+ * reported and removed, its resources are added to its job, and its job is
+ * released with its last process if it runs in the background.
+ *
+ * @param pid The pid of the child.
+ * @param status The wait status of the child.
+ * @param ru The resources used by the child, when it terminated.
+ */
+static void job_update(pid_t pid, int status, const struct rusage *ru) {
+    if (table.size == 0) {
+        return;
+    }
+    struct proc_entry *entry = proc_slot(pid);
+    if (entry->pid == 0) {
+        // Not launched as a job
+        return;
+    }
+    int job = entry->job;
+    struct job *j = &table.jobs[job];
+
+    if (WIFSTOPPED(status)) {
+        if (!entry->stopped) {
+            entry->stopped = true;
+            j->stopped++;
+            // A stopped job becomes the current job
+            if (j->stopped == j->running) {
+                j->current = ++table.current;
+            }
+            if (j->background && j->stopped == j->running && shell_interactive) {
+                printf("\n");
+                job_print(job);
+            }
+        }
+        return;
+    }
+    if (WIFCONTINUED(status)) {
+        if (entry->stopped) {
+            entry->stopped = false;
+            j->stopped--;
+        }
+        return;
+    }
+
+    if (entry->stopped) {
+        j->stopped--;
+    }
+    job_set_status(j, entry->stage, pid == j->last_pid, status);
+    job_add_usage(&j->usage, ru);
+    if (entry->stage < j->cap_stages) {
+        struct job_stage *st = &j->stages[entry->stage];
+        st->usage = *ru;
+        clock_gettime(CLOCK_MONOTONIC, &st->end);
+    }
+    proc_remove(entry);
+
+    print_process_status(pid, status, j->background);
+    j->running--;
+    if (j->running == 0 && j->background) {
+        if (j->time) {
+            job_report(j);
+        }
+        job_free(job);
+    }
+}
+
+/**
+ * @brief Reap all the terminated children.
+ *
+ * Nothing is done if no SIGCHLD arrived since the last call. Otherwise the
+ * self-pipe is drained and the children are collected by a single sweep of
+ * wait4(-1, WNOHANG), which also gives the resources used by each of them.
+ * Each pid is found in the job table in O(1), its status is printed and its
+ * job is released when its last process is reaped.
+ * The stopped and continued processes are recorded too.
+ */
+void job_reap() {
+    if (!sigchld_pending) {
+        return;
+    }
+    sigchld_pending = 0;
+    char drain[256];
+    while (read(signal_pipe[0], drain, sizeof(drain)) > 0) {
+    }
+
+    for (;;) {
+        int status;
+        struct rusage ru;
+        pid_t pid = wait4(-1, &status, WUNTRACED | WCONTINUED | WNOHANG, &ru);
+        if (pid == -1) {
+            if (errno != ECHILD) {
+                perror("wait4");
+            }
+            return;
+        }
+        if (pid == 0) {
+            // Some children are still running
+            return;
+        }
+        job_update(pid, status, &ru);
+    }
+}
+
+/**
+ * @brief Sleep until a child changes state, then reap it.
+ *
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int job_sleep() {
+    struct pollfd pfd = { signal_pipe[0], POLLIN, 0 };
+    if (poll(&pfd, 1, -1) == -1 && errno != EINTR) {
+        perror("poll");
+        return 1;
+    }
+    job_reap();
+    return 0;
+}
+
+/**
+ * @brief Get the exit code of a job, like $? in a shell.
+ *
+ * It is the status of the last stage of the pipeline, or with the pipefail
+ * option, the status of the last stage that failed.
+ *
+ * @param j The job.
+ * @return int The exit code: the exit status, or 128 + the number of the signal.
+ */
+static int job_exit_code(const struct job *j) {
+    if (j->running > 0) {
+        // Stopped
+        return 128 + SIGTSTP;
+    }
+    int status = shell_pipefail && j->failed ? j->fail_status : j->status;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+/**
+ * @brief Wait for a foreground job to terminate or to be stopped.
+ *
+ * With job control, the terminal is given to the process group of the job
+ * and taken back afterwards, and the shell blocks in wait4(-pgid) on the
+ * group of the job: all the stages are reaped as they terminate, and the
+ * background children are left to job_reap(). Without job control, the shell
+ * sleeps in poll() on the self-pipe and reaps all its children.
+ * A stopped job goes on in the background.
+ *
+ * @param job The index of the job.
+ */
+static void job_wait(int job) {
+    struct job *j = &table.jobs[job];
+    bool failed = false;
+
+    if (shell_pgid != 0) {
+        tcsetpgrp(STDIN_FILENO, j->pgid);
+        while (j->running > 0 && j->stopped < j->running) {
+            int status;
+            struct rusage ru;
+            pid_t pid = wait4(-j->pgid, &status, WUNTRACED, &ru);
+            if (pid == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                perror("wait4");
+                failed = true;
+                break;
+            }
+            job_update(pid, status, &ru);
+        }
+        tcsetpgrp(STDIN_FILENO, shell_pgid);
+    } else {
+        job_reap();
+        while (j->running > 0 && j->stopped < j->running) {
+            if (job_sleep() != 0) {
+                failed = true;
+                break;
+            }
+        }
+    }
+
+    if (failed) {
+        // Stop waiting: the job is reaped later, like a background job
+        j->background = true;
+    } else if (j->running > 0) {
+        // Stopped (Ctrl-Z): the job goes on in the background, stopped
+        j->background = true;
+        printf("\n");
+        job_print(job);
+    }
+}
+
+/**
+ * @brief Get the exit code of a job that was waited for, and release it if it is over.
+ *
+ * @param job The index of the job.
+ * @return int The exit code of the job.
+ */
+static int job_finish(int job) {
+    int code = job_exit_code(&table.jobs[job]);
+    if (table.jobs[job].running == 0) {
+        if (table.jobs[job].time) {
+            job_report(&table.jobs[job]);
+        }
+        job_free(job);
+    }
+    return code;
+}
+
+/**
+ * @brief Check if a job created by job_create_task() is over.
+ *
+ * A terminated job is released, and its exit code is given. A stopped job
+ * (Ctrl-Z) is over too: it goes on in the background, like in job_wait().
+ *
+ * @param job The index of the job.
+ * @param code Receives the exit code of the job when it is over.
+ * @return bool Returns true if the job terminated or was stopped.
+ */
+bool job_done(int job, int *code) {
+    struct job *j = &table.jobs[job];
+    if (j->running > 0 && j->stopped < j->running) {
+        return false;
+    }
+    if (j->running > 0) {
+        j->background = true;
+    }
+    *code = job_finish(job);
+    return true;
+}
+
+/**
+ * @brief Run a job once all its processes are launched.
+ *
+ * A foreground job is waited for. The id and the process group of a
+ * background job are printed when the shell is interactive.
+ * A job without any running process is released.
+ *
+ * @param job The index of the job.
+ * @return int The exit code of the job (0 for a background job).
+ */
+int job_run(int job) {
+    struct job *j = &table.jobs[job];
+    if (j->running > 0 && j->background) {
+        if (shell_interactive) {
+            printf("[%d] %d\n", job + 1, j->pgid);
+            fflush(stdout);
+        }
+        return 0;
+    }
+    if (j->running > 0) {
+        job_wait(job);
+    }
+    return job_finish(job);
+}
+
+/**
+ * @brief Find the job designated by an argument of fg, bg or wait.
+ *
+ * "%n" is the job of id n, a number is the pid of one of its processes.
+ * Without argument, the current job is chosen, like '%+' in sh: the last job
+ * started in the background or stopped.
+ *
+ * @param name The name of the builtin, for the error messages.
+ * @param arg The argument, or NULL.
+ * @return int The index of the job, or -1 if there is no such job.
+ */
+static int job_find(const char *name, const char *arg) {
+    if (arg == NULL) {
+        int job = -1;
+        for (size_t i = 0; i < table.n_jobs; ++i) {
+            const struct job *j = &table.jobs[i];
+            if (j->used && j->background && (job == -1 || j->current > table.jobs[job].current)) {
+                job = i;
+            }
+        }
+        if (job == -1) {
+            fprintf(stderr, "%s: no current job\n", name);
+        }
+        return job;
+    }
+
+    char *end;
+    long n = strtol(arg[0] == '%' ? arg + 1 : arg, &end, 10);
+    if (*end == '\0' && n > 0) {
+        if (arg[0] == '%') {
+            if ((size_t)n <= table.n_jobs && table.jobs[n - 1].used && table.jobs[n - 1].background) {
+                return n - 1;
+            }
+        } else if (table.size != 0) {
+            struct proc_entry *entry = proc_slot(n);
+            if (entry->pid != 0) {
+                return entry->job;
+            }
+        }
+    }
+    fprintf(stderr, "%s: %s: no such job\n", name, arg);
+    return -1;
+}
+
+/**
+ * @brief Let the stopped processes of a job go on.
+ *
+ * @param job The index of the job.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+static int job_continue(int job) {
+    struct job *j = &table.jobs[job];
+    if (j->stopped == 0) {
+        return 0;
+    }
+    if (kill(-j->pgid, SIGCONT) == -1) {
+        perror("kill");
+        return 1;
+    }
+    // The processes are running again: job_wait() must not see them as stopped
+    for (size_t i = 0; i < table.size; ++i) {
+        if (table.procs[i].pid != 0 && table.procs[i].job == job) {
+            table.procs[i].stopped = false;
+        }
+    }
+    j->stopped = 0;
+    return 0;
+}
+
+/**
+ * @brief List the background jobs.
+ *
+ * This function implements the 'jobs' command for the shell.
+ *
+ * @param args Array of arguments where args[0] is "jobs".
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int execute_command_intern_jobs(char **args) {
+    if (args[1] != NULL) {
+        fprintf(stderr, "jobs: too many arguments\n");
+        return 1;
+    }
+    job_reap();
+    for (size_t i = 0; i < table.n_jobs; ++i) {
+        if (table.jobs[i].used && table.jobs[i].background) {
+            job_print(i);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Bring a background job to the foreground.
+ *
+ * This function implements the 'fg' command for the shell: 'fg' or 'fg %n'.
+ * Without argument, it takes the current job: the last one started in the
+ * background or stopped. A stopped job is continued, and the shell waits for it.
+ *
+ * @param args Array of arguments where args[0] is "fg".
+ * @return int Returns the exit status of the job, or 1 on failure.
+ */
+int execute_command_intern_fg(char **args) {
+    if (shell_pgid == 0) {
+        fprintf(stderr, "fg: no job control\n");
+        return 1;
+    }
+    if (args[1] != NULL && args[2] != NULL) {
+        fprintf(stderr, "fg: too many arguments\n");
+        return 1;
+    }
+    int job = job_find("fg", args[1]);
+    if (job == -1) {
+        return 1;
+    }
+    struct job *j = &table.jobs[job];
+    printf("%s\n", j->cmd);
+    fflush(stdout);
+
+    // The terminal is given to the job before it goes on
+    j->background = false;
+    tcsetpgrp(STDIN_FILENO, j->pgid);
+    if (job_continue(job) != 0) {
+        tcsetpgrp(STDIN_FILENO, shell_pgid);
+        j->background = true;
+        return 1;
+    }
+    job_wait(job);
+    return job_finish(job);
+}
+
+/**
+ * @brief Continue a stopped job in the background.
+ *
+ * This function implements the 'bg' command for the shell: 'bg' or 'bg %n'.
+ * Without argument, it takes the current job, like 'fg'.
+ *
+ * @param args Array of arguments where args[0] is "bg".
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int execute_command_intern_bg(char **args) {
+    if (shell_pgid == 0) {
+        fprintf(stderr, "bg: no job control\n");
+        return 1;
+    }
+    if (args[1] != NULL && args[2] != NULL) {
+        fprintf(stderr, "bg: too many arguments\n");
+        return 1;
+    }
+    int job = job_find("bg", args[1]);
+    if (job == -1) {
+        return 1;
+    }
+    if (job_continue(job) != 0) {
+        return 1;
+    }
+    printf("[%d]  %s\n", job + 1, table.jobs[job].cmd);
+    fflush(stdout);
+    return 0;
+}
+
+/**
+ * @brief Wait for background jobs.
+ *
+ * This function implements the 'wait' command for the shell: 'wait' waits
+ * for all the background jobs, 'wait %n' or 'wait pid' for one of them.
+ * The stopped jobs are not waited for.
+ *
+ * @param args Array of arguments where args[0] is "wait".
+ * @return int Returns the exit status of the last job waited for, or 1 on failure.
+ */
+int execute_command_intern_wait(char **args) {
+    job_reap();
+    if (args[1] == NULL) {
+        for (;;) {
+            bool waiting = false;
+            for (size_t i = 0; i < table.n_jobs && !waiting; ++i) {
+                struct job *j = &table.jobs[i];
+                waiting = j->used && j->background && j->stopped < j->running;
+            }
+            if (!waiting) {
+                return 0;
+            }
+            if (job_sleep() != 0) {
+                return 1;
+            }
+        }
+    }
+
+    int ret = 0;
+    for (size_t k = 1; args[k] != NULL; ++k) {
+        int job = job_find("wait", args[k]);
+        if (job == -1) {
+            ret = 1;
+            continue;
+        }
+        // Waited for like a foreground job: the reaping does not release it,
+        // its exit code is read first
+        struct job *j = &table.jobs[job];
+        j->background = false;
+        int err = 0;
+        while (err == 0 && j->stopped < j->running) {
+            err = job_sleep();
+        }
+        if (j->running > 0) {
+            j->background = true;
+        }
+        if (err != 0) {
+            return 1;
+        }
+        ret = job_finish(job);
+    }
+    return ret;
+}
@@ -0,0 +1,210 @@
+#ifndef JOB_CMD_H
+#define JOB_CMD_H
+
+#include <stdbool.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#include "cmdline.h"
+
+/**
+ * @brief The time and the resources of the shell at some point ('time' on an internal command).
+ */
+struct job_self {
+    struct timespec start;
+    struct rusage usage;
+};
+
+/**
+ * @brief Install the SIGCHLD handler and create the self-pipe it writes to.
+ *
+ * The handler only sets a flag and writes one byte in the pipe: the children
+ * are reaped later by job_reap(), outside of the signal handler.
+ * When the shell is interactive, job control is enabled: the shell leads its
+ * own process group, owns the terminal and ignores SIGTSTP, SIGTTIN and SIGTTOU.
+ *
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int job_init();
+
+/**
+ * @brief Prepare the job control of a child process running an internal command.
+ *
+ * The child gets its own self-pipe: the one inherited from the shell is
+ * shared with it, and each process could drain the wake ups of the other.
+ * Job control stays with the shell: the child does not touch the terminal.
+ *
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int job_subshell();
+
+/**
+ * @brief Get the read end of the self-pipe.
+ *
+ * It becomes readable when a child has terminated: an event loop can poll()
+ * it together with its input, and call job_reap() when it is readable.
+ *
+ * @return int The file descriptor (close-on-exec and non-blocking).
+ */
+int job_signal_fd();
+
+/**
+ * @brief Create a job for a command line, taking a free job of the table.
+ *
+ * The resources used by each process of the job are kept on it: with
+ * li->time set ('time'), they are printed on the standard error when the
+ * job is over, for the whole pipeline and, with 'time -v', for each stage.
+ *
+ * @param li The parsed command line.
+ * @return int The index of the job, or -1 on failure.
+ */
+int job_create(const struct line *li);
+
+/**
+ * @brief Create a job for a single command launched by an internal command.
+ *
+ * The job is neither waited for by job_run() nor released when its process
+ * terminates: its owner polls it with job_done().
+ *
+ * @param args The arguments of the command, args[0] being the command itself.
+ * @return int The index of the job, or -1 on failure.
+ */
+int job_create_task(char **args);
+
+/**
+ * @brief Check if a job created by job_create_task() is over.
+ *
+ * A terminated job is released, and its exit code is given. A stopped job
+ * (Ctrl-Z) is over too: it goes on in the background, like in job_wait().
+ *
+ * @param job The index of the job.
+ * @param code Receives the exit code of the job when it is over.
+ * @return bool Returns true if the job terminated or was stopped.
+ */
+bool job_done(int job, int *code);
+
+/**
+ * @brief Get the process group that the next process of a job must join.
+ *
+ * @param job The index of the job.
+ * @return pid_t The process group of the job, 0 for a new process group
+ *               (first process), or -1 without job control.
+ */
+pid_t job_pgid(int job);
+
+/**
+ * @brief Add a launched process to a job.
+ *
+ * The first process of the job is the leader of its process group.
+ *
+ * @param job The index of the job.
+ * @param pid The pid of the process.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int job_add_process(int job, pid_t pid);
+
+/**
+ * @brief Add a stage without process to a job.
+ *
+ * Used for a command that could not be launched (exit code 127) and for an
+ * internal command run by the shell itself.
+ *
+ * @param job The index of the job.
+ * @param code The exit code of the stage.
+ */
+void job_add_done(int job, int code);
+
+/**
+ * @brief Run a job once all its processes are launched.
+ *
+ * A foreground job is waited for. The id and the process group of a
+ * background job are printed when the shell is interactive.
+ * A job without any running process is released.
+ *
+ * @param job The index of the job.
+ * @return int The exit code of the job (0 for a background job).
+ */
+int job_run(int job);
+
+/**
+ * @brief Reap all the terminated children.
+ *
+ * Nothing is done if no SIGCHLD arrived since the last call. Otherwise the
+ * self-pipe is drained and the children are collected by a single sweep of
+ * wait4(-1, WNOHANG), which also gives the resources used by each of them.
+ * Each pid is found in the job table in O(1), its status is printed and its
+ * job is released when its last process is reaped.
+ * The stopped and continued processes are recorded too.
+ */
+void job_reap();
+
+/**
+ * @brief Sleep until a child changes state, then reap it.
+ *
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int job_sleep();
+
+/**
+ * @brief Start measuring the resources used by the shell itself.
+ *
+ * Used by 'time' on an internal command run without process.
+ *
+ * @param self Receives the current time and resources of the shell.
+ */
+void job_self_start(struct job_self *self);
+
+/**
+ * @brief Print the resources used by the shell since job_self_start().
+ *
+ * @param self The time and resources at the start.
+ */
+void job_self_report(const struct job_self *self);
+
+/**
+ * @brief List the background jobs.
+ *
+ * This function implements the 'jobs' command for the shell.
+ *
+ * @param args Array of arguments where args[0] is "jobs".
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int execute_command_intern_jobs(char **args);
+
+/**
+ * @brief Bring a background job to the foreground.
+ *
+ * This function implements the 'fg' command for the shell: 'fg' or 'fg %n'.
+ * Without argument, it takes the current job: the last one started in the
+ * background or stopped. A stopped job is continued, and the shell waits for it.
+ *
+ * @param args Array of arguments where args[0] is "fg".
+ * @return int Returns the exit status of the job, or 1 on failure.
+ */
+int execute_command_intern_fg(char **args);
+
+/**
+ * @brief Continue a stopped job in the background.
+ *
+ * This function implements the 'bg' command for the shell: 'bg' or 'bg %n'.
+ * Without argument, it takes the current job, like 'fg'.
+ *
+ * @param args Array of arguments where args[0] is "bg".
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int execute_command_intern_bg(char **args);
+
+/**
+ * @brief Wait for background jobs.
+ *
+ * This function implements the 'wait' command for the shell: 'wait' waits
+ * for all the background jobs, 'wait %n' or 'wait pid' for one of them.
+ * The stopped jobs are not waited for.
+ *
+ * @param args Array of arguments where args[0] is "wait".
+ * @return int Returns the exit status of the last job waited for, or 1 on failure.
+ */
+int execute_command_intern_wait(char **args);
+
+#endif /* JOB_CMD_H */
@@ -0,0 +1,414 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+
+#include "spawn_cmd/spawn_cmd.h"
+#include "job_cmd/job_cmd.h"
+#include "parallel_cmd.h"
+
+#define PARALLEL_MAX_JOBS 1024
+#define PARALLEL_BUFLEN 65536
+#define PARALLEL_USAGE "Usage: parallel [-j jobs] [-a file] command [args...] [::: words...]\n"
+
+/**
+ * @brief One worker: a command running, and the files keeping its output.
+ *
+ * The memory files are reused by the successive commands of the worker.
+ */
+struct parallel_slot {
+    int job; // job of the running command, -1 if the worker is idle
+    int out; // memory file receiving the standard output of the command
+    int err; // memory file receiving the standard error of the command
+};
+
+/**
+ * @brief The arguments to give to the commands, read one at a time.
+ */
+struct parallel_source {
+    char **words; // the words after ":::", or NULL to read the lines of "file"
+    FILE *file;
+    char *line;
+    size_t cap;
+};
+
+/**
+ * @brief Get the next argument.
+ *
+ * The lines are read only when a worker is idle: the whole input is never
+ * kept in memory. The empty lines are skipped.
+ *
+ * @param src The source of the arguments.
+ * @return const char* The argument (valid until the next call), or NULL at the end.
+ */
+static const char *parallel_next(struct parallel_source *src) {
+    if (src->words != NULL) {
+        return *src->words != NULL ? *src->words++ : NULL;
+    }
+    ssize_t len;
+    while ((len = getline(&src->line, &src->cap, src->file)) != -1) {
+        if (len > 0 && src->line[len - 1] == '\n') {
+            src->line[--len] = '\0';
+        }
+        if (len > 0) {
+            return src->line;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Replace each "{}" of a word by an argument.
+ *
+ * @param word The word of the command.
+ * @param arg The argument.
+ * @return char* The dynamically allocated word, or NULL on failure.
+ */
+static char *parallel_subst(const char *word, const char *arg) {
+    size_t n = 0;
+    for (const char *p = strstr(word, "{}"); p != NULL; p = strstr(p + 2, "{}")) {
+        n++;
+    }
+    size_t arg_len = strlen(arg);
+    char *res = malloc(strlen(word) - 2 * n + n * arg_len + 1);
+    if (res == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+
+    char *q = res;
+    const char *p;
+    while ((p = strstr(word, "{}")) != NULL) {
+        memcpy(q, word, p - word);
+        q += p - word;
+        memcpy(q, arg, arg_len);
+        q += arg_len;
+        word = p + 2;
+    }
+    strcpy(q, word);
+    return res;
+}
+
+/**
+ * @brief Release the arguments of a command.
+ *
+ * @param args The NULL-terminated array of arguments.
+ */
+static void parallel_free_args(char **args) {
+    for (size_t k = 0; args[k] != NULL; ++k) {
+        free(args[k]);
+    }
+    free(args);
+}
+
+/**
+ * @brief Build the command of an argument from the template.
+ *
+ * @param tpl The NULL-terminated words of the command.
+ * @param arg The argument.
+ * @param append A flag indicating if the argument is appended (no "{}" in the template).
+ * @return char** The dynamically allocated arguments, or NULL on failure.
+ */
+static char **parallel_args(char **tpl, const char *arg, bool append) {
+    size_t n = 0;
+    while (tpl[n] != NULL) {
+        n++;
+    }
+    char **args = calloc(n + 2, sizeof(char *));
+    if (args == NULL) {
+        perror("calloc");
+        return NULL;
+    }
+    for (size_t k = 0; k < n; ++k) {
+        args[k] = parallel_subst(tpl[k], arg);
+        if (args[k] == NULL) {
+            parallel_free_args(args);
+            return NULL;
+        }
+    }
+    if (append && (args[n] = strdup(arg)) == NULL) {
+        perror("strdup");
+        parallel_free_args(args);
+        return NULL;
+    }
+    return args;
+}
+
+/**
+ * @brief Launch a command on an idle worker.
+ *
+ * The command reads /dev/null (the arguments may come from the standard
+ * input) and writes in the memory files of the worker. It stays in the
+ * process group of the shell: Ctrl-C reaches it like a foreground command.
+ *
+ * @param slot The worker.
+ * @param args The arguments of the command.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+static int parallel_launch(struct parallel_slot *slot, char **args) {
+    int job = job_create_task(args);
+    if (job == -1) {
+        return 1;
+    }
+
+    struct spawn_req req;
+    spawn_req_init(&req, args, false);
+    req.pgroup = -1;
+    pid_t pid = -1;
+    if (spawn_add_open(&req, STDIN_FILENO, "/dev/null", O_RDONLY, 0) == 0
+        && spawn_add_dup2(&req, slot->out, STDOUT_FILENO) == 0
+        && spawn_add_dup2(&req, slot->err, STDERR_FILENO) == 0) {
+        pid = spawn_process(&req);
+    }
+    spawn_req_reset(&req);
+    // If the process could not be launched, the error has already been printed
+    if (pid != -1) {
+        job_add_process(job, pid);
+    } else {
+        job_add_done(job, 127);
+    }
+    slot->job = job;
+    return 0;
+}
+
+/**
+ * @brief Copy the content of a memory file to a file descriptor, then empty it.
+ *
+ * @param src The memory file.
+ * @param fd The file descriptor receiving the content.
+ */
+static void parallel_flush(int src, int fd) {
+    char buf[PARALLEL_BUFLEN];
+    ssize_t n;
+    lseek(src, 0, SEEK_SET);
+    while ((n = read(src, buf, sizeof(buf))) > 0) {
+        for (ssize_t done = 0; done < n;) {
+            ssize_t w = write(fd, buf + done, n - done);
+            if (w == -1) {
+                perror("write");
+                break;
+            }
+            done += w;
+        }
+    }
+    if (ftruncate(src, 0) == -1 || lseek(src, 0, SEEK_SET) == -1) {
+        perror("memfd");
+    }
+}
+
+/**
+ * @brief Read the options of the command.
+ *
+ * The value of an option is the next word ('-j 4') or is attached to it
+ * ('-j4'). An unknown option is a usage error.
+ *
+ * @param args Array of arguments where args[0] is "parallel".
+ * @param n_jobs Receives the number of workers.
+ * @param file Receives the file given by -a, or NULL.
+ * @return int The index of the first word of the command, or -1 on error.
+ */
+static int parallel_options(char **args, long *n_jobs, const char **file) {
+    *n_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (*n_jobs < 1) {
+        *n_jobs = 1;
+    }
+    *file = NULL;
+
+    int i = 1;
+    while (args[i] != NULL && args[i][0] == '-') {
+        char opt = args[i][1];
+        if (opt != 'j' && opt != 'a') {
+            fprintf(stderr, "parallel: %s: unknown option\n" PARALLEL_USAGE, args[i]);
+            return -1;
+        }
+        const char *value = args[i][2] != '\0' ? args[i] + 2 : args[i + 1];
+        if (value == NULL) {
+            fprintf(stderr, "parallel: %s: missing argument\n", args[i]);
+            return -1;
+        }
+        i += args[i][2] != '\0' ? 1 : 2;
+        if (opt == 'a') {
+            *file = value;
+        } else {
+            char *end;
+            *n_jobs = strtol(value, &end, 10);
+            if (*value == '\0' || *end != '\0' || *n_jobs < 1 || *n_jobs > PARALLEL_MAX_JOBS) {
+                fprintf(stderr, "parallel: %s: invalid number of jobs\n", value);
+                return -1;
+            }
+        }
+    }
+    if (args[i] == NULL || strcmp(args[i], ":::") == 0) {
+        fputs(PARALLEL_USAGE, stderr);
+        return -1;
+    }
+    return i;
+}
+
+/**
+ * @brief Run a command once per argument, several at a time.
+ *
+ * This function implements the 'parallel' command for the shell:
+ * 'parallel [-j jobs] [-a file] command [args...] [::: words...]'.
+ * Each "{}" in the command is replaced by the argument, which is appended
+ * to the command if there is no "{}". The arguments are the words after
+ * ":::", or the lines of the file given by -a, or the lines of the standard
+ * input. At most "jobs" commands run at the same time (the number of
+ * processors by default): each one that terminates is replaced by the
+ * command of the next argument. The output of a command is kept until it
+ * terminates, then written in one piece: the outputs are never mixed.
+ *
+ * @param args Array of arguments where args[0] is "parallel".
+ * @return int Returns 0 if all the commands succeeded, 130 if they were
+ *             interrupted by Ctrl-C, or 1 otherwise.
+ */
+int execute_command_intern_parallel(char **args) {
+    long n_jobs;
+    const char *file;
+    int first = parallel_options(args, &n_jobs, &file);
+    if (first == -1) {
+        return 1;
+    }
+
+    // The template ends at ":::", which is replaced by NULL while the command runs
+    char **tpl = &args[first];
+    char **sep = tpl;
+    while (*sep != NULL && strcmp(*sep, ":::") != 0) {
+        sep++;
+    }
+    bool append = true;
+    for (char **w = tpl; w != sep; ++w) {
+        if (strstr(*w, "{}") != NULL) {
+            append = false;
+        }
+    }
+
+    struct parallel_source src = { NULL, NULL, NULL, 0 };
+    if (*sep != NULL) {
+        src.words = sep + 1;
+    } else if (file != NULL) {
+        src.file = fopen(file, "r");
+        if (src.file == NULL) {
+            perror(file);
+            return 1;
+        }
+    } else {
+        // The stream of the shell stays open: read a duplicate of it
+        spawn_sync_input();
+        int fd = dup(STDIN_FILENO);
+        src.file = fd != -1 ? fdopen(fd, "r") : NULL;
+        if (src.file == NULL) {
+            perror("parallel");
+            if (fd != -1) {
+                close(fd);
+            }
+            return 1;
+        }
+    }
+
+    struct parallel_slot *slots = calloc(n_jobs, sizeof(struct parallel_slot));
+    if (slots == NULL) {
+        perror("calloc");
+        if (src.file != NULL) {
+            fclose(src.file);
+        }
+        return 1;
+    }
+    char *saved_sep = *sep;
+    *sep = NULL;
+
+    // The next argument goes to the first idle worker: a long command never
+    // holds back the others, and at most n_jobs commands are in flight
+    bool failed = false;
+    bool stop = false;
+    int interrupted = 0;
+    long running = 0;
+    long n_slots = 0;
+    for (;;) {
+        for (long s = 0; s < n_jobs && !stop && running < n_jobs; ++s) {
+            if (s < n_slots && slots[s].job != -1) {
+                continue;
+            }
+            const char *arg = parallel_next(&src);
+            if (arg == NULL) {
+                stop = true;
+                break;
+            }
+            if (s == n_slots) {
+                // The memory files of a worker are created with its first command
+                slots[s].out = memfd_create("parallel-out", MFD_CLOEXEC);
+                slots[s].err = memfd_create("parallel-err", MFD_CLOEXEC);
+                n_slots++;
+                if (slots[s].out == -1 || slots[s].err == -1) {
+                    perror("memfd_create");
+                    slots[s].job = -1;
+                    failed = stop = true;
+                    break;
+                }
+            }
+            char **cmd = parallel_args(tpl, arg, append);
+            if (cmd == NULL || parallel_launch(&slots[s], cmd) != 0) {
+                slots[s].job = -1;
+                failed = stop = true;
+            } else {
+                running++;
+            }
+            if (cmd != NULL) {
+                parallel_free_args(cmd);
+            }
+        }
+        if (running == 0) {
+            break;
+        }
+
+        // A command that could not be launched is already over: no need to sleep
+        long done = 0;
+        for (long s = 0; s < n_slots; ++s) {
+            int code;
+            if (slots[s].job == -1 || !job_done(slots[s].job, &code)) {
+                continue;
+            }
+            slots[s].job = -1;
+            running--;
+            done++;
+            fflush(stdout);
+            parallel_flush(slots[s].out, STDOUT_FILENO);
+            parallel_flush(slots[s].err, STDERR_FILENO);
+            if (code == 128 + SIGINT || code == 128 + SIGTSTP) {
+                // Ctrl-C or Ctrl-Z: no new command, the status tells why
+                stop = true;
+                interrupted = code;
+            } else if (code != 0) {
+                failed = true;
+            }
+        }
+        if (done == 0 && job_sleep() != 0) {
+            failed = true;
+            break;
+        }
+    }
+
+    *sep = saved_sep;
+    for (long s = 0; s < n_slots; ++s) {
+        if (slots[s].out != -1) {
+            close(slots[s].out);
+        }
+        if (slots[s].err != -1) {
+            close(slots[s].err);
+        }
+    }
+    free(slots);
+    free(src.line);
+    if (src.file != NULL) {
+        fclose(src.file);
+    }
+    if (interrupted != 0) {
+        return interrupted;
+    }
+    return failed ? 1 : 0;
+}
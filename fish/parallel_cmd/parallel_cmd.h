@@ -0,0 +1,23 @@
+#ifndef PARALLEL_CMD_H
+#define PARALLEL_CMD_H
+
+/**
+ * @brief Run a command once per argument, several at a time.
+ *
+ * This function implements the 'parallel' command for the shell:
+ * 'parallel [-j jobs] [-a file] command [args...] [::: words...]'.
+ * Each "{}" in the command is replaced by the argument, which is appended
+ * to the command if there is no "{}". The arguments are the words after
+ * ":::", or the lines of the file given by -a, or the lines of the standard
+ * input. At most "jobs" commands run at the same time (the number of
+ * processors by default): each one that terminates is replaced by the
+ * command of the next argument. The output of a command is kept until it
+ * terminates, then written in one piece: the outputs are never mixed.
+ *
+ * @param args Array of arguments where args[0] is "parallel".
+ * @return int Returns 0 if all the commands succeeded, 130 if they were
+ *             interrupted by Ctrl-C, or 1 otherwise.
+ */
+int execute_command_intern_parallel(char **args);
+
+#endif /* PARALLEL_CMD_H */
@@ -3,10 +3,17 @@
 #include <unistd.h>
 #include <string.h>
 #include <signal.h>
+#include <fcntl.h>
 
 #include "cmdline.h"
 #include "util.h"
 #include "execute_cmd/execute_cmd.h"
+#include "pipe_cmd/pipe_cmd.h"
+#include "intern_cmd/intern_cmd.h"
+#include "spawn_cmd/spawn_cmd.h"
+#include "redirect_cmd/redirect_cmd.h"
+#include "job_cmd/job_cmd.h"
+#include "var_cmd/var_cmd.h"
 
 /**
  * @brief Execute a command line containing exactly one pipe.
@@ -26,139 +33,7 @@ int execute_line_with_one_pipe(struct line *li) {
         fprintf(stderr, "This function supports exactly one pipe between two commands.\n");
         return 1;
     }
-
-    int pipefd[2];
-    pid_t pids[2];
-
-    // Create the pipe
-    if (pipe(pipefd) == -1) {
-        perror("pipe");
-        return 1;
-    }
-
-    // Fork the first child for the first command
-    pids[0] = fork();
-    if (pids[0] == -1) {
-        perror("fork");
-        return 1;
-    }
-
-    if (pids[0] == 0) { // In the first child process
-        if (li->background) {
-            // Redirect standard input to /dev/null for background processes
-            if (!is_input_redirected()) {
-                if (redirect_input_to_dev_null() != 0) {
-                    return 1;
-                }
-            }
-        } else {
-            // Reset SIGINT handler to default for foreground commands
-            struct sigaction default_sigint;
-            sigemptyset(&default_sigint.sa_mask);
-            default_sigint.sa_flags = SA_RESTART;
-            default_sigint.sa_handler = SIG_DFL;
-            if (sigaction(SIGINT, &default_sigint, NULL) == -1) {
-                perror("sigaction");
-                return 1;
-            }
-        }
-        
-
-        // Redirect stdout to the pipe
-        if (dup2(pipefd[1], STDOUT_FILENO) == -1) {
-            perror("dup2");
-            return 2;
-        }
-
-        // Close unused pipe ends
-        if (close(pipefd[0]) == -1 || close(pipefd[1]) == -1) {
-            perror("close");
-            return 1;
-        }
-
-        // Execute the first command
-        execvp(li->cmds[0].args[0], li->cmds[0].args);
-        perror("execvp");
-        return 2;
-    }
-
-    // Fork the second child for the second command
-    pids[1] = fork();
-    if (pids[1] == -1) {
-        perror("fork");
-        return 1;
-    }
-
-    if (pids[1] == 0) { // In the second child process
-        if (li->background) {
-            // Redirect standard input to /dev/null for background processes
-            if (!is_input_redirected()) {
-                if (redirect_input_to_dev_null() != 0) {
-                    return 1;
-                }
-            }
-        } else {
-            // Reset SIGINT handler to default for foreground commands
-            struct sigaction default_sigint;
-            sigemptyset(&default_sigint.sa_mask);
-            default_sigint.sa_flags = SA_RESTART;
-            default_sigint.sa_handler = SIG_DFL;
-            if (sigaction(SIGINT, &default_sigint, NULL) == -1) {
-                perror("sigaction");
-                return 1;
-            }
-        }
-
-        // Redirect stdin to the pipe
-        if (dup2(pipefd[0], STDIN_FILENO) == -1) {
-            perror("dup2");
-            return 1;
-        }
-
-        // Close unused pipe ends
-        if (close(pipefd[0]) == -1 || close(pipefd[1]) == -1) {
-            perror("close");
-            return 1;
-        }
-
-        // Execute the second command
-        execvp(li->cmds[1].args[0], li->cmds[1].args);
-        perror("execvp");
-        return 1;
-    }
-
-    // Parent process
-
-    // Close unused pipe ends
-    if (close(pipefd[0]) == -1 || close(pipefd[1]) == -1) {
-        perror("close");
-        return 1;
-    }
-
-    // Wait for both child processes to finish and print their status
-    for (int i = 0; i < 2; i++) {
-        if (li->background) {
-            // Add background process to the list
-            bg_processes[bg_index++] = pids[i];
-        } else {
-            // Add foreground process to the list
-            fg_processes[fg_index++] = pids[i];
-            // Wait for the foreground process to complete
-            while (fg_index > 0) {
-                int status;
-                pid_t res = wait(&status);
-                if (res == -1) {
-                    perror("wait");
-                    return 1;
-                } else {
-                    print_process_status(res, status, li->background);
-                    remove_fg_process(res);
-                }
-            }
-        }
-    }
-
-    return 0;
+    return execute_line_with_pipes(li);
 }
 
 
@@ -170,111 +45,110 @@ int execute_line_with_one_pipe(struct line *li) {
  * between commands. It sets up the necessary pipes, forks child processes to execute 
  * each command, and manages the redirections of standard input and output accordingly.
  * After forking, it waits for all child processes to complete and prints their statuses.
+ * All the commands are launched in one process group and registered in one job
+ * before the shell waits: the stages are reaped concurrently, as they terminate.
  *
  * @param li A pointer to a `struct line` containing the parsed command line with multiple commands.
  *
  * @return 0 on success, 1 on error.
  */
 int execute_line_with_pipes(struct line *li) {
-    int pipefd[2 * (li->n_cmds - 1)];
-    pid_t pids[li->n_cmds];
-
-    // Create the necessary tubes
-    for (size_t i = 0; i < li->n_cmds - 1; i++) {
-        if (pipe(pipefd + i * 2) == -1) {
-            perror("pipe");
-            return 1;
-        }
+    // All the commands of the line form one job, in one process group
+    int job = job_create(li);
+    if (job == -1) {
+        return 1;
     }
+    int prev_read = -1; // read end of the pipe feeding the current command
 
     for (size_t i = 0; i < li->n_cmds; i++) {
-        pids[i] = fork();
-        if (pids[i] == -1) {
-            perror("fork");
+        // Create the tube to the next command (close-on-exec: the dup2
+        // actions of the child clear the flag on its standard descriptors)
+        int pipefd[2] = { -1, -1 };
+        if (i < li->n_cmds - 1 && pipe2(pipefd, O_CLOEXEC) == -1) {
+            perror("pipe");
+            if (prev_read != -1) {
+                close(prev_read);
+            }
+            job_run(job);
             return 1;
         }
 
-        if (pids[i] == 0) { // Child processes
-            if (li->background) {
-                // Redirect standard input to /dev/null for background processes
-                if (!is_input_redirected()) {
-                    if (redirect_input_to_dev_null() != 0) {
-                        return 1;
-                    }
-                }
+        struct cmd *cmd = &li->cmds[i];
+        const struct builtin *builtin = cmd->n_args > 0 ? builtin_lookup(cmd->args[0]) : NULL;
+        if (cmd->n_args == 0 || (builtin != NULL && !builtin_needs_child(builtin, li))) {
+            // No effect and no input/output (assignments only, true, false, test): no process
+            // is needed, the pipe ends are closed and the neighbours see the end of file
+            // (its redirections are applied to the shell around it)
+            int code = 0;
+            struct redirect_saved saved;
+            if (redirect_apply(cmd, &saved) != 0) {
+                code = 1;
             } else {
-                // Reset SIGINT handler to default for foreground commands
-                struct sigaction default_sigint;
-                sigemptyset(&default_sigint.sa_mask);
-                default_sigint.sa_flags = SA_RESTART;
-                default_sigint.sa_handler = SIG_DFL;
-                if (sigaction(SIGINT, &default_sigint, NULL) == -1) {
-                    perror("sigaction");
-                    return 1;
+                if (cmd->n_args > 0 && var_push_assigns(cmd) == 0) {
+                    code = execute_command_intern(li, cmd);
+                    var_pop_scope();
                 }
+                redirect_restore(&saved);
             }
-
-            // Redirect input
-            if (i > 0) {
-                if (dup2(pipefd[(i - 1) * 2], STDIN_FILENO) == -1) {
-                    perror("dup2");
-                    return 1;
-                }
+            job_add_done(job, code);
+            if (prev_read != -1) {
+                close(prev_read);
             }
-
-            // Redirect output
-            if (i < li->n_cmds - 1) {
-                if (dup2(pipefd[i * 2 + 1], STDOUT_FILENO) == -1) {
-                    perror("dup2");
-                    return 1;
-                }
-            }
-
-            // Close all pipe descriptors in child
-            for (size_t j = 0; j < 2 * (li->n_cmds - 1); j++) {
-                if (close(pipefd[j]) == -1) {
-                    perror("close");
-                    return 1;
-                }
+            if (pipefd[1] != -1) {
+                close(pipefd[1]);
             }
-
-            // Execute the command
-            execvp(li->cmds[i].args[0], li->cmds[i].args);
-            perror("execvp");
-            return 1;
+            prev_read = pipefd[0];
+            continue;
         }
-    }
 
-    // Close all pipe descriptors in parent
-    for (size_t i = 0; i < 2 * (li->n_cmds - 1); i++) {
-        if (close(pipefd[i]) == -1) {
-            perror("close");
-            return 1;
+        struct spawn_req req;
+        struct intern_stage stage = { li, cmd };
+        spawn_req_init(&req, cmd->args, li->background);
+        req.pgroup = job_pgid(job);
+        if (builtin != NULL) {
+            // The internal command runs in a forked subshell
+            req.fn = run_intern_stage;
+            req.ctx = &stage;
         }
-    }
 
-    // Wait for all child processes
-    for (size_t i = 0; i < li->n_cmds; i++) {
-        if (li->background) {
-            // Add background process to the list
-            bg_processes[bg_index++] = pids[i];
+        int err = 0;
+        // Redirect input
+        if (prev_read != -1) {
+            err |= spawn_add_dup2(&req, prev_read, STDIN_FILENO);
+        }
+        // Redirect output
+        if (pipefd[1] != -1) {
+            err |= spawn_add_dup2(&req, pipefd[1], STDOUT_FILENO);
+        }
+        // (a redirection that fails gives the status 1, like a failing command)
+        bool redirected = redirect_add_actions(&req, li, i) == 0;
+
+        // If a command could not be launched, the error has already been printed
+        // (the assignments before the command are only given to its process)
+        pid_t pid = -1;
+        if (!err && redirected && var_push_assigns(cmd) == 0) {
+            pid = spawn_process(&req);
+            var_pop_scope();
+        }
+        spawn_req_reset(&req);
+        if (pid != -1) {
+            job_add_process(job, pid);
         } else {
-            // Add foreground process to the list
-            fg_processes[fg_index++] = pids[i];
-            // Wait for the foreground process to complete
-            while (fg_index > 0) {
-                int status;
-                pid_t res = wait(&status);
-                if (res == -1) {
-                    perror("wait");
-                    return 1;
-                } else {
-                    print_process_status(res, status, li->background);
-                    remove_fg_process(res);
-                }
-            }
+            job_add_done(job, !err && !redirected ? 1 : 127);
+        }
+
+        // Close the pipe descriptors used by the child in the parent
+        if (prev_read != -1) {
+            close(prev_read);
+        }
+        if (pipefd[1] != -1) {
+            close(pipefd[1]);
         }
+        prev_read = pipefd[0];
     }
 
+    // Wait for all the foreground processes to complete: the status of the
+    // line is the status of the last command (or of the last failed one with pipefail)
+    shell_status = job_run(job);
     return 0;
 }
@@ -23,6 +23,8 @@ int execute_line_with_one_pipe(struct line *li);
  * between commands. It sets up the necessary pipes, forks child processes to execute 
  * each command, and manages the redirections of standard input and output accordingly.
  * After forking, it waits for all child processes to complete and prints their statuses.
+ * All the commands are launched in one process group and registered in one job
+ * before the shell waits: the stages are reaped concurrently, as they terminate.
  *
  * @param li A pointer to a `struct line` containing the parsed command line with multiple commands.
  *
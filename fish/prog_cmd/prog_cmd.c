@@ -0,0 +1,667 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#include "prog_cmd.h"
+#include "util.h"
+#include "execute_cmd/execute_cmd.h"
+#include "var_cmd/var_cmd.h"
+#include "glob_cmd/glob_cmd.h"
+#include "job_cmd/job_cmd.h"
+
+#define NO_TARGET ((size_t)-1)
+
+/**
+ * @brief Kinds of blocks.
+ */
+enum prog_block_kind {
+    BLOCK_IF,
+    BLOCK_WHILE,
+    BLOCK_FOR,
+};
+
+/**
+ * @brief A block being compiled.
+ */
+struct prog_block {
+    enum prog_block_kind kind;
+    size_t start;    // loops: first instruction of an iteration (target of 'continue')
+    size_t next;     // OP_JUMP_FALSE or OP_FOR_NEXT to patch with the next branch or the exit, NO_TARGET if none
+    bool has_else;
+    bool cond_open;  // the condition goes on up to the next ';' or the end of the line
+    size_t *exits;   // OP_JUMP to patch with the end of the block ('break', end of a branch of 'if')
+    size_t n_exits;
+    size_t cap_exits;
+};
+
+/**
+ * @brief The words of a running 'for' loop.
+ */
+struct prog_loop {
+    struct line li; // owns the expanded words
+    char **words;
+    size_t n_words;
+    size_t next;    // next word to give to the variable
+};
+
+// Runtime state, kept from one program to the next (the arenas are reused)
+static struct line work;           // line being run
+static bool work_ready;
+static struct prog_loop *loops;    // running 'for' loops, the innermost last
+static size_t n_loops;
+static size_t cap_loops;
+static size_t init_loops;          // number of loops whose line is initialized
+
+
+/**
+ * @brief Initialize an empty program.
+ *
+ * @param p The program.
+ */
+void prog_init(struct prog *p) {
+    memset(p, 0, sizeof(struct prog));
+}
+
+/**
+ * @brief Check if a block is being compiled.
+ *
+ * @param p The program.
+ * @return bool Returns true if a block is open (the next lines belong to it).
+ */
+bool prog_pending(const struct prog *p) {
+    return p->depth > 0;
+}
+
+/**
+ * @brief Empty a program, dropping the blocks not closed yet.
+ *
+ * @param p The program.
+ */
+void prog_reset(struct prog *p) {
+    for (size_t i = 0; i < p->n_ops; ++i) {
+        free(p->ops[i].var);
+    }
+    for (size_t i = 0; i < p->n_lines; ++i) {
+        cache_template_free(&p->lines[i]);
+    }
+    for (size_t i = 0; i < p->depth; ++i) {
+        free(p->blocks[i].exits);
+    }
+    free(p->ops);
+    free(p->lines);
+    free(p->blocks);
+    prog_init(p);
+}
+
+/**
+ * @brief Append an instruction to a program.
+ *
+ * @param p The program.
+ * @param code The opcode.
+ * @param line The index of the line (OP_RUN and OP_FOR_INIT).
+ * @param var The name of the variable (OP_FOR_NEXT), copied.
+ * @return size_t The index of the instruction, or NO_TARGET on failure.
+ */
+static size_t prog_emit(struct prog *p, enum prog_opcode code, size_t line, const char *var) {
+    if (p->n_ops == p->cap_ops) {
+        size_t cap = p->cap_ops ? 2 * p->cap_ops : 16;
+        struct prog_op *ops = realloc(p->ops, cap * sizeof(struct prog_op));
+        if (ops == NULL) {
+            perror("realloc");
+            return NO_TARGET;
+        }
+        p->ops = ops;
+        p->cap_ops = cap;
+    }
+    struct prog_op *op = &p->ops[p->n_ops];
+    op->code = code;
+    op->line = line;
+    op->target = NO_TARGET;
+    op->var = NULL;
+    if (var != NULL && (op->var = strdup(var)) == NULL) {
+        perror("strdup");
+        return NO_TARGET;
+    }
+    return p->n_ops++;
+}
+
+/**
+ * @brief Keep a pipeline in a program, without its first words.
+ *
+ * Only the pipeline itself is kept, not the next ones of its list.
+ *
+ * @param p The program.
+ * @param li The parsed pipeline (its first command loses "skip" words).
+ * @param skip The number of words to drop (the keywords).
+ * @return size_t The index of the line, or NO_TARGET on failure.
+ */
+static size_t prog_add_line(struct prog *p, struct line *li, size_t skip) {
+    if (p->n_lines == p->cap_lines) {
+        size_t cap = p->cap_lines ? 2 * p->cap_lines : 8;
+        struct line_template *lines = realloc(p->lines, cap * sizeof(struct line_template));
+        if (lines == NULL) {
+            perror("realloc");
+            return NO_TARGET;
+        }
+        p->lines = lines;
+        p->cap_lines = cap;
+    }
+    li->cmds[0].args += skip;
+    li->cmds[0].n_args -= skip;
+    struct line *next = li->next;
+    li->next = NULL;
+    int err = cache_template_store(&p->lines[p->n_lines], li);
+    li->next = next;
+    return err ? NO_TARGET : p->n_lines++;
+}
+
+/**
+ * @brief Add a line and the instruction running it.
+ *
+ * @param p The program.
+ * @param li The parsed line.
+ * @param skip The number of words to drop (the keywords).
+ * @param code OP_RUN or OP_FOR_INIT.
+ * @return int Returns 0 on success, or -1 on failure.
+ */
+static int prog_emit_line(struct prog *p, struct line *li, size_t skip, enum prog_opcode code) {
+    size_t line = prog_add_line(p, li, skip);
+    return line == NO_TARGET || prog_emit(p, code, line, NULL) == NO_TARGET ? -1 : 0;
+}
+
+/**
+ * @brief Open a new block.
+ *
+ * @param p The program.
+ * @param kind The kind of the block.
+ * @return struct prog_block* The block, or NULL on failure.
+ */
+static struct prog_block *prog_open(struct prog *p, enum prog_block_kind kind) {
+    if (p->depth == p->cap_blocks) {
+        size_t cap = p->cap_blocks ? 2 * p->cap_blocks : 8;
+        struct prog_block *blocks = realloc(p->blocks, cap * sizeof(struct prog_block));
+        if (blocks == NULL) {
+            perror("realloc");
+            return NULL;
+        }
+        p->blocks = blocks;
+        p->cap_blocks = cap;
+    }
+    struct prog_block *b = &p->blocks[p->depth++];
+    memset(b, 0, sizeof(struct prog_block));
+    b->kind = kind;
+    b->next = NO_TARGET;
+    return b;
+}
+
+/**
+ * @brief Emit a jump to the end of a block, patched when the block is closed.
+ *
+ * @param p The program.
+ * @param b The block.
+ * @return int Returns 0 on success, or -1 on failure.
+ */
+static int prog_emit_exit(struct prog *p, struct prog_block *b) {
+    if (b->n_exits == b->cap_exits) {
+        size_t cap = b->cap_exits ? 2 * b->cap_exits : 4;
+        size_t *exits = realloc(b->exits, cap * sizeof(size_t));
+        if (exits == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        b->exits = exits;
+        b->cap_exits = cap;
+    }
+    size_t jump = prog_emit(p, OP_JUMP, 0, NULL);
+    if (jump == NO_TARGET) {
+        return -1;
+    }
+    b->exits[b->n_exits++] = jump;
+    return 0;
+}
+
+/**
+ * @brief End the condition of the innermost block, if it is still open.
+ *
+ * @param p The program.
+ * @return int Returns 0 on success, or -1 on failure.
+ */
+static int prog_end_cond(struct prog *p) {
+    struct prog_block *b = p->depth > 0 ? &p->blocks[p->depth - 1] : NULL;
+    if (b == NULL || !b->cond_open) {
+        return 0;
+    }
+    b->cond_open = false;
+    b->next = prog_emit(p, OP_JUMP_FALSE, 0, NULL);
+    return b->next == NO_TARGET ? -1 : 0;
+}
+
+/**
+ * @brief Close the innermost block.
+ *
+ * @param p The program.
+ * @return int Returns 0 on success, or -1 on failure.
+ */
+static int prog_close(struct prog *p) {
+    struct prog_block *b = &p->blocks[p->depth - 1];
+    if (b->kind != BLOCK_IF && prog_emit(p, OP_JUMP, 0, NULL) == NO_TARGET) {
+        return -1;
+    }
+    if (b->kind != BLOCK_IF) {
+        p->ops[p->n_ops - 1].target = b->start;
+    }
+    // A 'for' loop is left through OP_FOR_POP, which drops its words
+    size_t end = p->n_ops;
+    if (b->kind == BLOCK_FOR && prog_emit(p, OP_FOR_POP, 0, NULL) == NO_TARGET) {
+        return -1;
+    }
+    if (b->next != NO_TARGET) {
+        p->ops[b->next].target = end;
+    }
+    for (size_t i = 0; i < b->n_exits; ++i) {
+        p->ops[b->exits[i]].target = end;
+    }
+    free(b->exits);
+    p->depth--;
+    return 0;
+}
+
+/**
+ * @brief Find the innermost loop.
+ *
+ * @param p The program.
+ * @return struct prog_block* The block of the loop, or NULL outside of any loop.
+ */
+static struct prog_block *prog_loop_block(struct prog *p) {
+    for (size_t i = p->depth; i > 0; --i) {
+        if (p->blocks[i - 1].kind != BLOCK_IF) {
+            return &p->blocks[i - 1];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Get the keyword starting a parsed line.
+ *
+ * A quoted word is never a keyword.
+ *
+ * @param li The parsed line.
+ * @return const char* The keyword, or NULL if the line doesn't start with a keyword.
+ */
+static const char *prog_keyword(const struct line *li) {
+    static const char *const keywords[] = { "if", "else", "while", "for", "end", "break", "continue" };
+    if (li->n_cmds == 0 || li->cmds[0].n_args == 0 || !li->argv_glob[li->cmds[0].args - li->argv]) {
+        return NULL;
+    }
+    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); ++i) {
+        if (strcmp(li->cmds[0].args[0], keywords[i]) == 0) {
+            return keywords[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Check if a line is made of one command, without redirection nor '&'.
+ *
+ * @param li The parsed line.
+ * @return bool Returns true if the line is a single plain command.
+ */
+static bool prog_plain(const struct line *li) {
+    return li->n_cmds == 1 && li->cmds[0].n_redirs == 0 && !li->background;
+}
+
+/**
+ * @brief Compile a line starting with a keyword.
+ *
+ * @param p The program.
+ * @param li The parsed line.
+ * @param kw The keyword.
+ * @return int Returns 0 on success, or -1 on failure (the error is printed).
+ */
+static int prog_compile_keyword(struct prog *p, struct line *li, const char *kw) {
+    struct cmd *cmd = &li->cmds[0];
+    struct prog_block *b = p->depth > 0 ? &p->blocks[p->depth - 1] : NULL;
+
+    if (strcmp(kw, "if") == 0 || strcmp(kw, "while") == 0) {
+        if (cmd->n_args < 2) {
+            fprintf(stderr, "fish: %s: missing command\n", kw);
+            return -1;
+        }
+        b = prog_open(p, kw[0] == 'i' ? BLOCK_IF : BLOCK_WHILE);
+        if (b == NULL) {
+            return -1;
+        }
+        b->start = p->n_ops;
+        b->cond_open = true;
+        return prog_emit_line(p, li, 1, OP_RUN);
+    }
+
+    if (strcmp(kw, "for") == 0) {
+        if (!prog_plain(li) || cmd->n_args < 3 || strcmp(cmd->args[2], "in") != 0) {
+            fprintf(stderr, "fish: for: usage: for name in words...\n");
+            return -1;
+        }
+        const char *var = cmd->args[1];
+        b = prog_open(p, BLOCK_FOR);
+        if (b == NULL || prog_emit_line(p, li, 3, OP_FOR_INIT) != 0) {
+            return -1;
+        }
+        b->start = p->n_ops;
+        b->next = prog_emit(p, OP_FOR_NEXT, 0, var);
+        return b->next == NO_TARGET ? -1 : 0;
+    }
+
+    if (strcmp(kw, "else") == 0) {
+        bool else_if = cmd->n_args >= 3 && strcmp(cmd->args[1], "if") == 0;
+        if (b == NULL || b->kind != BLOCK_IF || b->has_else || (!else_if && !(prog_plain(li) && cmd->n_args == 1))) {
+            fprintf(stderr, "fish: 'else' misplaced\n");
+            return -1;
+        }
+        // The previous branch jumps to the end, its condition jumps here
+        if (prog_emit_exit(p, b) != 0) {
+            return -1;
+        }
+        p->ops[b->next].target = p->n_ops;
+        b->next = NO_TARGET;
+        if (!else_if) {
+            b->has_else = true;
+            return 0;
+        }
+        b->cond_open = true;
+        return prog_emit_line(p, li, 2, OP_RUN);
+    }
+
+    // end, break and continue are alone on their line
+    if (!prog_plain(li) || cmd->n_args != 1) {
+        fprintf(stderr, "fish: %s: too many arguments\n", kw);
+        return -1;
+    }
+    if (strcmp(kw, "end") == 0) {
+        if (b == NULL) {
+            fprintf(stderr, "fish: 'end' outside of a block\n");
+            return -1;
+        }
+        return prog_close(p);
+    }
+    struct prog_block *loop = prog_loop_block(p);
+    if (loop == NULL) {
+        fprintf(stderr, "fish: '%s' outside of a loop\n", kw);
+        return -1;
+    }
+    if (strcmp(kw, "break") == 0) {
+        return prog_emit_exit(p, loop);
+    }
+    size_t jump = prog_emit(p, OP_JUMP, 0, NULL);
+    if (jump == NO_TARGET) {
+        return -1;
+    }
+    p->ops[jump].target = loop->start;
+    return 0;
+}
+
+/**
+ * @brief Compile a parsed line in a program.
+ *
+ * The blocks are 'if cmd', 'else', 'else if cmd', 'while cmd' and
+ * 'for name in words', each closed by 'end'; 'break' and 'continue' jump
+ * out of or back to the innermost loop. A line outside of any block which
+ * does not start one is not compiled.
+ * Each pipeline of a list is compiled on its own: '&&' and '||' become
+ * conditional jumps, and the condition of 'if' or 'while' is the whole list
+ * up to the next ';'.
+ *
+ * @param p The program.
+ * @param li The parsed line (not expanded).
+ * @return int Returns PROG_SIMPLE, PROG_MORE or PROG_READY, or -1 if the line is
+ *             misplaced (the program is then emptied).
+ */
+int prog_feed(struct prog *p, struct line *li) {
+    bool has_kw = false;
+    for (const struct line *seg = li; seg != NULL && !has_kw; seg = seg->next) {
+        has_kw = prog_keyword(seg) != NULL;
+    }
+    if (!has_kw && p->depth == 0) {
+        return PROG_SIMPLE;
+    }
+    if (li->n_cmds == 0) {
+        // Empty line in a block
+        return PROG_MORE;
+    }
+
+    int err = 0;
+    int op = LINE_SEQ;
+    for (struct line *seg = li; seg != NULL && !err; op = seg->next_op, seg = seg->next) {
+        const char *kw = prog_keyword(seg);
+        size_t guard = NO_TARGET;
+        if (op == LINE_SEQ) {
+            err = prog_end_cond(p);
+        } else if (kw != NULL && strcmp(kw, "break") != 0 && strcmp(kw, "continue") != 0) {
+            fprintf(stderr, "fish: '%s' after '%s'\n", kw, op == LINE_AND ? "&&" : "||");
+            err = -1;
+        } else {
+            // The pipeline is skipped depending on the status of the previous one
+            guard = prog_emit(p, op == LINE_AND ? OP_JUMP_FALSE : OP_JUMP_TRUE, 0, NULL);
+            err = guard == NO_TARGET;
+        }
+        if (!err) {
+            err = kw != NULL ? prog_compile_keyword(p, seg, kw) : prog_emit_line(p, seg, 0, OP_RUN);
+        }
+        if (!err && guard != NO_TARGET) {
+            p->ops[guard].target = p->n_ops;
+        }
+    }
+    if (err || prog_end_cond(p) != 0) {
+        prog_reset(p);
+        return -1;
+    }
+    return p->depth > 0 ? PROG_MORE : PROG_READY;
+}
+
+/**
+ * @brief Take the 'time' keyword at the beginning of a pipeline.
+ *
+ * 'time' (and its option -v) is dropped from the first command, like the
+ * keywords of the blocks. A quoted "time", or 'time' alone, is a command;
+ * 'time -v' without a command is a usage error.
+ *
+ * @param li The parsed pipeline (not expanded).
+ * @return int LINE_TIME, LINE_TIME_STAGES for 'time -v', 0 without 'time',
+ *             or -1 on a usage error (the error is printed).
+ */
+static int prog_time(struct line *li) {
+    struct cmd *cmd = li->n_cmds > 0 ? &li->cmds[0] : NULL;
+    if (cmd == NULL || cmd->n_args < 2 || !li->argv_glob[cmd->args - li->argv] || strcmp(cmd->args[0], "time") != 0) {
+        return 0;
+    }
+    size_t skip = 1;
+    int mode = LINE_TIME;
+    if (strcmp(cmd->args[1], "-v") == 0) {
+        if (cmd->n_args == 2) {
+            fprintf(stderr, "fish: time: usage: time [-v] pipeline\n");
+            return -1;
+        }
+        skip = 2;
+        mode = LINE_TIME_STAGES;
+    }
+    cmd->args += skip;
+    cmd->n_args -= skip;
+    return mode;
+}
+
+/**
+ * @brief Expand and run one pipeline of a list.
+ *
+ * A pipeline starting with 'time' prints the resources it used when it is over.
+ *
+ * @param li The parsed pipeline.
+ * @return int Returns 0 on success, or 1 on a fatal error.
+ */
+static int prog_run_pipeline(struct line *li) {
+    li->time = prog_time(li);
+    if (li->time == -1) {
+        shell_status = 2;
+        return 0;
+    }
+    if (var_expand_line(li) != 0 || glob_expand_line(li) != 0) {
+        shell_status = 2;
+        return 0;
+    }
+    if (li->n_cmds == 1 && li->cmds[0].n_args == 0) {
+        // Assignments only: they set the variables of the shell
+        shell_status = var_set_assigns(&li->cmds[0]);
+        return 0;
+    }
+    if (li->n_cmds > 0) {
+        return execute_command(li->cmds[0].args[0], li->cmds[0].args, li->background, li);
+    }
+    return 0;
+}
+
+/**
+ * @brief Expand and run a parsed line.
+ *
+ * The pipelines of a list are expanded and run one after the other: after '&&'
+ * (resp. '||') a pipeline is skipped if the status is not 0 (resp. is 0), and
+ * the list stops when a pipeline is interrupted by Ctrl-C.
+ * A pipeline made of assignments only sets the variables of the shell.
+ * The status of the last pipeline run goes to shell_status.
+ *
+ * @param li The parsed line.
+ * @return int Returns 0 on success, or 1 on a fatal error.
+ */
+int prog_run_line(struct line *li) {
+    int ret = 0;
+    for (struct line *seg = li; seg != NULL && ret == 0; seg = seg->next) {
+        ret = prog_run_pipeline(seg);
+        if (shell_status == 128 + SIGINT) {
+            break;
+        }
+        while (seg->next != NULL && (seg->next_op == LINE_AND ? shell_status != 0 : seg->next_op == LINE_OR && shell_status == 0)) {
+            seg = seg->next;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief Start a 'for' loop: expand its words.
+ *
+ * @param tpl The line of the words.
+ * @return int Returns 0 on success, or -1 on failure.
+ */
+static int prog_loop_push(const struct line_template *tpl) {
+    if (n_loops == cap_loops) {
+        size_t cap = cap_loops ? 2 * cap_loops : 4;
+        struct prog_loop *new_loops = realloc(loops, cap * sizeof(struct prog_loop));
+        if (new_loops == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        loops = new_loops;
+        cap_loops = cap;
+    }
+    struct prog_loop *loop = &loops[n_loops];
+    if (n_loops == init_loops) {
+        line_init(&loop->li);
+        init_loops++;
+    }
+    n_loops++;
+    loop->words = NULL;
+    loop->n_words = 0;
+    loop->next = 0;
+    if (cache_template_load(tpl, &loop->li) != 0) {
+        return -1;
+    }
+
+    struct cmd *cmd = &loop->li.cmds[0];
+    if (var_expand_line(&loop->li) != 0) {
+        // No iteration
+        shell_status = 2;
+        return 0;
+    }
+    // The words of the form NAME=value are words, not assignments
+    cmd->args = cmd->assigns;
+    cmd->n_args += cmd->n_assigns;
+    cmd->n_assigns = 0;
+    if (glob_expand_line(&loop->li) != 0) {
+        shell_status = 2;
+        return 0;
+    }
+    loop->words = cmd->args;
+    loop->n_words = cmd->n_args;
+    return 0;
+}
+
+/**
+ * @brief Run a complete program, then empty it.
+ *
+ * A loop stops when one of its commands is interrupted by Ctrl-C.
+ *
+ * @param p The program.
+ * @return int Returns 0 on success, or 1 on a fatal error.
+ */
+int prog_run(struct prog *p) {
+    if (!work_ready) {
+        line_init(&work);
+        work_ready = true;
+    }
+
+    int ret = 0;
+    size_t pc = 0;
+    while (pc < p->n_ops && ret == 0) {
+        const struct prog_op *op = &p->ops[pc++];
+        switch (op->code) {
+        case OP_RUN:
+            if (cache_template_load(&p->lines[op->line], &work) != 0) {
+                ret = 1;
+                break;
+            }
+            ret = prog_run_line(&work);
+            line_reset(&work);
+            // The background jobs terminated during a long loop are reaped as it runs
+            job_reap();
+            if (shell_status == 128 + SIGINT) {
+                pc = p->n_ops;
+            }
+            break;
+        case OP_JUMP:
+            pc = op->target;
+            break;
+        case OP_JUMP_FALSE:
+            if (shell_status != 0) {
+                pc = op->target;
+            }
+            break;
+        case OP_JUMP_TRUE:
+            if (shell_status == 0) {
+                pc = op->target;
+            }
+            break;
+        case OP_FOR_INIT:
+            ret = prog_loop_push(&p->lines[op->line]) != 0;
+            break;
+        case OP_FOR_NEXT: {
+            struct prog_loop *loop = &loops[n_loops - 1];
+            if (loop->next == loop->n_words) {
+                pc = op->target;
+            } else if (var_set(op->var, loop->words[loop->next++]) != 0) {
+                ret = 1;
+            }
+            break;
+        }
+        case OP_FOR_POP:
+            line_reset(&loops[--n_loops].li);
+            break;
+        }
+    }
+
+    // The loops left by an interruption are dropped
+    while (n_loops > 0) {
+        line_reset(&loops[--n_loops].li);
+    }
+    prog_reset(p);
+    return ret;
+}
@@ -0,0 +1,121 @@
+#ifndef PROG_CMD_H
+#define PROG_CMD_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "cmdline.h"
+#include "cache_cmd/cache_cmd.h"
+
+#define PROG_SIMPLE 0 // the line is not part of a block: it can be run as is
+#define PROG_MORE   1 // the line is compiled, the block is not complete yet
+#define PROG_READY  2 // the block is complete: the program can be run
+
+/**
+ * @brief Instructions of a compiled program.
+ */
+enum prog_opcode {
+    OP_RUN,        // run the line "line", the status goes to shell_status
+    OP_JUMP,       // go to "target"
+    OP_JUMP_FALSE, // go to "target" if the status of the last line is not 0
+    OP_JUMP_TRUE,  // go to "target" if the status of the last line is 0
+    OP_FOR_INIT,   // expand the words of the line "line" and push them as a loop
+    OP_FOR_NEXT,   // set "var" to the next word of the loop, or go to "target" after the last one
+    OP_FOR_POP,    // drop the words of the innermost loop
+};
+
+/**
+ * @brief One instruction of a compiled program.
+ */
+struct prog_op {
+    enum prog_opcode code;
+    size_t line;   // OP_RUN and OP_FOR_INIT: index of the line in the program
+    size_t target; // jumps and OP_FOR_NEXT: index of an instruction
+    char *var;     // OP_FOR_NEXT: name of the variable
+};
+
+struct prog_block; // block being compiled, private to prog_cmd.c
+
+/**
+ * @brief A program: the instructions of a top-level block and its parsed lines.
+ *
+ * The lines are kept as templates: each time an instruction runs a line, the
+ * template is copied and expanded, but never parsed again.
+ */
+struct prog {
+    struct prog_op *ops;
+    size_t n_ops;
+    size_t cap_ops;
+    struct line_template *lines;
+    size_t n_lines;
+    size_t cap_lines;
+    struct prog_block *blocks; // blocks not closed yet, the innermost last
+    size_t depth;
+    size_t cap_blocks;
+};
+
+/**
+ * @brief Initialize an empty program.
+ *
+ * @param p The program.
+ */
+void prog_init(struct prog *p);
+
+/**
+ * @brief Check if a block is being compiled.
+ *
+ * @param p The program.
+ * @return bool Returns true if a block is open (the next lines belong to it).
+ */
+bool prog_pending(const struct prog *p);
+
+/**
+ * @brief Compile a parsed line in a program.
+ *
+ * The blocks are 'if cmd', 'else', 'else if cmd', 'while cmd' and
+ * 'for name in words', each closed by 'end'; 'break' and 'continue' jump
+ * out of or back to the innermost loop. A line outside of any block which
+ * does not start one is not compiled.
+ * Each pipeline of a list is compiled on its own: '&&' and '||' become
+ * conditional jumps, and the condition of 'if' or 'while' is the whole list
+ * up to the next ';'.
+ *
+ * @param p The program.
+ * @param li The parsed line (not expanded).
+ * @return int Returns PROG_SIMPLE, PROG_MORE or PROG_READY, or -1 if the line is
+ *             misplaced (the program is then emptied).
+ */
+int prog_feed(struct prog *p, struct line *li);
+
+/**
+ * @brief Run a complete program, then empty it.
+ *
+ * A loop stops when one of its commands is interrupted by Ctrl-C.
+ *
+ * @param p The program.
+ * @return int Returns 0 on success, or 1 on a fatal error.
+ */
+int prog_run(struct prog *p);
+
+/**
+ * @brief Expand and run a parsed line.
+ *
+ * The pipelines of a list are expanded and run one after the other: after '&&'
+ * (resp. '||') a pipeline is skipped if the status is not 0 (resp. is 0), and
+ * the list stops when a pipeline is interrupted by Ctrl-C.
+ * A pipeline made of assignments only sets the variables of the shell.
+ * The status of the last pipeline run goes to shell_status.
+ *
+ * @param li The parsed line.
+ * @return int Returns 0 on success, or 1 on a fatal error.
+ */
+int prog_run_line(struct line *li);
+
+/**
+ * @brief Empty a program, dropping the blocks not closed yet.
+ *
+ * @param p The program.
+ */
+void prog_reset(struct prog *p);
+
+#endif /* PROG_CMD_H */
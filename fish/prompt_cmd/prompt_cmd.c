@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "util.h"
+#include "var_cmd/var_cmd.h"
+#include "prompt_cmd.h"
+
+#define PROMPT_WAIT_MS 20      // longest wait of the prompt for the branch
+#define PROMPT_BRANCH_LEN 128
+#define PROMPT_HEAD_LEN 256
+
+/**
+ * @brief The requests of the shell and the results of the prompt thread.
+ *
+ * The shell asks for the branch of a directory each time it builds the
+ * prompt; when several requests are pending, only the last one is answered.
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;            // signaled when a request is made
+    pthread_cond_t ready;           // signaled when a result is given
+    bool started;
+    char request[PATH_MAX];         // directory of the last request
+    unsigned long requested;        // number of the last request
+    unsigned long answered;         // number of the last request answered
+    char dir[PATH_MAX];             // directory of the last result
+    char branch[PROMPT_BRANCH_LEN]; // last result, "" outside of a repository
+} prompt = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+
+/**
+ * @brief Read the beginning of a small file.
+ *
+ * @param path The path of the file.
+ * @param buf Receives the content, '\0' terminated.
+ * @param size The size of "buf".
+ * @return ssize_t The number of bytes read, or -1 on failure.
+ */
+static ssize_t prompt_read_file(const char *path, char *buf, size_t size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    if (n == -1) {
+        return -1;
+    }
+    buf[n] = '\0';
+    buf[strcspn(buf, "\n")] = '\0';
+    return n;
+}
+
+/**
+ * @brief Find the git branch of a directory.
+ *
+ * The directory and its parents are searched for a .git directory (or a
+ * .git file "gitdir: path", for a worktree or a submodule), then its HEAD is
+ * read: the branch is the name of the ref, or the short hash of a detached HEAD.
+ *
+ * @param dir The absolute path of the directory.
+ * @param branch Receives the branch, "" outside of a repository.
+ * @param size The size of "branch".
+ */
+static void prompt_git_branch(const char *dir, char *branch, size_t size) {
+    char path[PATH_MAX];
+    char head[PROMPT_HEAD_LEN];
+    branch[0] = '\0';
+
+    // path[0..len) is the directory being searched ("" for the root)
+    size_t len = strlen(dir);
+    memcpy(path, dir, len);
+    if (len == 1) {
+        len = 0;
+    }
+    for (;;) {
+        ssize_t n = -1;
+        if (len + sizeof("/.git/HEAD") <= sizeof(path)) {
+            strcpy(path + len, "/.git/HEAD");
+            n = prompt_read_file(path, head, sizeof(head));
+            if (n == -1) {
+                path[len + sizeof("/.git") - 1] = '\0';
+                if (prompt_read_file(path, head, sizeof(head)) != -1) {
+                    // .git is a file: the search ends here, found or not
+                    if (strncmp(head, "gitdir: ", 8) != 0) {
+                        return;
+                    }
+                    char gitdir[PROMPT_HEAD_LEN];
+                    strcpy(gitdir, head + 8);
+                    size_t off = gitdir[0] == '/' ? 0 : len;
+                    int k = snprintf(path + off, sizeof(path) - off, off == 0 ? "%s/HEAD" : "/%s/HEAD", gitdir);
+                    if (k < 0 || (size_t)k >= sizeof(path) - off
+                        || prompt_read_file(path, head, sizeof(head)) == -1) {
+                        return;
+                    }
+                    n = 0;
+                }
+            }
+        }
+        if (n != -1) {
+            if (strncmp(head, "ref: ", 5) == 0) {
+                const char *ref = head + 5;
+                if (strncmp(ref, "refs/heads/", 11) == 0) {
+                    ref += 11;
+                }
+                snprintf(branch, size, "%s", ref);
+            } else {
+                snprintf(branch, size, "%.7s", head);
+            }
+            return;
+        }
+        if (len == 0) {
+            return;
+        }
+        while (len > 0 && path[--len] != '/') {
+        }
+    }
+}
+
+/**
+ * @brief Body of the prompt thread: answer the requests of the shell.
+ *
+ * @param arg Unused.
+ * @return void* Never returns.
+ */
+static void *prompt_thread(void *arg) {
+    (void)arg;
+    char dir[PATH_MAX];
+    char branch[PROMPT_BRANCH_LEN];
+
+    pthread_mutex_lock(&prompt.lock);
+    for (;;) {
+        while (prompt.answered == prompt.requested) {
+            pthread_cond_wait(&prompt.work, &prompt.lock);
+        }
+        unsigned long request = prompt.requested;
+        strcpy(dir, prompt.request);
+        // The disk is read without the lock: the shell never waits for it
+        pthread_mutex_unlock(&prompt.lock);
+        prompt_git_branch(dir, branch, sizeof(branch));
+        pthread_mutex_lock(&prompt.lock);
+
+        strcpy(prompt.dir, dir);
+        strcpy(prompt.branch, branch);
+        prompt.answered = request;
+        pthread_cond_broadcast(&prompt.ready);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Start the thread computing the slow segments of the prompt.
+ *
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int prompt_init() {
+    // The shell waits for the results with a monotonic timeout
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&prompt.ready, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_cond_init(&prompt.work, NULL);
+
+    // The signals (SIGCHLD) are left to the main thread
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    pthread_t thread;
+    int err = pthread_create(&thread, NULL, prompt_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err != 0) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(err));
+        return 1;
+    }
+    pthread_detach(thread);
+    prompt.started = true;
+    return 0;
+}
+
+/**
+ * @brief Build the prompt shown before the next command line.
+ *
+ * The prompt is "fish dir (branch) [status]> ": the last component of $PWD,
+ * the git branch of the directory and the status of the last command line
+ * when it is not 0. The branch is read from the disk by the prompt thread:
+ * the shell waits for it PROMPT_WAIT_MS at most, and uses the last result
+ * for the same directory if it comes too late (slow filesystem), so that the
+ * prompt never holds up the reading of the next command. Without the thread
+ * (batch mode), no branch is shown.
+ */
+void prompt_refresh() {
+    const char *pwd = var_get("PWD");
+    if (pwd == NULL || pwd[0] != '/' || strlen(pwd) >= PATH_MAX) {
+        pwd = NULL;
+    }
+
+    char branch[PROMPT_BRANCH_LEN] = "";
+    if (prompt.started && pwd != NULL) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_nsec += PROMPT_WAIT_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        pthread_mutex_lock(&prompt.lock);
+        strcpy(prompt.request, pwd);
+        unsigned long request = ++prompt.requested;
+        pthread_cond_signal(&prompt.work);
+        while (prompt.answered != request) {
+            if (pthread_cond_timedwait(&prompt.ready, &prompt.lock, &deadline) == ETIMEDOUT) {
+                break;
+            }
+        }
+        if (strcmp(prompt.dir, pwd) == 0) {
+            strcpy(branch, prompt.branch);
+        }
+        pthread_mutex_unlock(&prompt.lock);
+    }
+
+    char text[PATH_MAX + PROMPT_BRANCH_LEN + 32];
+    int len = snprintf(text, sizeof(text), "fish");
+    if (pwd != NULL) {
+        const char *base = strrchr(pwd, '/');
+        len += snprintf(text + len, sizeof(text) - len, " %s", base[1] != '\0' ? base + 1 : "/");
+    }
+    if (branch[0] != '\0') {
+        len += snprintf(text + len, sizeof(text) - len, " (%s)", branch);
+    }
+    if (shell_status != 0) {
+        len += snprintf(text + len, sizeof(text) - len, " [%d]", shell_status);
+    }
+    snprintf(text + len, sizeof(text) - len, "> ");
+    set_prompt(text);
+}
@@ -0,0 +1,24 @@
+#ifndef PROMPT_CMD_H
+#define PROMPT_CMD_H
+
+/**
+ * @brief Start the thread computing the slow segments of the prompt.
+ *
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int prompt_init();
+
+/**
+ * @brief Build the prompt shown before the next command line.
+ *
+ * The prompt is "fish dir (branch) [status]> ": the last component of $PWD,
+ * the git branch of the directory and the status of the last command line
+ * when it is not 0. The branch is read from the disk by the prompt thread:
+ * the shell waits for it PROMPT_WAIT_MS at most, and uses the last result
+ * for the same directory if it comes too late (slow filesystem), so that the
+ * prompt never holds up the reading of the next command. Without the thread
+ * (batch mode), no branch is shown.
+ */
+void prompt_refresh();
+
+#endif /* PROMPT_CMD_H */
@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "read_cmd.h"
+
+
+/**
+ * @brief Initialize a reader on a file descriptor.
+ *
+ * @param r The reader to initialize.
+ * @param fd The file descriptor to read from.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int reader_init(struct reader *r, int fd) {
+    memset(r, 0, sizeof(struct reader));
+    r->fd = fd;
+    r->wake_fd = -1;
+    r->seekable = lseek(fd, 0, SEEK_CUR) != -1;
+    r->cap = READER_CHUNK;
+    r->buf = malloc(r->cap);
+    if (r->buf == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Watch a second file descriptor while the reader waits for input.
+ *
+ * When "fd" becomes readable before the input, "fn" is called and the reader
+ * goes on waiting. It lets the shell handle events (terminated children)
+ * while it is idle at the prompt.
+ *
+ * @param r The reader.
+ * @param fd The file descriptor to watch.
+ * @param fn The function called when "fd" is readable.
+ */
+void reader_set_wake(struct reader *r, int fd, void (*fn)()) {
+    r->wake_fd = fd;
+    r->wake = fn;
+}
+
+/**
+ * @brief Read the input through a function instead of read().
+ *
+ * The function is called like read() on the file descriptor of the reader,
+ * which is not read directly anymore (used by the line editor). It waits
+ * for the input itself: the watched descriptor is not polled.
+ *
+ * @param r The reader.
+ * @param fn The function: it returns the number of bytes given, 0 at the end
+ *           of the input, or -1 on error.
+ */
+void reader_set_input(struct reader *r, ssize_t (*fn)(char *buf, size_t size)) {
+    r->input = fn;
+}
+
+/**
+ * @brief Wait until the input is readable, handling the events of the watched descriptor.
+ *
+ * @param r The reader.
+ * @return int Returns 0 when the input is readable, or -1 on error.
+ */
+static int reader_wait(struct reader *r) {
+    struct pollfd pfds[2] = { { r->fd, POLLIN, 0 }, { r->wake_fd, POLLIN, 0 } };
+    for (;;) {
+        if (poll(pfds, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            return -1;
+        }
+        if (pfds[1].revents & POLLIN) {
+            r->wake();
+        }
+        if (pfds[0].revents != 0) {
+            return 0;
+        }
+    }
+}
+
+/**
+ * @brief Read more data at the end of the buffer.
+ *
+ * The pending bytes are moved to the beginning of the buffer, and the buffer
+ * grows if it is full of a single unfinished line. Two bytes are always kept
+ * free at the end for the "\n\0" of a last line.
+ *
+ * @param r The reader.
+ * @return int Returns the number of bytes read, 0 at the end of the input, or -1 on error.
+ */
+static int reader_fill(struct reader *r) {
+    if (r->start > 0) {
+        memmove(r->buf, r->buf + r->start, r->end - r->start);
+        r->end -= r->start;
+        r->start = 0;
+    }
+    if (r->cap - r->end < READER_CHUNK / 2 + 2) {
+        char *buf = realloc(r->buf, 2 * r->cap);
+        if (buf == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        r->buf = buf;
+        r->cap *= 2;
+    }
+
+    ssize_t n;
+    if (r->input != NULL) {
+        n = r->input(r->buf + r->end, r->cap - r->end - 2);
+        if (n == -1) {
+            return -1;
+        }
+        r->end += n;
+        return n;
+    }
+
+    if (r->wake_fd != -1 && reader_wait(r) != 0) {
+        return -1;
+    }
+
+    do {
+        n = read(r->fd, r->buf + r->end, r->cap - r->end - 2);
+    } while (n == -1 && errno == EINTR);
+
+    if (n == -1) {
+        perror("read");
+        return -1;
+    }
+    r->end += n;
+    return n;
+}
+
+/**
+ * @brief Get the next line of the input.
+ *
+ * The returned line always ends with "\n" (one is added to a last line
+ * without it) followed by a '\0'. It stays valid until the next call.
+ * There is no limit on the length of a line.
+ *
+ * @param r The reader.
+ * @return char* The line, or NULL at the end of the input or on error.
+ */
+char *reader_next_line(struct reader *r) {
+    // Give back the byte hidden by the '\0' of the previous line
+    if (r->saved != '\0') {
+        r->buf[r->start] = r->saved;
+        r->saved = '\0';
+    }
+
+    size_t scanned = r->start;
+    for (;;) {
+        char *nl = memchr(r->buf + scanned, '\n', r->end - scanned);
+        if (nl != NULL) {
+            char *line = r->buf + r->start;
+            r->start = nl - r->buf + 1;
+            if (r->start < r->end) {
+                r->saved = r->buf[r->start];
+            }
+            r->buf[r->start] = '\0';
+            r->lines++;
+            return line;
+        }
+
+        if (r->eof) {
+            if (r->start == r->end) {
+                return NULL;
+            }
+            // Last line without "\n"
+            char *line = r->buf + r->start;
+            r->buf[r->end] = '\n';
+            r->buf[r->end + 1] = '\0';
+            r->start = r->end;
+            r->lines++;
+            return line;
+        }
+
+        scanned = r->end - r->start;
+        int n = reader_fill(r);
+        if (n == -1) {
+            return NULL;
+        }
+        if (n == 0) {
+            r->eof = true;
+        }
+    }
+}
+
+/**
+ * @brief Give the bytes read ahead back to the file descriptor, if it is seekable.
+ *
+ * The offset of the input goes back to the end of the last line returned, as
+ * sh does before running a command: a command reading the same input ('read',
+ * 'head -1' in 'fish < script') starts at the next line, and the reader
+ * reads again from there. Nothing is done on a pipe or a terminal.
+ *
+ * @param r The reader.
+ */
+void reader_sync(struct reader *r) {
+    if (!r->seekable || r->input != NULL || r->start == r->end) {
+        return;
+    }
+    if (lseek(r->fd, -(off_t)(r->end - r->start), SEEK_CUR) == -1) {
+        r->seekable = false;
+        return;
+    }
+    // The line returned last stays in the buffer until the next call
+    r->saved = '\0';
+    r->start = 0;
+    r->end = 0;
+    r->eof = false;
+}
+
+/**
+ * @brief Release the memory used by a reader (the file descriptor is not closed).
+ *
+ * @param r The reader.
+ */
+void reader_reset(struct reader *r) {
+    free(r->buf);
+    memset(r, 0, sizeof(struct reader));
+}
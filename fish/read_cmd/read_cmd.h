@@ -0,0 +1,102 @@
+#ifndef READ_CMD_H
+#define READ_CMD_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define READER_CHUNK 65536
+
+/**
+ * @brief Buffered line reader over a file descriptor.
+ *
+ * The input is read by chunks of READER_CHUNK bytes (or more for longer
+ * lines) and the lines are returned in place, without any copy. The offset
+ * of the file descriptor is then ahead of the lines returned: reader_sync()
+ * moves it back when the input is seekable. On a pipe it cannot: unlike a
+ * reader taking one byte at a time, the commands reading the same pipe do
+ * not see the bytes read ahead ('echo "head -1
+ * text" | fish' gives nothing to head).
+ */
+struct reader {
+    int fd;
+    char *buf;
+    size_t cap;       // size of buf
+    size_t start;     // first byte not returned yet
+    size_t end;       // end of the valid data in buf
+    char saved;       // byte overwritten by the '\0' of the last line
+    bool eof;
+    bool seekable;    // the offset of fd can be moved back (regular file)
+    unsigned long lines; // number of lines returned
+    int wake_fd;         // watched while waiting for input, -1 if none
+    void (*wake)();      // called when wake_fd is readable
+    ssize_t (*input)(char *buf, size_t size); // reads the input instead of read(), NULL if none
+};
+
+/**
+ * @brief Initialize a reader on a file descriptor.
+ *
+ * @param r The reader to initialize.
+ * @param fd The file descriptor to read from.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int reader_init(struct reader *r, int fd);
+
+/**
+ * @brief Watch a second file descriptor while the reader waits for input.
+ *
+ * When "fd" becomes readable before the input, "fn" is called and the reader
+ * goes on waiting. It lets the shell handle events (terminated children)
+ * while it is idle at the prompt.
+ *
+ * @param r The reader.
+ * @param fd The file descriptor to watch.
+ * @param fn The function called when "fd" is readable.
+ */
+void reader_set_wake(struct reader *r, int fd, void (*fn)());
+
+/**
+ * @brief Read the input through a function instead of read().
+ *
+ * The function is called like read() on the file descriptor of the reader,
+ * which is not read directly anymore (used by the line editor). It waits
+ * for the input itself: the watched descriptor is not polled.
+ *
+ * @param r The reader.
+ * @param fn The function: it returns the number of bytes given, 0 at the end
+ *           of the input, or -1 on error.
+ */
+void reader_set_input(struct reader *r, ssize_t (*fn)(char *buf, size_t size));
+
+/**
+ * @brief Get the next line of the input.
+ *
+ * The returned line always ends with "\n" (one is added to a last line
+ * without it) followed by a '\0'. It stays valid until the next call.
+ * There is no limit on the length of a line.
+ *
+ * @param r The reader.
+ * @return char* The line, or NULL at the end of the input or on error.
+ */
+char *reader_next_line(struct reader *r);
+
+/**
+ * @brief Give the bytes read ahead back to the file descriptor, if it is seekable.
+ *
+ * The offset of the input goes back to the end of the last line returned, as
+ * sh does before running a command: a command reading the same input ('read',
+ * 'head -1' in 'fish < script') starts at the next line, and the reader
+ * reads again from there. Nothing is done on a pipe or a terminal.
+ *
+ * @param r The reader.
+ */
+void reader_sync(struct reader *r);
+
+/**
+ * @brief Release the memory used by a reader (the file descriptor is not closed).
+ *
+ * @param r The reader.
+ */
+void reader_reset(struct reader *r);
+
+#endif /* READ_CMD_H */
@@ -2,92 +2,270 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cmdline.h"
+#include "util.h"
+#include "spawn_cmd/spawn_cmd.h"
+#include "redirect_cmd/redirect_cmd.h"
 
 /**
- * @brief Redirect the standard input to a file.
+ * @brief Write a text in an anonymous memory file.
  *
- * This function redirects the standard input (stdin) to the specified file.
+ * The file lives in memory only (memfd_create): nothing is left on the disk,
+ * and the reader gets end-of-file after the text, whatever its size.
  *
- * @param filename The name of the file to use as the new standard input.
- * @return int Returns 0 on success, or 1 on failure.
+ * @param text The text.
+ * @param newline A flag indicating if a '\n' is added after the text.
+ * @return int The file descriptor (close-on-exec, at offset 0), or -1 on failure.
  */
-int redirect_input(char *filename) {
-    int fd = open(filename, O_RDONLY);
+static int redirect_memfd(const char *text, bool newline) {
+    int fd = memfd_create("fish-input", MFD_CLOEXEC);
     if (fd == -1) {
-        perror("open");
-        return 1;
+        perror("memfd_create");
+        return -1;
     }
-
-    if (dup2(fd, STDIN_FILENO) == -1) {
-        perror("dup2");
+    size_t len = strlen(text);
+    while (len > 0) {
+        ssize_t n = write(fd, text, len);
+        if (n == -1) {
+            perror("write");
+            close(fd);
+            return -1;
+        }
+        text += n;
+        len -= n;
+    }
+    if ((newline && write(fd, "\n", 1) != 1) || lseek(fd, 0, SEEK_SET) == -1) {
+        perror("memfd");
         close(fd);
-        return 1;
+        return -1;
     }
+    return fd;
+}
 
-    if (close(fd) == -1) {
-        perror("close");
-        return 1;
+/**
+ * @brief Get the open() flags of a redirection to a file.
+ *
+ * @param op The kind of redirection.
+ * @return int The flags, or -1 if the redirection doesn't open a file.
+ */
+static int redirect_flags(int op) {
+    switch (op) {
+    case REDIR_INPUT:  return O_RDONLY;
+    case REDIR_OUTPUT: return O_WRONLY | O_CREAT | O_TRUNC;
+    case REDIR_APPEND: return O_WRONLY | O_CREAT | O_APPEND;
+    case REDIR_RDWR:   return O_RDWR | O_CREAT;
+    default:           return -1;
     }
-    return 0;
 }
 
-
 /**
- * @brief Redirect the standard output to a file (truncate mode).
+ * @brief Add the redirections of one command of a line to a spawn request.
  *
- * This function redirects the standard output (stdout) to the specified file,
- * truncating the file if it already exists or creating it if it does not.
+ * The redirections of the command are applied in their order, after the pipes,
+ * so "cmd 2>&1 | less" sends stderr to the pipe. The first command of a
+ * background job gets /dev/null as standard input, unless it redirects it.
+ * Nothing is done to the file descriptors of the shell: the actions are applied
+ * in the child. The files are opened by the shell and given to the child, so a
+ * missing or forbidden file is reported by its name, not as an error of the
+ * command; only a FIFO is opened by the child, created with fork() (opening it
+ * waits for the other end). A here-string or a here-document is given through a memory file owned
+ * by the request.
  *
- * @param filename The name of the file to use as the new standard output.
- * @return int Returns 0 on success, or 1 on failure.
+ * @param req The spawn request of the command.
+ * @param li The parsed command line.
+ * @param i The index of the command in the line.
+ * @return int Returns 0 on success, or 1 on failure (the error is printed).
  */
-int redirect_output_trunc(char *filename) {
-    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-    if (fd == -1) {
-        perror("open");
-        return 1;
-    }
+int redirect_add_actions(struct spawn_req *req, struct line *li, size_t i) {
+    const struct cmd *cmd = &li->cmds[i];
 
-    if (dup2(fd, STDOUT_FILENO) == -1) {
-        perror("dup2");
-        close(fd);
+    // A background job never reads the input of the shell (terminal or script):
+    // its first command gets /dev/null as standard input, unless it redirects it
+    bool own_input = false;
+    for (size_t k = 0; k < cmd->n_redirs; ++k) {
+        own_input |= cmd->redirs[k].fd == STDIN_FILENO;
+    }
+    if (i == 0 && li->background && !own_input
+        && spawn_add_open(req, STDIN_FILENO, "/dev/null", O_RDONLY, 0) != 0) {
         return 1;
     }
 
-    if (close(fd) == -1) {
-        perror("close");
-        return 1;
+    for (size_t k = 0; k < cmd->n_redirs; ++k) {
+        const struct redir *r = &cmd->redirs[k];
+        int err = 0;
+        switch (r->op) {
+        case REDIR_DUP:
+            err = spawn_add_dup2(req, r->src_fd, r->fd);
+            break;
+        case REDIR_CLOSE:
+            err = spawn_add_close(req, r->fd);
+            break;
+        case REDIR_STRING:
+        case REDIR_HEREDOC: {
+            int fd = redirect_memfd(r->target, r->op == REDIR_STRING);
+            err = fd == -1 || spawn_add_fd(req, fd, r->fd) != 0;
+            break;
+        }
+        default: {
+            struct stat st;
+            if (stat(r->target, &st) == 0 && S_ISFIFO(st.st_mode)) {
+                req->fork = true;
+                err = spawn_add_open(req, r->fd, r->target, redirect_flags(r->op), 0666);
+                break;
+            }
+            int fd = open(r->target, redirect_flags(r->op) | O_CLOEXEC, 0666);
+            if (fd == -1) {
+                perror(r->target);
+                return 1;
+            }
+            err = spawn_add_fd(req, fd, r->fd);
+            break;
+        }
+        }
+        if (err) {
+            return 1;
+        }
     }
     return 0;
 }
 
-
 /**
- * @brief Redirect the standard output to a file (append mode).
+ * @brief Put back the file descriptors of the shell saved by redirect_apply().
  *
- * This function redirects the standard output (stdout) to the specified file,
- * appending to the file if it already exists or creating it if it does not.
+ * @param saved The saved descriptors (released).
+ */
+void redirect_restore(struct redirect_saved *saved) {
+    // What the command wrote goes to its redirections, not to the shell
+    fflush(stdout);
+    fflush(stderr);
+    for (size_t k = saved->n; k > 0; --k) {
+        int fd = saved->fds[k - 1].fd;
+        int copy = saved->fds[k - 1].copy;
+        if (copy == -1) {
+            close(fd);
+        } else {
+            // dup3() keeps a close-on-exec descriptor of the shell (the
+            // SIGCHLD pipe) from leaking into the next commands
+            dup3(copy, fd, saved->fds[k - 1].flags & FD_CLOEXEC ? O_CLOEXEC : 0);
+            close(copy);
+        }
+    }
+    free(saved->fds);
+    memset(saved, 0, sizeof(struct redirect_saved));
+}
+
+/**
+ * @brief Save a file descriptor of the shell before a redirection replaces it.
  *
- * @param filename The name of the file to use as the new standard output.
+ * @param saved The saved descriptors (room for one more is reserved).
+ * @param fd The descriptor.
  * @return int Returns 0 on success, or 1 on failure.
  */
-int redirect_output_append(char *filename) {
-    int fd = open(filename, O_WRONLY | O_CREAT | O_APPEND, 0666);
-    if (fd == -1) {
-        perror("open");
+static int redirect_save(struct redirect_saved *saved, int fd) {
+    for (size_t k = 0; k < saved->n; ++k) {
+        if (saved->fds[k].fd == fd) {
+            return 0;
+        }
+    }
+    // The copy is taken above the descriptors a script can name (0 to 9)
+    int copy = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+    if (copy == -1 && errno != EBADF) {
+        perror("fcntl");
         return 1;
     }
+    saved->fds[saved->n].fd = fd;
+    saved->fds[saved->n].copy = copy;
+    saved->fds[saved->n].flags = copy != -1 ? fcntl(fd, F_GETFD) : 0;
+    saved->n++;
+    return 0;
+}
 
-    if (dup2(fd, STDOUT_FILENO) == -1) {
-        perror("dup2");
-        close(fd);
+/**
+ * @brief Apply the redirections of a command run by the shell itself.
+ *
+ * Each redirected descriptor of the shell is saved first (a copy above 10),
+ * then the redirections are applied in order with dup2(), like in a child,
+ * as sh does: 'cd dir 2>/dev/null' is silent. redirect_restore() puts the
+ * descriptors of the shell back. On failure, they are already restored.
+ * It is the only place where the shell changes its own descriptors: the
+ * command writes to its standard streams and must change the shell itself
+ * (cd, set), so neither a child nor a separate output descriptor would do.
+ *
+ * @param cmd The command.
+ * @param saved Receives the saved descriptors.
+ * @return int Returns 0 on success, or 1 on failure (the error is printed).
+ */
+int redirect_apply(const struct cmd *cmd, struct redirect_saved *saved) {
+    memset(saved, 0, sizeof(struct redirect_saved));
+    if (cmd->n_redirs == 0) {
+        return 0;
+    }
+    saved->fds = malloc(cmd->n_redirs * sizeof(saved->fds[0]));
+    if (saved->fds == NULL) {
+        perror("malloc");
+        redirect_restore(saved);
         return 1;
     }
+    // The output of the shell so far goes to its own descriptors
+    fflush(stdout);
+    fflush(stderr);
 
-    if (close(fd) == -1) {
-        perror("close");
-        return 1;
+    for (size_t k = 0; k < cmd->n_redirs; ++k) {
+        const struct redir *r = &cmd->redirs[k];
+        // The input read ahead by the shell goes back to its standard input
+        // before it is replaced: nothing is left to give back to the new one
+        // ('parallel cmd < file' launching processes)
+        if (r->fd == STDIN_FILENO) {
+            spawn_sync_input();
+        }
+        if (redirect_save(saved, r->fd) != 0) {
+            redirect_restore(saved);
+            return 1;
+        }
+        int fd = -1;
+        int err = 0;
+        switch (r->op) {
+        case REDIR_DUP:
+            if (r->src_fd != r->fd && dup2(r->src_fd, r->fd) == -1) {
+                fprintf(stderr, "fish: %d: %s\n", r->src_fd, strerror(errno));
+                err = 1;
+            }
+            break;
+        case REDIR_CLOSE:
+            close(r->fd);
+            break;
+        case REDIR_STRING:
+        case REDIR_HEREDOC:
+            fd = redirect_memfd(r->target, r->op == REDIR_STRING);
+            err = fd == -1;
+            break;
+        default:
+            fd = open(r->target, redirect_flags(r->op) | O_CLOEXEC, 0666);
+            if (fd == -1) {
+                perror(r->target);
+                err = 1;
+            }
+            break;
+        }
+        if (fd == r->fd) {
+            // Opened on the redirected descriptor itself (it was closed)
+            fcntl(fd, F_SETFD, 0);
+        } else if (fd != -1) {
+            if (dup2(fd, r->fd) == -1) {
+                perror("dup2");
+                err = 1;
+            }
+            close(fd);
+        }
+        if (err) {
+            redirect_restore(saved);
+            return 1;
+        }
     }
     return 0;
-}
\ No newline at end of file
+}
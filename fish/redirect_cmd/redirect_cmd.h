@@ -1,36 +1,63 @@
 #ifndef REDIRECT_COMMAND_H
 #define REDIRECT_COMMAND_H
 
+#include "cmdline.h"
+#include "spawn_cmd/spawn_cmd.h"
+
 /**
- * @brief Redirect the standard input to a file.
+ * @brief Add the redirections of one command of a line to a spawn request.
  *
- * This function redirects the standard input (stdin) to the specified file.
+ * The redirections of the command are applied in their order, after the pipes,
+ * so "cmd 2>&1 | less" sends stderr to the pipe. The first command of a
+ * background job gets /dev/null as standard input, unless it redirects it.
+ * Nothing is done to the file descriptors of the shell: the actions are applied
+ * in the child. The files are opened by the shell and given to the child, so a
+ * missing or forbidden file is reported by its name, not as an error of the
+ * command; only a FIFO is opened by the child, created with fork() (opening it
+ * waits for the other end). A here-string or a here-document is given through a memory file owned
+ * by the request.
  *
- * @param filename The name of the file to use as the new standard input.
+ * @param req The spawn request of the command.
+ * @param li The parsed command line.
+ * @param i The index of the command in the line.
  * @return int Returns 0 on success, or 1 on failure.
  */
-int redirect_input(char *filename);
+int redirect_add_actions(struct spawn_req *req, struct line *li, size_t i);
+
+/**
+ * @brief The file descriptors of the shell replaced by the redirections of an internal command.
+ */
+struct redirect_saved {
+    struct {
+        int fd;    // the redirected descriptor
+        int copy;  // its copy (close-on-exec), -1 for a descriptor that was closed
+        int flags; // its descriptor flags (FD_CLOEXEC for a descriptor of the shell)
+    } *fds;
+    size_t n;
+};
 
 /**
- * @brief Redirect the standard output to a file (truncate mode).
+ * @brief Apply the redirections of a command run by the shell itself.
  *
- * This function redirects the standard output (stdout) to the specified file,
- * truncating the file if it already exists or creating it if it does not.
+ * Each redirected descriptor of the shell is saved first (a copy above 10),
+ * then the redirections are applied in order with dup2(), like in a child,
+ * as sh does: 'cd dir 2>/dev/null' is silent. redirect_restore() puts the
+ * descriptors of the shell back. On failure, they are already restored.
+ * It is the only place where the shell changes its own descriptors: the
+ * command writes to its standard streams and must change the shell itself
+ * (cd, set), so neither a child nor a separate output descriptor would do.
  *
- * @param filename The name of the file to use as the new standard output.
- * @return int Returns 0 on success, or 1 on failure.
+ * @param cmd The command.
+ * @param saved Receives the saved descriptors.
+ * @return int Returns 0 on success, or 1 on failure (the error is printed).
  */
-int redirect_output_trunc(char *filename);
+int redirect_apply(const struct cmd *cmd, struct redirect_saved *saved);
 
 /**
- * @brief Redirect the standard output to a file (append mode).
- *
- * This function redirects the standard output (stdout) to the specified file,
- * appending to the file if it already exists or creating it if it does not.
+ * @brief Put back the file descriptors of the shell saved by redirect_apply().
  *
- * @param filename The name of the file to use as the new standard output.
- * @return int Returns 0 on success, or 1 on failure.
+ * @param saved The saved descriptors (released).
  */
-int redirect_output_append(char *filename);
+void redirect_restore(struct redirect_saved *saved);
 
 #endif /* REDIRECT_COMMAND_H */
\ No newline at end of file
@@ -0,0 +1,423 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/types.h>
+
+#include "spawn_cmd.h"
+#include "hash_cmd/hash_cmd.h"
+#include "var_cmd/var_cmd.h"
+
+static void (*input_sync)() = NULL;
+
+
+/**
+ * @brief Set the function giving the input read ahead by the shell back to its standard input.
+ *
+ * It is called before a process that inherits the standard input of the
+ * shell is launched, and before an internal command reads it.
+ *
+ * @param fn The function, or NULL.
+ */
+void spawn_set_input_sync(void (*fn)()) {
+    input_sync = fn;
+}
+
+/**
+ * @brief Give the input read ahead by the shell back to its standard input.
+ *
+ * A command reading the standard input of the shell then starts right after
+ * the line being run.
+ */
+void spawn_sync_input() {
+    if (input_sync != NULL) {
+        input_sync();
+    }
+}
+
+/**
+ * @brief Check if the child of a request gets the standard input of the shell.
+ *
+ * A pipe, /dev/null (background job) or a redirection on fd 0 replaces it.
+ *
+ * @param req The request.
+ * @return bool Returns true if the child can read the standard input of the shell.
+ */
+static bool spawn_inherits_input(const struct spawn_req *req) {
+    for (size_t i = 0; i < req->n_actions; ++i) {
+        const struct spawn_action *a = &req->actions[i];
+        if (a->kind == SPAWN_DUP2 && a->src_fd == STDIN_FILENO) {
+            // Copied before being replaced ('3<&0')
+            return true;
+        }
+        if (a->fd == STDIN_FILENO) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Initialize a spawn request.
+ *
+ * @param req The request to initialize.
+ * @param args The arguments of the command, args[0] being the command itself.
+ * @param background A flag indicating if the process runs in the background.
+ */
+void spawn_req_init(struct spawn_req *req, char **args, bool background) {
+    memset(req, 0, sizeof(struct spawn_req));
+    req->args = args;
+    req->background = background;
+    req->pgroup = -1;
+}
+
+/**
+ * @brief Release the memory used by a spawn request.
+ *
+ * The file descriptors given by spawn_add_fd() are closed.
+ *
+ * @param req The request to reset.
+ */
+void spawn_req_reset(struct spawn_req *req) {
+    for (size_t i = 0; i < req->n_actions; ++i) {
+        if (req->actions[i].owned) {
+            close(req->actions[i].src_fd);
+        }
+    }
+    free(req->actions);
+    memset(req, 0, sizeof(struct spawn_req));
+}
+
+/**
+ * @brief Append an action to a spawn request, growing the array if needed.
+ *
+ * @param req The request.
+ * @param action The action to append.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+static int spawn_add_action(struct spawn_req *req, struct spawn_action action) {
+    if (req->n_actions == req->cap_actions) {
+        size_t cap = req->cap_actions ? 2 * req->cap_actions : 4;
+        struct spawn_action *actions = realloc(req->actions, cap * sizeof(struct spawn_action));
+        if (actions == NULL) {
+            perror("realloc");
+            return 1;
+        }
+        req->actions = actions;
+        req->cap_actions = cap;
+    }
+    req->actions[req->n_actions++] = action;
+    return 0;
+}
+
+/**
+ * @brief Add an open() action on "fd" to a spawn request.
+ *
+ * @param req The request.
+ * @param fd The file descriptor to open in the child.
+ * @param path The file to open (must live until spawn_process() returns).
+ * @param flags The flags given to open().
+ * @param mode The mode given to open().
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int spawn_add_open(struct spawn_req *req, int fd, const char *path, int flags, mode_t mode) {
+    struct spawn_action action = { .kind = SPAWN_OPEN, .fd = fd, .path = path, .flags = flags, .mode = mode };
+    return spawn_add_action(req, action);
+}
+
+/**
+ * @brief Add a dup2(src_fd, fd) action to a spawn request.
+ *
+ * @param req The request.
+ * @param src_fd The file descriptor to duplicate.
+ * @param fd The target file descriptor.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int spawn_add_dup2(struct spawn_req *req, int src_fd, int fd) {
+    struct spawn_action action = { .kind = SPAWN_DUP2, .fd = fd, .src_fd = src_fd };
+    return spawn_add_action(req, action);
+}
+
+/**
+ * @brief Give an open file descriptor of the shell to the child.
+ *
+ * A dup2(src_fd, fd) action is added, and "src_fd" is owned by the request:
+ * it is closed in the shell by spawn_req_reset(), even if this call fails.
+ *
+ * @param req The request.
+ * @param src_fd The file descriptor to give (it should be close-on-exec).
+ * @param fd The target file descriptor.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int spawn_add_fd(struct spawn_req *req, int src_fd, int fd) {
+    struct spawn_action action = { .kind = SPAWN_DUP2, .fd = fd, .src_fd = src_fd, .owned = true };
+    if (spawn_add_action(req, action) != 0) {
+        close(src_fd);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Add a close(fd) action to a spawn request.
+ *
+ * @param req The request.
+ * @param fd The file descriptor to close in the child.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int spawn_add_close(struct spawn_req *req, int fd) {
+    struct spawn_action action = { .kind = SPAWN_CLOSE, .fd = fd };
+    return spawn_add_action(req, action);
+}
+
+/**
+ * @brief Apply the actions of a spawn request in the current process.
+ *
+ * Only called in a forked child (fallback path).
+ *
+ * @param req The request.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+static int spawn_apply_actions(const struct spawn_req *req) {
+    for (size_t i = 0; i < req->n_actions; ++i) {
+        const struct spawn_action *a = &req->actions[i];
+        switch (a->kind) {
+        case SPAWN_OPEN: {
+            int fd = open(a->path, a->flags, a->mode);
+            if (fd == -1) {
+                perror(a->path);
+                return 1;
+            }
+            if (fd != a->fd) {
+                if (dup2(fd, a->fd) == -1) {
+                    perror("dup2");
+                    close(fd);
+                    return 1;
+                }
+                close(fd);
+            }
+            break;
+        }
+        case SPAWN_DUP2:
+            if (dup2(a->src_fd, a->fd) == -1) {
+                perror("dup2");
+                return 1;
+            }
+            break;
+        case SPAWN_CLOSE:
+            close(a->fd);
+            break;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Build the arguments running a file without a valid header (a script without "#!") with /bin/sh.
+ *
+ * execvp() does it when execve() fails with ENOEXEC; posix_spawn() does not.
+ *
+ * @param path The path of the file.
+ * @param args The arguments of the command, NULL terminated.
+ * @return char** "/bin/sh path args[1] ... NULL" (to free), or NULL on failure.
+ */
+static char **spawn_sh_args(const char *path, char **args) {
+    size_t n = 0;
+    while (args[n] != NULL) {
+        ++n;
+    }
+    char **sh_args = malloc((n + 2) * sizeof(char *));
+    if (sh_args != NULL) {
+        sh_args[0] = "/bin/sh";
+        sh_args[1] = (char *)path;
+        memcpy(sh_args + 2, args + 1, n * sizeof(char *));
+    }
+    return sh_args;
+}
+
+/**
+ * @brief Execute the command of a request in a forked child.
+ *
+ * Like posix_spawn() in spawn_process(): the resolved path is executed, and a
+ * file that is not an executable format is given to /bin/sh.
+ *
+ * @param req The request.
+ * @return int The exit status of the child (127): it only returns on failure.
+ */
+static int spawn_exec(struct spawn_req *req) {
+    const char *path = hash_lookup(req->args[0]);
+    if (path != NULL) {
+        execve(path, req->args, var_environ());
+        char **sh_args = errno == ENOEXEC ? spawn_sh_args(path, req->args) : NULL;
+        if (sh_args != NULL) {
+            execve("/bin/sh", sh_args, var_environ());
+        }
+    } else {
+        errno = ENOENT;
+    }
+    fprintf(stderr, "Exec error: %s: %s\n", req->args[0], strerror(errno));
+    return 127;
+}
+
+/**
+ * @brief Launch a request with fork(), running req->fn in the child.
+ *
+ * Without req->fn, the child executes the command of the request.
+ *
+ * @param req The request.
+ * @return pid_t The pid of the child, or -1 on error.
+ */
+static pid_t spawn_with_fork(struct spawn_req *req) {
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return -1;
+    }
+
+    if (pid == 0) { // Child process
+        if (req->pgroup != -1) {
+            setpgid(0, req->pgroup);
+        }
+        struct sigaction default_action;
+        sigemptyset(&default_action.sa_mask);
+        default_action.sa_flags = SA_RESTART;
+        default_action.sa_handler = SIG_DFL;
+        if (!req->background) {
+            // Reset SIGINT handler to default for foreground commands
+            sigaction(SIGINT, &default_action, NULL);
+        }
+        sigaction(SIGTSTP, &default_action, NULL);
+        sigaction(SIGTTIN, &default_action, NULL);
+        sigaction(SIGTTOU, &default_action, NULL);
+        if (spawn_apply_actions(req) != 0) {
+            _exit(EXIT_FAILURE);
+        }
+        int status = req->fn != NULL ? req->fn(req->ctx) : spawn_exec(req);
+        fflush(NULL);
+        _exit(status);
+    }
+    // Also done in the parent: the group exists before the next stage joins it
+    if (req->pgroup != -1) {
+        setpgid(pid, req->pgroup == 0 ? pid : req->pgroup);
+    }
+    return pid;
+}
+
+/**
+ * @brief Launch a file without a valid header (a script without "#!") with /bin/sh.
+ *
+ * @param pid Receives the pid of the child.
+ * @param path The path of the file.
+ * @param actions The file actions of the request.
+ * @param attr The attributes of the request.
+ * @param args The arguments of the command, NULL terminated.
+ * @return int Returns 0 on success, or an error number.
+ */
+static int spawn_script(pid_t *pid, const char *path, const posix_spawn_file_actions_t *actions,
+                        const posix_spawnattr_t *attr, char **args) {
+    char **sh_args = spawn_sh_args(path, args);
+    if (sh_args == NULL) {
+        return ENOMEM;
+    }
+    int err = posix_spawn(pid, "/bin/sh", actions, attr, sh_args, var_environ());
+    free(sh_args);
+    return err;
+}
+
+/**
+ * @brief Launch the process described by a spawn request.
+ *
+ * External commands are launched with posix_spawn(), which uses
+ * clone(CLONE_VM|CLONE_VFORK) on Linux, so the page tables of the shell are
+ * never copied. The command is resolved with hash_lookup() and executed
+ * with execve(); a file that is not an executable format is given to /bin/sh,
+ * like execvp() does. The fork() fallback is only used when req->fn or
+ * req->fork is set.
+ * Foreground processes get the default SIGINT disposition back, and all the
+ * processes get the default disposition of the stop signals.
+ *
+ * @param req The request.
+ * @return pid_t The pid of the child, or -1 on error (the error is printed to stderr).
+ */
+pid_t spawn_process(struct spawn_req *req) {
+    // The child may read the standard input of the shell (fish < script)
+    if (spawn_inherits_input(req)) {
+        spawn_sync_input();
+    }
+    if (req->fn != NULL || req->fork) {
+        return spawn_with_fork(req);
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+
+    int err = 0;
+    for (size_t i = 0; i < req->n_actions && err == 0; ++i) {
+        const struct spawn_action *a = &req->actions[i];
+        switch (a->kind) {
+        case SPAWN_OPEN:
+            err = posix_spawn_file_actions_addopen(&actions, a->fd, a->path, a->flags, a->mode);
+            break;
+        case SPAWN_DUP2:
+            err = posix_spawn_file_actions_adddup2(&actions, a->src_fd, a->fd);
+            break;
+        case SPAWN_CLOSE:
+            err = posix_spawn_file_actions_addclose(&actions, a->fd);
+            break;
+        }
+    }
+
+    short flags = POSIX_SPAWN_SETSIGDEF;
+    sigset_t sigdefault;
+    sigemptyset(&sigdefault);
+    if (!req->background) {
+        // Reset SIGINT handler to default for foreground commands
+        sigaddset(&sigdefault, SIGINT);
+    }
+    // The stop signals are ignored by an interactive shell, not by its children
+    sigaddset(&sigdefault, SIGTSTP);
+    sigaddset(&sigdefault, SIGTTIN);
+    sigaddset(&sigdefault, SIGTTOU);
+    posix_spawnattr_setsigdefault(&attr, &sigdefault);
+    if (req->pgroup != -1) {
+        posix_spawnattr_setpgroup(&attr, req->pgroup);
+        flags |= POSIX_SPAWN_SETPGROUP;
+    }
+    posix_spawnattr_setflags(&attr, flags);
+
+    // Launch the resolved path with execve(): no $PATH scan per launch.
+    // A remembered path that has disappeared is looked up again once
+    // (ENOENT may also come from a file action: the path itself is checked).
+    pid_t pid = -1;
+    for (int attempt = 0; err == 0; ++attempt) {
+        const char *path = hash_lookup(req->args[0]);
+        if (path == NULL) {
+            err = ENOENT;
+            break;
+        }
+        err = posix_spawn(&pid, path, &actions, &attr, req->args, var_environ());
+        if (err == ENOEXEC) {
+            err = spawn_script(&pid, path, &actions, &attr, req->args);
+        }
+        if (err != ENOENT || attempt > 0 || path == req->args[0] || access(path, X_OK) == 0) {
+            break;
+        }
+        hash_forget(req->args[0]);
+        err = 0;
+    }
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (err != 0) {
+        fprintf(stderr, "Exec error: %s: %s\n", req->args[0], strerror(err));
+        return -1;
+    }
+    return pid;
+}
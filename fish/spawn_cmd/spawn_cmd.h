@@ -0,0 +1,152 @@
+#ifndef SPAWN_CMD_H
+#define SPAWN_CMD_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/**
+ * @brief Kind of file descriptor action applied in the child before the exec.
+ */
+enum spawn_action_kind {
+    SPAWN_OPEN,  // open(path, flags, mode) on fd
+    SPAWN_DUP2,  // dup2(src_fd, fd)
+    SPAWN_CLOSE, // close(fd)
+};
+
+/**
+ * @brief One file descriptor action (redirection, pipe end, /dev/null, ...).
+ */
+struct spawn_action {
+    enum spawn_action_kind kind;
+    int fd;
+    int src_fd;       // only used by SPAWN_DUP2
+    bool owned;       // only used by SPAWN_DUP2: src_fd is closed by spawn_req_reset()
+    const char *path; // only used by SPAWN_OPEN
+    int flags;        // only used by SPAWN_OPEN
+    mode_t mode;      // only used by SPAWN_OPEN
+};
+
+/**
+ * @brief Description of a process to launch.
+ *
+ * The file descriptor actions are applied in order in the child, after
+ * the fork or the vfork, and before the command is executed.
+ * If "fn" is not NULL, the child runs fn(ctx) instead of executing "args"
+ * (used for the internal commands that must run in a child process), and
+ * the process is created with a real fork(). "fork" also asks for a real
+ * fork() for an external command, whose file actions may wait (opening a FIFO
+ * waits for the other end, and posix_spawn() blocks the shell until the exec).
+ * "pgroup" is the process group joined by the child: 0 for a new group led
+ * by the child, -1 to stay in the group of the shell.
+ */
+struct spawn_req {
+    char **args;
+    struct spawn_action *actions;
+    size_t n_actions;
+    size_t cap_actions;
+    bool background;
+    bool fork;
+    pid_t pgroup;
+    int (*fn)(void *ctx);
+    void *ctx;
+};
+
+/**
+ * @brief Initialize a spawn request.
+ *
+ * @param req The request to initialize.
+ * @param args The arguments of the command, args[0] being the command itself.
+ * @param background A flag indicating if the process runs in the background.
+ */
+void spawn_req_init(struct spawn_req *req, char **args, bool background);
+
+/**
+ * @brief Release the memory used by a spawn request.
+ *
+ * The file descriptors given by spawn_add_fd() are closed.
+ *
+ * @param req The request to reset.
+ */
+void spawn_req_reset(struct spawn_req *req);
+
+/**
+ * @brief Set the function giving the input read ahead by the shell back to its standard input.
+ *
+ * It is called before a process that inherits the standard input of the
+ * shell is launched, and before an internal command reads it.
+ *
+ * @param fn The function, or NULL.
+ */
+void spawn_set_input_sync(void (*fn)());
+
+/**
+ * @brief Give the input read ahead by the shell back to its standard input.
+ *
+ * A command reading the standard input of the shell then starts right after
+ * the line being run.
+ */
+void spawn_sync_input();
+
+/**
+ * @brief Add an open() action on "fd" to a spawn request.
+ *
+ * @param req The request.
+ * @param fd The file descriptor to open in the child.
+ * @param path The file to open (must live until spawn_process() returns).
+ * @param flags The flags given to open().
+ * @param mode The mode given to open().
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int spawn_add_open(struct spawn_req *req, int fd, const char *path, int flags, mode_t mode);
+
+/**
+ * @brief Add a dup2(src_fd, fd) action to a spawn request.
+ *
+ * @param req The request.
+ * @param src_fd The file descriptor to duplicate.
+ * @param fd The target file descriptor.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int spawn_add_dup2(struct spawn_req *req, int src_fd, int fd);
+
+/**
+ * @brief Give an open file descriptor of the shell to the child.
+ *
+ * A dup2(src_fd, fd) action is added, and "src_fd" is owned by the request:
+ * it is closed in the shell by spawn_req_reset(), even if this call fails.
+ *
+ * @param req The request.
+ * @param src_fd The file descriptor to give (it should be close-on-exec).
+ * @param fd The target file descriptor.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int spawn_add_fd(struct spawn_req *req, int src_fd, int fd);
+
+/**
+ * @brief Add a close(fd) action to a spawn request.
+ *
+ * @param req The request.
+ * @param fd The file descriptor to close in the child.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int spawn_add_close(struct spawn_req *req, int fd);
+
+/**
+ * @brief Launch the process described by a spawn request.
+ *
+ * External commands are launched with posix_spawn(), which uses
+ * clone(CLONE_VM|CLONE_VFORK) on Linux, so the page tables of the shell are
+ * never copied. The command is resolved with hash_lookup() and executed
+ * with execve(); a file that is not an executable format is given to /bin/sh,
+ * like execvp() does. The fork() fallback is only used when req->fn or
+ * req->fork is set.
+ * Foreground processes get the default SIGINT disposition back, and all the
+ * processes get the default disposition of the stop signals.
+ *
+ * @param req The request.
+ * @return pid_t The pid of the child, or -1 on error (the error is printed to stderr).
+ */
+pid_t spawn_process(struct spawn_req *req);
+
+#endif /* SPAWN_CMD_H */
@@ -2,118 +2,52 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
-#include <libgen.h>
 #include <signal.h>
 #include <sys/wait.h>
 #include <sys/types.h>
 #include <fcntl.h>
 #include "cmdline.h"
+#include "util.h"
 
 
-volatile pid_t bg_processes[MAX_CMDS];
-volatile size_t bg_index = 0;
-volatile pid_t fg_processes[MAX_CMDS];
-volatile size_t fg_index = 0;
+bool shell_interactive = true;
+bool shell_pipefail = false; // set -o pipefail
+bool shell_nullglob = false; // set -o nullglob
+int shell_status = 0;        // exit code of the last command line
 
 #define BUFLEN 512
 
 
-/**
- * @brief Get the current working directory.
- *
- * This function allocates memory and retrieves the current working directory.
- * The caller is responsible for freeing the allocated memory.
- *
- * @return char* The current working directory.
- */
-char* get_current_dir_name() {
-  char* cwd = (char*)malloc(BUFLEN * sizeof(char));
-  if (cwd == NULL) {
-    perror("fish");
-    exit(EXIT_FAILURE);
-  }
+static char prompt[BUFLEN] = "fish> "; // built by prompt_refresh()
 
-  if (getcwd(cwd, BUFLEN) == NULL) {
-    perror("fish");
-    free(cwd);
-    exit(EXIT_FAILURE);
-  }
-
-  return cwd;
-}
 
 /**
- * @brief Update the shell prompt with the current directory.
+ * @brief Change the text of the shell prompt.
  *
- * This function updates the shell prompt to display the current working directory.
+ * @param text The new prompt (truncated if it is too long).
  */
-void update_prompt() {
-  char* cwd = get_current_dir_name();
-  char* base = basename(cwd);
-  printf("fish %s> ", base);
-  fflush(stdout);  // Force the output buffer to be flushed
-  free(cwd);
+void set_prompt(const char *text) {
+  snprintf(prompt, sizeof(prompt), "%s", text);
 }
 
 /**
- * @brief Remove an element from an array of pids.
- *
- * This function removes an element at the specified index from the array and shifts
- * the remaining elements to fill the gap.
+ * @brief Get the text of the shell prompt.
  *
- * @param array The array of pids.
- * @param size The size of the array.
- * @param index The index of the element to remove.
+ * @return const char* The prompt (owned by the shell).
  */
-void remove_element(volatile pid_t *array, int size, size_t index) {
-  for (int i = index; i < size - 1; ++i) {
-    array[i] = array[i+1];
-  }
-  array[size - 1] = 0;
-}
-
-/**
- * @brief Checks if the standard input (stdin) is redirected.
- * 
- * This function checks whether the standard input is coming from a terminal
- * (tty) or if it has been redirected from a file or another source. It uses
- * the `isatty` function to determine this.
- * 
- * @return int Returns 0 if stdin is coming from a terminal (not redirected),
- *             and returns a non-zero value if stdin is redirected.
- */
-int is_input_redirected() {
-    // Check if standard input is redirected
-    return !isatty(STDIN_FILENO);
+const char *get_prompt() {
+  return prompt;
 }
 
 /**
- * @brief Redirects the standard input (stdin) to /dev/null.
- * 
- * This function opens /dev/null for reading and redirects the standard input
- * to read from /dev/null instead. This is useful for background processes that
- * should not read from the terminal.
- * 
- * @return int Returns 0 on success, or 1 if an error occurs.
+ * @brief Print the shell prompt.
+ *
+ * The prompt is built beforehand (set_prompt()): printing it needs no other
+ * system call than the write.
  */
-int redirect_input_to_dev_null() {
-    int dev_null_fd = open("/dev/null", O_RDONLY);
-    if (dev_null_fd == -1) {
-        perror("Error opening /dev/null");
-        return 1;
-    }
-
-    if (dup2(dev_null_fd, STDIN_FILENO) == -1) {
-        perror("Error redirecting input to /dev/null");
-        close(dev_null_fd);
-        return 1;
-    }
-
-    if (close(dev_null_fd) == -1) {
-        perror("close");
-        return 1;
-    }
-    return 0;
+void update_prompt() {
+  fputs(prompt, stdout);
+  fflush(stdout);  // Force the output buffer to be flushed
 }
 
 /**
@@ -121,12 +55,17 @@ int redirect_input_to_dev_null() {
  *
  * This function prints the status of a foreground or background process, including
  * whether it exited normally or was terminated by a signal.
+ * Nothing is printed when the shell is not interactive (batch mode).
  *
  * @param pid The process ID.
  * @param status The status returned by waitpid.
  * @param is_background A flag indicating if the process is a background process.
  */
 void print_process_status(pid_t pid, int status, int is_background) {
+  // Processes are only reported to an interactive user
+  if (!shell_interactive) {
+    return;
+  }
   char *buf = calloc(BUFLEN, sizeof(char));
   if (WIFEXITED(status)) {
     int exit_status = WEXITSTATUS(status);
@@ -2,69 +2,40 @@
 #define UTIL_H
 
 
-extern volatile pid_t bg_processes[MAX_CMDS];
-extern volatile size_t bg_index;
-extern volatile pid_t fg_processes[MAX_CMDS];
-extern volatile size_t fg_index;
+extern bool shell_interactive;
+extern bool shell_pipefail;
+extern bool shell_nullglob;
+extern int shell_status;
 
 
 /**
- * @brief Get the current working directory.
+ * @brief Change the text of the shell prompt.
  *
- * This function allocates memory and retrieves the current working directory.
- * The caller is responsible for freeing the allocated memory.
- *
- * @return char* The current working directory.
+ * @param text The new prompt (truncated if it is too long).
  */
-char* get_current_dir_name();
+void set_prompt(const char *text);
 
 /**
- * @brief Update the shell prompt with the current directory.
+ * @brief Get the text of the shell prompt.
  *
- * This function updates the shell prompt to display the current working directory.
+ * @return const char* The prompt (owned by the shell).
  */
-void update_prompt();
+const char *get_prompt();
 
 /**
- * @brief Remove an element from an array of pids.
- *
- * This function removes an element at the specified index from the array and shifts
- * the remaining elements to fill the gap.
+ * @brief Print the shell prompt.
  *
- * @param array The array of pids.
- * @param size The size of the array.
- * @param index The index of the element to remove.
- */
-void remove_element(volatile pid_t *array, int size, size_t index);
-
-/**
- * @brief Checks if the standard input (stdin) is redirected.
- * 
- * This function checks whether the standard input is coming from a terminal
- * (tty) or if it has been redirected from a file or another source. It uses
- * the `isatty` function to determine this.
- * 
- * @return int Returns 0 if stdin is coming from a terminal (not redirected),
- *             and returns a non-zero value if stdin is redirected.
+ * The prompt is built beforehand (set_prompt()): printing it needs no other
+ * system call than the write.
  */
-int is_input_redirected();
-
-/**
- * @brief Redirects the standard input (stdin) to /dev/null.
- * 
- * This function opens /dev/null for reading and redirects the standard input
- * to read from /dev/null instead. This is useful for background processes that
- * should not read from the terminal.
- * 
- * @return int Returns 0 on success, or 1 if an error occurs.
- */
-int redirect_input_to_dev_null();
+void update_prompt();
 
 /**
  * @brief Print the status of a process.
  *
  * This function prints the status of a foreground or background process, including
  * whether it exited normally or was terminated by a signal.
+ * Nothing is printed when the shell is not interactive (batch mode).
  *
  * @param pid The process ID.
  * @param status The status returned by waitpid.
@@ -0,0 +1,722 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "var_cmd.h"
+#include "util.h"
+
+#define VAR_MIN_SIZE 128 // must be a power of 2
+
+extern char **environ;
+
+/**
+ * @brief One binding of a variable, in a scope.
+ */
+struct var_binding {
+    char *value;              // NULL if the variable is unset
+    bool exported;
+    size_t level;             // scope of the binding, 0 for the global scope
+    struct var_binding *prev; // binding hidden by this one, in an outer scope
+};
+
+/**
+ * @brief One variable name, and its innermost binding.
+ */
+struct var_entry {
+    char *name; // NULL if the slot is empty
+    struct var_binding *top;
+};
+
+/**
+ * @brief Open addressing hash table (linear probing) of the variables.
+ */
+static struct {
+    struct var_entry *slots;
+    size_t size; // number of slots, a power of 2
+    size_t count;
+
+    size_t level;        // innermost scope
+    char **bound;        // names bound by var_set_local(), in order
+    size_t n_bound;
+    size_t cap_bound;
+    size_t *scope_start; // for each scope, its first name in "bound"
+    size_t cap_scopes;
+
+    char **envp;         // environment given to the commands
+    char *env_buf;       // the "name=value" strings of envp
+    bool env_dirty;      // an exported variable changed since envp was built
+} table = { .env_dirty = true };
+
+
+/**
+ * @brief FNV-1a hash of a name.
+ *
+ * @param name The name.
+ * @param len The length of the name.
+ * @return uint64_t The hash.
+ */
+static uint64_t var_hash(const char *name, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)name[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/**
+ * @brief Find the slot of a name: the slot holding it, or the empty slot where it would go.
+ *
+ * @param name The name (not necessarily '\0' terminated).
+ * @param len The length of the name.
+ * @return struct var_entry* The slot.
+ */
+static struct var_entry *var_slot(const char *name, size_t len) {
+    size_t mask = table.size - 1;
+    size_t i = var_hash(name, len) & mask;
+    while (table.slots[i].name != NULL
+           && (strncmp(table.slots[i].name, name, len) != 0 || table.slots[i].name[len] != '\0')) {
+        i = (i + 1) & mask;
+    }
+    return &table.slots[i];
+}
+
+/**
+ * @brief Double the size of the table.
+ *
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+static int var_grow() {
+    struct var_entry *old = table.slots;
+    size_t old_size = table.size;
+    size_t size = old_size ? 2 * old_size : VAR_MIN_SIZE;
+
+    struct var_entry *slots = calloc(size, sizeof(struct var_entry));
+    if (slots == NULL) {
+        perror("calloc");
+        return 1;
+    }
+    table.slots = slots;
+    table.size = size;
+    for (size_t i = 0; i < old_size; ++i) {
+        if (old[i].name != NULL) {
+            *var_slot(old[i].name, strlen(old[i].name)) = old[i];
+        }
+    }
+    free(old);
+    return 0;
+}
+
+/**
+ * @brief Find the slot of a name, adding the name to the table if needed.
+ *
+ * @param name The name (not necessarily '\0' terminated).
+ * @param len The length of the name.
+ * @return struct var_entry* The slot, or NULL on failure.
+ */
+static struct var_entry *var_entry(const char *name, size_t len) {
+    // Keep the load factor under 1/2
+    if (2 * (table.count + 1) > table.size && var_grow() != 0) {
+        return NULL;
+    }
+    struct var_entry *entry = var_slot(name, len);
+    if (entry->name == NULL) {
+        entry->name = strndup(name, len);
+        if (entry->name == NULL) {
+            perror("strndup");
+            return NULL;
+        }
+        table.count++;
+    }
+    return entry;
+}
+
+/**
+ * @brief Get the innermost binding of a name.
+ *
+ * @param name The name (not necessarily '\0' terminated).
+ * @param len The length of the name.
+ * @return struct var_binding* The binding, or NULL if the name was never bound.
+ */
+static struct var_binding *var_binding(const char *name, size_t len) {
+    if (table.size == 0) {
+        return NULL;
+    }
+    return var_slot(name, len)->top;
+}
+
+/**
+ * @brief Check if a string is a valid variable name.
+ *
+ * @param name The string.
+ * @param len The length of the string.
+ * @return bool Returns true if the string is a letter or '_', followed by letters, digits or '_'.
+ */
+static bool var_valid_name(const char *name, size_t len) {
+    if (len == 0 || (name[0] >= '0' && name[0] <= '9')) {
+        return false;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        char c = name[i];
+        if (!(c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Get the length of the name at the beginning of a string.
+ *
+ * @param str The string.
+ * @return size_t The length of the longest valid name prefix of str.
+ */
+static size_t var_name_len(const char *str) {
+    size_t len = 0;
+    while (var_valid_name(str, len + 1)) {
+        ++len;
+    }
+    return len;
+}
+
+/**
+ * @brief Change the value of a binding.
+ *
+ * @param b The binding.
+ * @param value The new value (copied), or NULL to unset the variable.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+static int var_assign(struct var_binding *b, const char *value) {
+    char *copy = NULL;
+    if (value != NULL) {
+        copy = strdup(value);
+        if (copy == NULL) {
+            perror("strdup");
+            return 1;
+        }
+    }
+    free(b->value);
+    b->value = copy;
+    if (b->exported) {
+        table.env_dirty = true;
+    }
+    return 0;
+}
+
+/**
+ * @brief Set a variable, given the length of its name.
+ *
+ * @param name The name (not necessarily '\0' terminated).
+ * @param len The length of the name.
+ * @param value The value (copied).
+ * @param exported A flag indicating if the variable must be exported (it stays exported if it already is).
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+static int var_set_len(const char *name, size_t len, const char *value, bool exported) {
+    struct var_entry *entry = var_entry(name, len);
+    if (entry == NULL) {
+        return 1;
+    }
+    if (entry->top == NULL) {
+        entry->top = calloc(1, sizeof(struct var_binding));
+        if (entry->top == NULL) {
+            perror("calloc");
+            return 1;
+        }
+    }
+    if (exported && !entry->top->exported) {
+        entry->top->exported = true;
+        table.env_dirty = true;
+    }
+    return var_assign(entry->top, value);
+}
+
+/**
+ * @brief Import the environment of the shell as exported variables.
+ *
+ * $PWD is kept if it names the current directory (it may go through symbolic
+ * links), and set to the physical path otherwise: afterwards it is only
+ * changed by 'cd', and reading it needs no system call.
+ *
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int var_init() {
+    for (char **env = environ; *env != NULL; ++env) {
+        char *eq = strchr(*env, '=');
+        if (eq != NULL && var_set_len(*env, eq - *env, eq + 1, true) != 0) {
+            return 1;
+        }
+    }
+
+    const char *pwd = var_get("PWD");
+    struct stat st_pwd, st_dot;
+    if (pwd != NULL && pwd[0] == '/' && stat(pwd, &st_pwd) == 0 && stat(".", &st_dot) == 0
+        && st_pwd.st_dev == st_dot.st_dev && st_pwd.st_ino == st_dot.st_ino) {
+        return 0;
+    }
+    char *cwd = getcwd(NULL, 0);
+    if (cwd == NULL) {
+        // The directory was removed: $PWD stays unknown until the next 'cd'
+        return 0;
+    }
+    int ret = var_export("PWD", cwd);
+    free(cwd);
+    return ret;
+}
+
+/**
+ * @brief Get the value of a variable.
+ *
+ * @param name The name of the variable.
+ * @return const char* The value (owned by the table), or NULL if the variable is not set.
+ */
+const char *var_get(const char *name) {
+    struct var_binding *b = var_binding(name, strlen(name));
+    return b != NULL ? b->value : NULL;
+}
+
+/**
+ * @brief Set a variable.
+ *
+ * The innermost binding of the variable is changed; a new variable is global.
+ *
+ * @param name The name of the variable.
+ * @param value The value (copied).
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int var_set(const char *name, const char *value) {
+    return var_set_len(name, strlen(name), value, false);
+}
+
+/**
+ * @brief Set a variable and export it to the commands.
+ *
+ * @param name The name of the variable.
+ * @param value The value (copied).
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int var_export(const char *name, const char *value) {
+    return var_set_len(name, strlen(name), value, true);
+}
+
+/**
+ * @brief Open a new scope of variables.
+ *
+ * The variables bound by var_set_local() until the matching var_pop_scope()
+ * hide the variables of the same name, which come back when the scope is closed.
+ *
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int var_push_scope() {
+    if (table.level + 1 >= table.cap_scopes) {
+        size_t cap = table.cap_scopes ? 2 * table.cap_scopes : 16;
+        size_t *scope_start = realloc(table.scope_start, cap * sizeof(size_t));
+        if (scope_start == NULL) {
+            perror("realloc");
+            return 1;
+        }
+        table.scope_start = scope_start;
+        table.cap_scopes = cap;
+    }
+    table.level++;
+    table.scope_start[table.level] = table.n_bound;
+    return 0;
+}
+
+/**
+ * @brief Close the innermost scope of variables.
+ */
+void var_pop_scope() {
+    if (table.level == 0) {
+        return;
+    }
+    size_t start = table.scope_start[table.level];
+    while (table.n_bound > start) {
+        char *name = table.bound[--table.n_bound];
+        struct var_entry *entry = var_slot(name, strlen(name));
+        struct var_binding *b = entry->top;
+        entry->top = b->prev;
+        if (b->exported || (b->prev != NULL && b->prev->exported)) {
+            table.env_dirty = true;
+        }
+        free(b->value);
+        free(b);
+    }
+    table.level--;
+}
+
+/**
+ * @brief Bind a variable in the innermost scope, given the length of its name.
+ *
+ * @param name The name (not necessarily '\0' terminated).
+ * @param len The length of the name.
+ * @param value The value (copied).
+ * @param exported A flag indicating if the variable is given to the commands.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+static int var_set_local_len(const char *name, size_t len, const char *value, bool exported) {
+    if (table.level == 0) {
+        return var_set_len(name, len, value, exported);
+    }
+    struct var_entry *entry = var_entry(name, len);
+    if (entry == NULL) {
+        return 1;
+    }
+    if (entry->top != NULL && entry->top->level == table.level) {
+        // Already bound in this scope
+        entry->top->exported |= exported;
+        table.env_dirty |= exported;
+        return var_assign(entry->top, value);
+    }
+
+    if (table.n_bound == table.cap_bound) {
+        size_t cap = table.cap_bound ? 2 * table.cap_bound : 16;
+        char **bound = realloc(table.bound, cap * sizeof(char *));
+        if (bound == NULL) {
+            perror("realloc");
+            return 1;
+        }
+        table.bound = bound;
+        table.cap_bound = cap;
+    }
+    struct var_binding *b = calloc(1, sizeof(struct var_binding));
+    if (b == NULL) {
+        perror("calloc");
+        return 1;
+    }
+    b->exported = exported;
+    b->level = table.level;
+    b->prev = entry->top;
+    if (var_assign(b, value) != 0) {
+        free(b);
+        return 1;
+    }
+    entry->top = b;
+    table.bound[table.n_bound++] = entry->name;
+    if (exported || (b->prev != NULL && b->prev->exported)) {
+        table.env_dirty = true;
+    }
+    return 0;
+}
+
+/**
+ * @brief Bind a variable in the innermost scope.
+ *
+ * @param name The name of the variable.
+ * @param value The value (copied).
+ * @param exported A flag indicating if the variable is given to the commands.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int var_set_local(const char *name, const char *value, bool exported) {
+    return var_set_local_len(name, strlen(name), value, exported);
+}
+
+/**
+ * @brief Get the environment given to the launched commands.
+ *
+ * The array is only rebuilt when an exported variable has changed since the
+ * last call: launching many commands does not copy the environment each time.
+ *
+ * @return char** The NULL terminated array of "name=value" strings (owned by the table).
+ */
+char **var_environ() {
+    if (!table.env_dirty && table.envp != NULL) {
+        return table.envp;
+    }
+
+    size_t n = 0;
+    size_t len = 0;
+    for (size_t i = 0; i < table.size; ++i) {
+        struct var_binding *b = table.slots[i].top;
+        if (table.slots[i].name != NULL && b != NULL && b->exported && b->value != NULL) {
+            ++n;
+            len += strlen(table.slots[i].name) + strlen(b->value) + 2;
+        }
+    }
+
+    char **envp = malloc((n + 1) * sizeof(char *));
+    char *buf = malloc(len + 1);
+    if (envp == NULL || buf == NULL) {
+        perror("malloc");
+        free(envp);
+        free(buf);
+        // Keep the previous environment
+        return table.envp != NULL ? table.envp : environ;
+    }
+    char *p = buf;
+    n = 0;
+    for (size_t i = 0; i < table.size; ++i) {
+        struct var_binding *b = table.slots[i].top;
+        if (table.slots[i].name != NULL && b != NULL && b->exported && b->value != NULL) {
+            envp[n++] = p;
+            p = stpcpy(p, table.slots[i].name);
+            *p++ = '=';
+            p = stpcpy(p, b->value) + 1;
+        }
+    }
+    envp[n] = NULL;
+
+    free(table.envp);
+    free(table.env_buf);
+    table.envp = envp;
+    table.env_buf = buf;
+    table.env_dirty = false;
+    return envp;
+}
+
+/**
+ * @brief Find the variable referenced after a '$'.
+ *
+ * @param str Pointer to the char following the '$'.
+ * @param value Pointer to the value of the variable ("" if it is not set), or NULL if
+ *              the '$' does not start a reference (it is then a plain char).
+ * @param number Buffer used for the values of $? and $$.
+ * @return size_t The number of chars of the reference after the '$', or (size_t)-1 if
+ *                a "${" is not closed or contains an invalid name.
+ */
+static size_t var_reference(const char *str, const char **value, char number[24]) {
+    *value = NULL;
+    if (str[0] == '?' || str[0] == '$') {
+        snprintf(number, 24, "%d", str[0] == '?' ? shell_status : (int)getpid());
+        *value = number;
+        return 1;
+    }
+
+    const char *name = str;
+    size_t len;
+    size_t used;
+    if (str[0] == '{') {
+        const char *end = strchr(str, '}');
+        if (end == NULL || !var_valid_name(str + 1, end - str - 1)) {
+            return (size_t)-1;
+        }
+        name = str + 1;
+        len = end - str - 1;
+        used = len + 2;
+    } else {
+        len = var_name_len(str);
+        if (len == 0) {
+            return 0;
+        }
+        used = len;
+    }
+
+    struct var_binding *b = var_binding(name, len);
+    *value = b != NULL && b->value != NULL ? b->value : "";
+    return used;
+}
+
+/**
+ * @brief Expand the variables of a word.
+ *
+ * @param li The line owning the word.
+ * @param word The word.
+ * @return char* The word itself if it has no variable, the expanded word
+ *               (in the arena of the line), or NULL on error.
+ */
+static char *var_expand_word(struct line *li, char *word) {
+    if (strchr(word, '$') == NULL) {
+        return word;
+    }
+
+    // First pass: the length of the result
+    char number[24];
+    size_t len = 0;
+    for (const char *p = word; *p != '\0'; ++p) {
+        const char *value;
+        size_t used = *p == '$' ? var_reference(p + 1, &value, number) : 0;
+        if (used == (size_t)-1) {
+            fprintf(stderr, "%s: bad substitution\n", word);
+            return NULL;
+        }
+        if (used == 0 || value == NULL) {
+            ++len;
+        } else {
+            len += strlen(value);
+            p += used;
+        }
+    }
+
+    char *result = line_alloc(li, len + 1);
+    if (result == NULL) {
+        return NULL;
+    }
+    char *out = result;
+    for (const char *p = word; *p != '\0'; ++p) {
+        const char *value;
+        size_t used = *p == '$' ? var_reference(p + 1, &value, number) : 0;
+        if (used == 0 || value == NULL) {
+            *out++ = *p;
+        } else {
+            out = stpcpy(out, value);
+            p += used;
+        }
+    }
+    *out = '\0';
+    return result;
+}
+
+/**
+ * @brief Check if a word is an assignment NAME=value.
+ *
+ * @param word The word.
+ * @return bool Returns true if the word is an assignment.
+ */
+static bool var_is_assign(const char *word) {
+    const char *eq = strchr(word, '=');
+    return eq != NULL && var_valid_name(word, eq - word);
+}
+
+/**
+ * @brief Expand the variables of a parsed line and find its assignments.
+ *
+ * $NAME, ${NAME}, $? (status of the last line) and $$ (pid of the shell) are
+ * replaced by their value in all the words of the line. A word without '$'
+ * is left as is; an expanded word is written in the arena of the line.
+ * There is no field splitting: a variable always expands to one word.
+ * The body of a here-document is expanded too, unless its end word is quoted.
+ * The leading words of a command of the form NAME=value are moved from
+ * cmd->args to cmd->assigns.
+ *
+ * @param li The parsed line.
+ * @return int Returns 0 on success, or -1 if the line is not valid.
+ */
+int var_expand_line(struct line *li) {
+    for (size_t i = 0; i < li->n_cmds; ++i) {
+        struct cmd *cmd = &li->cmds[i];
+        size_t n_assigns = 0;
+        while (n_assigns < cmd->n_args && var_is_assign(cmd->args[n_assigns])) {
+            ++n_assigns;
+        }
+        for (size_t k = 0; k < cmd->n_args; ++k) {
+            cmd->args[k] = var_expand_word(li, cmd->args[k]);
+            if (cmd->args[k] == NULL) {
+                return -1;
+            }
+        }
+        cmd->assigns = cmd->args;
+        cmd->n_assigns = n_assigns;
+        cmd->args += n_assigns;
+        cmd->n_args -= n_assigns;
+
+        // The body of a here-document whose end word is quoted is taken as is
+        for (size_t k = 0; k < cmd->n_redirs; ++k) {
+            struct redir *r = &cmd->redirs[k];
+            if (r->target != NULL && !r->literal && (r->target = var_expand_word(li, r->target)) == NULL) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Apply the assignments of a command for the command only.
+ *
+ * A scope is opened, in which the assigned variables are exported: the caller
+ * closes it with var_pop_scope() once the command is launched. On failure,
+ * no scope is left open.
+ *
+ * @param cmd The command.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int var_push_assigns(const struct cmd *cmd) {
+    if (var_push_scope() != 0) {
+        return 1;
+    }
+    for (size_t k = 0; k < cmd->n_assigns; ++k) {
+        const char *eq = strchr(cmd->assigns[k], '=');
+        if (var_set_local_len(cmd->assigns[k], eq - cmd->assigns[k], eq + 1, true) != 0) {
+            var_pop_scope();
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Apply the assignments of a command without arguments to the shell.
+ *
+ * @param cmd The command.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int var_set_assigns(const struct cmd *cmd) {
+    for (size_t k = 0; k < cmd->n_assigns; ++k) {
+        const char *eq = strchr(cmd->assigns[k], '=');
+        if (var_set_len(cmd->assigns[k], eq - cmd->assigns[k], eq + 1, false) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Export variables.
+ *
+ * This function implements the 'export' command for the shell:
+ * 'export' lists the exported variables, 'export NAME[=value]...' exports them.
+ *
+ * @param args Array of arguments where args[0] is "export".
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int execute_command_intern_export(char **args) {
+    if (args[1] == NULL) {
+        for (char **env = var_environ(); *env != NULL; ++env) {
+            printf("export %s\n", *env);
+        }
+        return 0;
+    }
+
+    int ret = 0;
+    for (size_t i = 1; args[i] != NULL; ++i) {
+        const char *eq = strchr(args[i], '=');
+        size_t len = eq != NULL ? (size_t)(eq - args[i]) : strlen(args[i]);
+        if (!var_valid_name(args[i], len)) {
+            fprintf(stderr, "export: %s: not a valid identifier\n", args[i]);
+            ret = 1;
+            continue;
+        }
+        const char *value = eq + 1;
+        if (eq == NULL) {
+            // Keep the current value
+            struct var_binding *b = var_binding(args[i], len);
+            value = b != NULL && b->value != NULL ? b->value : "";
+        }
+        if (var_set_len(args[i], len, value, true) != 0) {
+            ret = 1;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief Unset variables.
+ *
+ * This function implements the 'unset' command for the shell.
+ *
+ * @param args Array of arguments where args[0] is "unset".
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int execute_command_intern_unset(char **args) {
+    int ret = 0;
+    for (size_t i = 1; args[i] != NULL; ++i) {
+        size_t len = strlen(args[i]);
+        if (!var_valid_name(args[i], len)) {
+            fprintf(stderr, "unset: %s: not a valid identifier\n", args[i]);
+            ret = 1;
+            continue;
+        }
+        struct var_binding *b = var_binding(args[i], len);
+        if (b != NULL) {
+            var_assign(b, NULL);
+            if (b->exported) {
+                b->exported = false;
+                table.env_dirty = true;
+            }
+        }
+    }
+    return ret;
+}
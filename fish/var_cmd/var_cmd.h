@@ -0,0 +1,139 @@
+#ifndef VAR_CMD_H
+#define VAR_CMD_H
+
+#include <stdbool.h>
+
+#include "cmdline.h"
+
+/**
+ * @brief Import the environment of the shell as exported variables.
+ *
+ * $PWD is kept if it names the current directory (it may go through symbolic
+ * links), and set to the physical path otherwise: afterwards it is only
+ * changed by 'cd', and reading it needs no system call.
+ *
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int var_init();
+
+/**
+ * @brief Get the value of a variable.
+ *
+ * @param name The name of the variable.
+ * @return const char* The value (owned by the table), or NULL if the variable is not set.
+ */
+const char *var_get(const char *name);
+
+/**
+ * @brief Set a variable.
+ *
+ * The innermost binding of the variable is changed; a new variable is global.
+ *
+ * @param name The name of the variable.
+ * @param value The value (copied).
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int var_set(const char *name, const char *value);
+
+/**
+ * @brief Set a variable and export it to the commands.
+ *
+ * @param name The name of the variable.
+ * @param value The value (copied).
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int var_export(const char *name, const char *value);
+
+/**
+ * @brief Open a new scope of variables.
+ *
+ * The variables bound by var_set_local() until the matching var_pop_scope()
+ * hide the variables of the same name, which come back when the scope is closed.
+ *
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int var_push_scope();
+
+/**
+ * @brief Close the innermost scope of variables.
+ */
+void var_pop_scope();
+
+/**
+ * @brief Bind a variable in the innermost scope.
+ *
+ * @param name The name of the variable.
+ * @param value The value (copied).
+ * @param exported A flag indicating if the variable is given to the commands.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int var_set_local(const char *name, const char *value, bool exported);
+
+/**
+ * @brief Get the environment given to the launched commands.
+ *
+ * The array is only rebuilt when an exported variable has changed since the
+ * last call: launching many commands does not copy the environment each time.
+ *
+ * @return char** The NULL terminated array of "name=value" strings (owned by the table).
+ */
+char **var_environ();
+
+/**
+ * @brief Expand the variables of a parsed line and find its assignments.
+ *
+ * $NAME, ${NAME}, $? (status of the last line) and $$ (pid of the shell) are
+ * replaced by their value in all the words of the line. A word without '$'
+ * is left as is; an expanded word is written in the arena of the line.
+ * There is no field splitting: a variable always expands to one word.
+ * The body of a here-document is expanded too, unless its end word is quoted.
+ * The leading words of a command of the form NAME=value are moved from
+ * cmd->args to cmd->assigns.
+ *
+ * @param li The parsed line.
+ * @return int Returns 0 on success, or -1 if the line is not valid.
+ */
+int var_expand_line(struct line *li);
+
+/**
+ * @brief Apply the assignments of a command for the command only.
+ *
+ * A scope is opened, in which the assigned variables are exported: the caller
+ * closes it with var_pop_scope() once the command is launched. On failure,
+ * no scope is left open.
+ *
+ * @param cmd The command.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int var_push_assigns(const struct cmd *cmd);
+
+/**
+ * @brief Apply the assignments of a command without arguments to the shell.
+ *
+ * @param cmd The command.
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int var_set_assigns(const struct cmd *cmd);
+
+/**
+ * @brief Export variables.
+ *
+ * This function implements the 'export' command for the shell:
+ * 'export' lists the exported variables, 'export NAME[=value]...' exports them.
+ *
+ * @param args Array of arguments where args[0] is "export".
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int execute_command_intern_export(char **args);
+
+/**
+ * @brief Unset variables.
+ *
+ * This function implements the 'unset' command for the shell.
+ *
+ * @param args Array of arguments where args[0] is "unset".
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int execute_command_intern_unset(char **args);
+
+#endif /* VAR_CMD_H */